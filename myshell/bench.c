@@ -0,0 +1,205 @@
+// bench.c
+// Micro-benchmarks for the server's hot paths.
+// Usage: ./bench spawn [-n count] [-m MB]
+//        ./bench parse [-n count] [-p pipes] [-c]
+//   spawn   Launch latency of /bin/true: fork()+execvp(), the old shell path
+//           (a forked capture process that forks the command), and posix_spawn()
+//           as used by spawn.c. Each launch is waited for before the next.
+//   -n      launches per method (default 2000)
+//   -m      MB of touched heap held while launching, standing in for a loaded
+//           server whose page tables fork() must copy (default 0)
+//   parse   parse_input() + free_pipeline() throughput over a mix of typical
+//           commands; -n sets the number of parses (default 1000000)
+//   -p      parse instead one generated line of that many pipes, indented by as
+//           many spaces, to check that the cost grows linearly with its length
+//   -c      look the commands up in the parse cache (pcache.c) instead, as the
+//           server does: after the first round every lookup is a hit
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "spawn.h"
+#include "parse.h"
+#include "pcache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define BENCH_DEFAULT_COUNT 2000
+#define BENCH_PARSE_COUNT   1000000
+
+static char *const true_argv[] = { "true", NULL };
+
+// the command mix parsed by ./bench parse
+static const char *const parse_mix[] = {
+    "ls",
+    "pwd",
+    "ls -la /usr/bin",
+    "cat file.txt | grep pattern | wc -l",
+    "echo \"Hello World\" > out.txt",
+    "grep -v 'a|b' < input.txt 2> errors.log | sort | uniq -c | sort -rn | head -n 5",
+};
+
+
+// Current CLOCK_MONOTONIC time in nanoseconds.
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+// fork() a child that execs the program directly.
+static pid_t launch_fork(void) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        execvp(true_argv[0], true_argv);
+        _exit(127);
+    }
+    return pid;
+}
+
+
+// fork() a capture process that forks and waits for the program, as the server
+// did before spawn.c.
+static pid_t launch_fork_capture(void) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        pid_t inner = launch_fork();
+        if (inner < 0) _exit(1);
+        waitpid(inner, NULL, 0);
+        _exit(0);
+    }
+    return pid;
+}
+
+
+// posix_spawn() through the launch layer.
+static pid_t launch_spawn(void) {
+    SpawnIO io = SPAWN_IO_INHERIT;
+    return spawn_process(true_argv, &io);
+}
+
+
+// Launches and reaps the program count times with launch() and prints the mean
+// latency per launch.
+static void run_spawn_case(const char *name, pid_t (*launch)(void), int count) {
+    long long start = now_ns();
+    for (int i = 0; i < count; i++) {
+        pid_t pid = launch();
+        if (pid < 0) { perror(name); return; }
+        while (waitpid(pid, NULL, 0) < 0) { }
+    }
+    long long elapsed = now_ns() - start;
+    printf("%-14s %6d launches  %8.1f us/launch\n",
+           name, count, (double)elapsed / count / 1000.0);
+}
+
+
+// ./bench spawn: compares the three launch methods.
+static int bench_spawn(int argc, char *argv[]) {
+    int    count = BENCH_DEFAULT_COUNT;
+    size_t mb    = 0;
+    int    opt;
+    while ((opt = getopt(argc, argv, "n:m:")) != -1) {
+        if      (opt == 'n') count = atoi(optarg);
+        else if (opt == 'm') mb    = (size_t)atol(optarg);
+        else {
+            fprintf(stderr, "Usage: %s spawn [-n count] [-m MB]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (count <= 0) count = BENCH_DEFAULT_COUNT;
+
+    // resident ballast: every page is touched so fork() has to copy its mappings
+    char *ballast = NULL;
+    if (mb > 0) {
+        ballast = malloc(mb << 20);
+        if (ballast == NULL) { perror("malloc"); return 1; }
+        memset(ballast, 1, mb << 20);
+    }
+
+    printf("spawn latency, %zu MB resident ballast\n", mb);
+    run_spawn_case("fork+exec",    launch_fork,         count);
+    run_spawn_case("fork-capture", launch_fork_capture, count);
+    run_spawn_case("posix_spawn",  launch_spawn,        count);
+    free(ballast);
+    return 0;
+}
+
+
+// ./bench parse: parses the command mix round-robin and prints commands/sec.
+static int bench_parse(int argc, char *argv[]) {
+    long count = BENCH_PARSE_COUNT;
+    long pipes = 0;
+    int  cache = 0;
+    int  opt;
+    while ((opt = getopt(argc, argv, "n:p:c")) != -1) {
+        if      (opt == 'n') count = atol(optarg);
+        else if (opt == 'p') pipes = atol(optarg);
+        else if (opt == 'c') cache = 1;
+        else {
+            fprintf(stderr, "Usage: %s parse [-n count] [-p pipes] [-c]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (count <= 0) count = BENCH_PARSE_COUNT;
+
+    const char *const *mix   = parse_mix;
+    size_t             nmix  = sizeof(parse_mix) / sizeof(parse_mix[0]);
+    char              *line  = NULL;
+    if (pipes > 0) {
+        // "   ...cat | wc | wc ..." with one leading space per pipe
+        line = malloc((size_t)pipes * 6 + 4);
+        if (!line) { perror("malloc"); return 1; }
+        char *p = line;
+        memset(p, ' ', (size_t)pipes);
+        p += pipes;
+        memcpy(p, "cat", 3);
+        p += 3;
+        for (long i = 0; i < pipes; i++, p += 5) memcpy(p, " | wc", 5);
+        *p = '\0';
+        mix  = (const char *const *)&line;
+        nmix = 1;
+        if (count == BENCH_PARSE_COUNT) count = BENCH_PARSE_COUNT / (pipes + 1) + 1;
+    }
+
+    long      words = 0;  // keeps the parse from being optimised away
+    long long start = now_ns();
+    for (long i = 0; i < count; i++) {
+        if (cache) {
+            char         err[256];
+            PCacheEntry *e;
+            int          n = pcache_get(mix[(size_t)i % nmix], &e, err, sizeof(err));
+            words += n;
+            if (n > 0) pcache_put(e);
+            continue;
+        }
+        Pipeline p = parse_input(mix[(size_t)i % nmix]);
+        words += p.command_count;
+        free_pipeline(&p);
+    }
+    long long elapsed = now_ns() - start;
+    printf("%s: %ld commands (%ld stages) in %.3f s, %.0f commands/sec, %.0f ns/command\n",
+           cache ? "pcache" : "parse", count, words, (double)elapsed / 1e9, count / ((double)elapsed / 1e9),
+           (double)elapsed / count);
+    if (line) printf("       %zu-byte line: %.2f ns/byte\n", strlen(line),
+                     (double)elapsed / count / (double)strlen(line));
+    free(line);
+    return 0;
+}
+
+
+int main(int argc, char *argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "spawn") == 0)
+        return bench_spawn(argc - 1, argv + 1);
+    if (argc >= 2 && strcmp(argv[1], "parse") == 0)
+        return bench_parse(argc - 1, argv + 1);
+
+    fprintf(stderr, "Usage: %s spawn [-n count] [-m MB]\n"
+                    "       %s parse [-n count] [-p pipes] [-c]\n", argv[0], argv[0]);
+    return 1;
+}
@@ -0,0 +1,461 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "builtin.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BUILTIN_BUF     65536   // read/write buffer of cat, wc and head
+#define HEAD_DEFAULT_N     10   // lines printed by head without -n
+
+// Buffered output to a descriptor, so a builtin makes one write() per
+// BUILTIN_BUF bytes however many lines it prints. After a failed write (the
+// reader went away) further output is dropped.
+typedef struct {
+    int    fd;
+    int    failed;
+    size_t len;
+    char   buf[BUILTIN_BUF];
+} Out;
+
+
+// Writes the buffered bytes. Returns 0, or -1 once a write has failed.
+static int out_flush(Out *o) {
+    size_t off = 0;
+    while (!o->failed && off < o->len) {
+        ssize_t n = write(o->fd, o->buf + off, o->len - off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) o->failed = 1;
+        else        off += (size_t)n;
+    }
+    o->len = 0;
+    return o->failed ? -1 : 0;
+}
+
+
+// Appends len bytes, flushing whenever the buffer fills.
+static int out_write(Out *o, const char *data, size_t len) {
+    while (len > 0 && !o->failed) {
+        size_t room = sizeof(o->buf) - o->len;
+        size_t n    = len < room ? len : room;
+        memcpy(o->buf + o->len, data, n);
+        o->len += n;
+        data   += n;
+        len    -= n;
+        if (o->len == sizeof(o->buf)) out_flush(o);
+    }
+    return o->failed ? -1 : 0;
+}
+
+
+// Appends a NUL-terminated string.
+static int out_str(Out *o, const char *s) {
+    return out_write(o, s, strlen(s));
+}
+
+
+// Opens a file operand, "-" meaning in_fd. Reports a failure on err_fd as
+// "<cmd>: <path>: <reason>". Returns the fd (in_fd for "-"), or -1.
+static int open_operand(const char *cmd, const char *path, int in_fd, int err_fd) {
+    if (strcmp(path, "-") == 0) return in_fd;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        dprintf(err_fd, "%s: %s: %s\n", cmd, path, strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISDIR(st.st_mode)) {
+        dprintf(err_fd, "%s: %s: Is a directory\n", cmd, path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+// Reads up to len bytes, retrying on EINTR. Returns the count, 0 at EOF, -1 on error.
+static ssize_t read_some(int fd, char *buf, size_t len) {
+    ssize_t n;
+    while ((n = read(fd, buf, len)) < 0 && errno == EINTR) {}
+    return n;
+}
+
+
+// Parses a non-negative decimal count. Returns -1 if s is not one.
+static long parse_count(const char *s) {
+    if (*s == '\0') return -1;
+    for (const char *p = s; *p; p++) if (!isdigit((unsigned char)*p)) return -1;
+    return strtol(s, NULL, 10);
+}
+
+
+// ── echo [-e] [args] ──────────────────────────────────────────────────────
+// Prints its arguments separated by spaces; -e expands \n, \t and \\.
+static int builtin_echo(int argc, char *const argv[], int in_fd, int out_fd, int err_fd) {
+    (void)in_fd; (void)err_fd;
+    Out *o = malloc(sizeof(Out));
+    if (o == NULL) return 1;
+    o->fd = out_fd; o->failed = 0; o->len = 0;
+
+    int interpret_escapes = 0;  // set when -e flag is present
+    int start = 1;              // index of the first argument to print
+    if (argc > 1 && strcmp(argv[1], "-e") == 0) {
+        interpret_escapes = 1;
+        start = 2;  // skip the -e flag itself
+    }
+    for (int j = start; j < argc; ++j) {
+        if (j > start) out_write(o, " ", 1);  // space between arguments
+        for (const char *p = argv[j]; *p; ++p) {
+            char c = *p;
+            if (interpret_escapes && *p == '\\' && *(p + 1)) {
+                ++p;
+                c = (*p == 'n') ? '\n' : (*p == 't') ? '\t' : *p;
+            }
+            out_write(o, &c, 1);
+        }
+    }
+    out_write(o, "\n", 1);  // echo always ends with a newline
+    out_flush(o);
+    free(o);
+    return 0;
+}
+
+
+// ── pwd ───────────────────────────────────────────────────────────────────
+static int builtin_pwd(int argc, char *const argv[], int in_fd, int out_fd, int err_fd) {
+    (void)argc; (void)argv; (void)in_fd;
+    char path[PATH_MAX + 1];
+    if (getcwd(path, sizeof(path) - 1) == NULL) {
+        dprintf(err_fd, "pwd: %s\n", strerror(errno));
+        return 1;
+    }
+    size_t len = strlen(path);
+    path[len++] = '\n';  // one short line: written directly
+    ssize_t n = write(out_fd, path, len);
+    return n == (ssize_t)len ? 0 : 1;
+}
+
+
+// pwd only takes no arguments here (-L/-P make no difference without symlinks in play)
+static int accepts_no_args(int argc, char *const argv[]) {
+    (void)argv;
+    return argc == 1;
+}
+
+
+// ── true / false ──────────────────────────────────────────────────────────
+static int builtin_true(int argc, char *const argv[], int in_fd, int out_fd, int err_fd) {
+    (void)argc; (void)argv; (void)in_fd; (void)out_fd; (void)err_fd;
+    return 0;
+}
+
+static int builtin_false(int argc, char *const argv[], int in_fd, int out_fd, int err_fd) {
+    (void)argc; (void)argv; (void)in_fd; (void)out_fd; (void)err_fd;
+    return 1;
+}
+
+
+// ── cat [file...] ─────────────────────────────────────────────────────────
+// Copies each file (stdin without operands or for "-") to the output.
+static int builtin_cat(int argc, char *const argv[], int in_fd, int out_fd, int err_fd) {
+    Out *o = malloc(sizeof(Out));
+    if (o == NULL) return 1;
+    o->fd = out_fd; o->failed = 0; o->len = 0;
+
+    int status = 0;
+    for (int i = (argc > 1 ? 1 : 0); i < argc && !o->failed; i++) {
+        int fd = (argc > 1) ? open_operand("cat", argv[i], in_fd, err_fd) : in_fd;
+        if (fd < 0) { status = 1; continue; }
+
+        // read straight into the output buffer; it is flushed whenever full
+        ssize_t n;
+        while ((n = read_some(fd, o->buf + o->len, sizeof(o->buf) - o->len)) > 0) {
+            o->len += (size_t)n;
+            if (o->len == sizeof(o->buf) && out_flush(o) < 0) break;
+        }
+        if (n < 0) {
+            dprintf(err_fd, "cat: %s: %s\n", argc > 1 ? argv[i] : "-", strerror(errno));
+            status = 1;
+        }
+        if (fd != in_fd) close(fd);
+    }
+    if (out_flush(o) < 0) status = 1;
+    free(o);
+    return status;
+}
+
+
+// cat takes file operands only; any option runs the real cat
+static int accepts_operands(int argc, char *const argv[]) {
+    for (int i = 1; i < argc; i++)
+        if (argv[i][0] == '-' && argv[i][1] != '\0') return 0;
+    return 1;
+}
+
+
+// ── ls [-a] [-1] [path] ───────────────────────────────────────────────────
+// Lists one directory (or names one file), one entry per line, as ls does when
+// its output is not a terminal. Names are sorted by strcmp(), i.e. in byte
+// order, which is what GNU ls prints only in the C/POSIX locale; under a UTF-8
+// locale such as en_US.UTF-8 GNU ls collates ("a", "B", "c" rather than "B",
+// "a", "c"), so the two can differ in order, though never in content.
+
+// qsort comparator for entry names.
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+
+static int builtin_ls(int argc, char *const argv[], int in_fd, int out_fd, int err_fd) {
+    (void)in_fd;
+    int         all  = 0;
+    const char *path = ".";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-a") == 0)      all  = 1;
+        else if (strcmp(argv[i], "-1") != 0) path = argv[i];
+    }
+
+    struct stat st;
+    if (stat(path, &st) < 0) {
+        dprintf(err_fd, "ls: cannot access '%s': %s\n", path, strerror(errno));
+        return 2;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        dprintf(out_fd, "%s\n", path);
+        return 0;
+    }
+
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        dprintf(err_fd, "ls: cannot open directory '%s': %s\n", path, strerror(errno));
+        return 2;
+    }
+
+    // collect the names, then sort them
+    size_t count = 0, cap = 64;
+    char **names = malloc(cap * sizeof(char *));
+    struct dirent *de;
+    while (names != NULL && (de = readdir(dir)) != NULL) {
+        if (de->d_name[0] == '.' && !all) continue;  // hidden unless -a
+        if (count == cap) {
+            char **bigger = realloc(names, cap * 2 * sizeof(char *));
+            if (bigger == NULL) break;
+            names = bigger;
+            cap  *= 2;
+        }
+        names[count] = strdup(de->d_name);
+        if (names[count] != NULL) count++;
+    }
+    closedir(dir);
+    if (names == NULL) { dprintf(err_fd, "ls: %s\n", strerror(ENOMEM)); return 2; }
+    qsort(names, count, sizeof(char *), compare_names);
+
+    Out *o = malloc(sizeof(Out));
+    if (o != NULL) {
+        o->fd = out_fd; o->failed = 0; o->len = 0;
+        for (size_t i = 0; i < count; i++) {
+            out_str(o, names[i]);
+            out_write(o, "\n", 1);
+        }
+        out_flush(o);
+        free(o);
+    }
+    for (size_t i = 0; i < count; i++) free(names[i]);
+    free(names);
+    return o != NULL ? 0 : 2;
+}
+
+
+// ls: only -a and -1, and at most one path
+static int accepts_ls(int argc, char *const argv[]) {
+    int paths = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-a") == 0 || strcmp(argv[i], "-1") == 0) continue;
+        if (argv[i][0] == '-') return 0;
+        paths++;
+    }
+    return paths <= 1;
+}
+
+
+// ── wc [-l] [-w] [-c] [file] ──────────────────────────────────────────────
+// Counts lines, words and bytes of one input, printed like GNU wc.
+static int builtin_wc(int argc, char *const argv[], int in_fd, int out_fd, int err_fd) {
+    int         want_l = 0, want_w = 0, want_c = 0;
+    const char *path   = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            for (const char *p = argv[i] + 1; *p; p++) {
+                if (*p == 'l') want_l = 1;
+                if (*p == 'w') want_w = 1;
+                if (*p == 'c') want_c = 1;
+            }
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!want_l && !want_w && !want_c) want_l = want_w = want_c = 1;
+
+    int fd = path ? open_operand("wc", path, in_fd, err_fd) : in_fd;
+    if (fd < 0) return 1;
+
+    char *buf = malloc(BUILTIN_BUF);
+    if (buf == NULL) { if (fd != in_fd) close(fd); return 1; }
+    long long lines = 0, words = 0, bytes = 0;
+    int       in_word = 0;
+    ssize_t   n;
+    while ((n = read_some(fd, buf, BUILTIN_BUF)) > 0) {
+        bytes += n;
+        for (ssize_t i = 0; i < n; i++) {
+            unsigned char c = (unsigned char)buf[i];
+            if (c == '\n') lines++;
+            if (isspace(c))   in_word = 0;
+            else if (!in_word) { in_word = 1; words++; }
+        }
+    }
+    free(buf);
+    int status = 0;
+    if (n < 0) {
+        dprintf(err_fd, "wc: %s: %s\n", path ? path : "-", strerror(errno));
+        status = 1;
+    }
+
+    // GNU wc pads every count to one width when it prints several: the digits
+    // of a regular file's size, or 7 for other input
+    int         shown = want_l + want_w + want_c;
+    int         width = 1;
+    struct stat st;
+    if (shown > 1) {
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            for (long long v = st.st_size; v >= 10; v /= 10) width++;
+        } else {
+            width = 7;
+        }
+    }
+    if (fd != in_fd) close(fd);
+
+    char line[128];
+    int  len = 0;
+    long long counts[3] = { lines, words, bytes };
+    int       wanted[3] = { want_l, want_w, want_c };
+    for (int i = 0; i < 3; i++) {
+        if (!wanted[i]) continue;
+        len += snprintf(line + len, sizeof(line) - (size_t)len, "%s%*lld",
+                        len > 0 ? " " : "", width, counts[i]);
+    }
+    dprintf(out_fd, "%s%s%s\n", line, path ? " " : "", path ? path : "");
+    return status;
+}
+
+
+// wc: -l, -w, -c in any combination, and at most one operand
+static int accepts_wc(int argc, char *const argv[]) {
+    int paths = 0;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            if (strspn(argv[i] + 1, "lwc") != strlen(argv[i] + 1)) return 0;
+        } else {
+            paths++;
+        }
+    }
+    return paths <= 1;
+}
+
+
+// ── head [-n N | -N] [file] ───────────────────────────────────────────────
+// Prints the first N lines of one input.
+
+// Extracts N from the arguments; returns -1 if they are not understood.
+static long head_count(int argc, char *const argv[], const char **path) {
+    long n = HEAD_DEFAULT_N;
+    *path  = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0) {
+            if (i + 1 >= argc || (n = parse_count(argv[++i])) < 0) return -1;
+        } else if (strncmp(argv[i], "-n", 2) == 0) {
+            if ((n = parse_count(argv[i] + 2)) < 0) return -1;
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            if ((n = parse_count(argv[i] + 1)) < 0) return -1;
+        } else {
+            if (*path != NULL) return -1;  // one file at most
+            *path = argv[i];
+        }
+    }
+    return n;
+}
+
+
+static int builtin_head(int argc, char *const argv[], int in_fd, int out_fd, int err_fd) {
+    const char *path;
+    long        want = head_count(argc, argv, &path);
+    int         fd   = path ? open_operand("head", path, in_fd, err_fd) : in_fd;
+    if (fd < 0) return 1;
+
+    Out *o = malloc(sizeof(Out));
+    char *buf = malloc(BUILTIN_BUF);
+    if (o == NULL || buf == NULL) {
+        free(o); free(buf);
+        if (fd != in_fd) close(fd);
+        return 1;
+    }
+    o->fd = out_fd; o->failed = 0; o->len = 0;
+
+    // stop reading as soon as the last wanted newline has been copied
+    long    lines = 0;
+    ssize_t n     = 0;
+    while (lines < want && (n = read_some(fd, buf, BUILTIN_BUF)) > 0) {
+        ssize_t take = n;
+        for (ssize_t i = 0; i < n; i++) {
+            if (buf[i] == '\n' && ++lines == want) { take = i + 1; break; }
+        }
+        if (out_write(o, buf, (size_t)take) < 0) break;
+    }
+    int status = 0;
+    if (n < 0) {
+        dprintf(err_fd, "head: %s: %s\n", path ? path : "-", strerror(errno));
+        status = 1;
+    }
+    out_flush(o);
+    free(o);
+    free(buf);
+    if (fd != in_fd) close(fd);
+    return status;
+}
+
+
+static int accepts_head(int argc, char *const argv[]) {
+    const char *path;
+    return head_count(argc, argv, &path) >= 0;
+}
+
+
+// The registry. Bounded builtins print only what their arguments determine.
+static const Builtin builtins[] = {
+    { "echo",  builtin_echo,  NULL,             1 },
+    { "pwd",   builtin_pwd,   accepts_no_args,  1 },
+    { "true",  builtin_true,  NULL,             1 },
+    { "false", builtin_false, NULL,             1 },
+    { "cat",   builtin_cat,   accepts_operands, 0 },
+    { "ls",    builtin_ls,    accepts_ls,       0 },
+    { "wc",    builtin_wc,    accepts_wc,       0 },
+    { "head",  builtin_head,  accepts_head,     0 },
+};
+
+
+const Builtin *builtin_find(int argc, char *const argv[]) {
+    if (argc < 1 || argv[0] == NULL) return NULL;
+    for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++) {
+        const Builtin *b = &builtins[i];
+        if (strcmp(argv[0], b->name) != 0) continue;
+        return (b->accepts == NULL || b->accepts(argc, argv)) ? b : NULL;
+    }
+    return NULL;
+}
@@ -0,0 +1,28 @@
+// builtin.h
+// In-process implementations of the commands that make up most requests, so
+// they cost no fork or exec. The executor (execute.c) looks a command up with
+// builtin_find() and runs it itself when it is the only or the last stage of a
+// pipeline; bounded builtins, whose output is limited by their arguments, may
+// run in any stage. Anything a builtin does not implement (an unknown option,
+// several operands) makes builtin_find() decline, and the real program runs.
+//
+// To add a builtin, write a BuiltinFn and add it to the table in builtin.c.
+
+#ifndef BUILTIN_H
+#define BUILTIN_H
+
+// Runs a builtin with argv[0..argc-1] on the given descriptors, which it must
+// not close. Returns the exit status.
+typedef int (*BuiltinFn)(int argc, char *const argv[], int in_fd, int out_fd, int err_fd);
+
+typedef struct {
+    const char *name;
+    BuiltinFn   run;
+    int       (*accepts)(int argc, char *const argv[]);  // NULL = every argument list
+    int         bounded;   // output is bounded by the arguments: safe before its reader starts
+} Builtin;
+
+// Returns the builtin for argv[0] if it implements this argument list, else NULL.
+const Builtin *builtin_find(int argc, char *const argv[]);
+
+#endif /* BUILTIN_H */
@@ -1,8 +1,14 @@
 // client.c
 // TCP client for the multithreaded shell server.
 // Connects to the server, sends commands entered by the user, and prints responses.
+// Every command travels as one frame (protocol.h) carrying a request id; the server
+// echoes that id in its response, so with -p N up to N commands may be in flight
+// at once. Responses are still printed in the order the commands were typed.
 // Typing "exit" sends the command to the server first so it can log the disconnect,
 // then waits for the server to close the connection before printing "Disconnected from server."
+//
+// Usage: ./client [-p depth]
+//   -p depth   commands sent before waiting for the oldest response (default 1)
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -12,16 +18,126 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <errno.h>
+#include <stdint.h>
+
+#include "protocol.h"
 
 #define PORT        3000   // Must match the PORT value in server.c
-#define BUFFER_SIZE 4096   // Size of the send and receive buffers
+#define BUFFER_SIZE 4096   // Size of the command buffer
+#define MAX_DEPTH    256   // Upper bound for -p
+
+// One command that has been sent but whose final response has not been printed.
+typedef struct {
+    uint32_t id;
+    int      done;     // final frame (PROTO_OK / PROTO_ERROR) received
+    char    *output;   // payloads received while an older command was still running
+    size_t   len;
+} Pending;
+
+static Pending pending[MAX_DEPTH];  // ring of in-flight commands, oldest at head
+static int     head     = 0;
+static int     inflight = 0;
+static char    last_char = '\n';    // last byte written to stdout for the head command
+
+
+// Appends len bytes to p->output. Returns 0 on success, -1 on OOM.
+static int pending_append(Pending *p, const char *data, size_t len) {
+    if (len == 0) return 0;
+    char *buf = realloc(p->output, p->len + len);
+    if (!buf) return -1;
+    memcpy(buf + p->len, data, len);
+    p->output = buf;
+    p->len   += len;
+    return 0;
+}
+
+
+// Writes output of the oldest command straight to the terminal.
+static void print_output(const char *data, size_t len) {
+    if (len == 0) return;
+    fwrite(data, 1, len, stdout);
+    fflush(stdout);
+    last_char = data[len - 1];
+}
+
+
+// Reads frames until the oldest in-flight command has its final response.
+// Output of the oldest command is printed as it streams in; frames for younger
+// commands are buffered in their own slots and printed when they become oldest.
+// Returns 0 on success, -1 if the server closed the connection or an error occurred.
+static int wait_oldest(int sock) {
+    Pending *oldest = &pending[head];
+
+    // output that arrived while an older command was still being printed
+    print_output(oldest->output, oldest->len);
+
+    while (!oldest->done) {
+        FrameHeader h;
+        char       *payload = NULL;
+        int         r       = proto_recv_frame(sock, &h, &payload);
+        if (r <= 0) {
+            if (r == 0)
+                printf("Server disconnected.\n");
+            else
+                perror("recv failed");
+            return -1;
+        }
+
+        // match the response to its request by id
+        Pending *p = NULL;
+        for (int i = 0; i < inflight; i++) {
+            Pending *cand = &pending[(head + i) % MAX_DEPTH];
+            if (cand->id == h.id) { p = cand; break; }
+        }
+        if (p == NULL) {
+            fprintf(stderr, "Warning: response for unknown request %u ignored\n", h.id);
+        } else {
+            if (p == oldest) {
+                print_output(payload, h.length);
+            } else if (pending_append(p, payload, h.length) < 0) {
+                free(payload);
+                perror("realloc");
+                return -1;
+            }
+            if (h.status != PROTO_OUTPUT) p->done = 1;
+        }
+        free(payload);
+    }
+
+    // If the output does not end with a newline, add one so the next
+    // prompt appears on a clean line.
+    if (last_char != '\n') printf("\n");
+    fflush(stdout);
+    last_char = '\n';
 
-int main(void) {
+    free(oldest->output);
+    memset(oldest, 0, sizeof(Pending));
+    head = (head + 1) % MAX_DEPTH;
+    inflight--;
+    return 0;
+}
+
+
+int main(int argc, char *argv[]) {
     int sock;
     struct sockaddr_in serv_addr;
-    char send_buf[BUFFER_SIZE];  // Holds the command entered by the user
-    char recv_buf[BUFFER_SIZE];  // Holds the response received from the server
-    int  bytes;                  // Return value of recv(), reused throughout
+    char     send_buf[BUFFER_SIZE];  // Holds the command entered by the user
+    int      depth   = 1;            // Commands allowed in flight at once
+    uint32_t next_id = 1;            // Request id of the next command
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:")) != -1) {
+        if (opt == 'p') {
+            depth = atoi(optarg);
+            if (depth < 1 || depth > MAX_DEPTH) {
+                fprintf(stderr, "Error: depth must be between 1 and %d\n", MAX_DEPTH);
+                exit(EXIT_FAILURE);
+            }
+        } else {
+            fprintf(stderr, "Usage: %s [-p depth]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
 
     // Create the TCP socket. AF_INET = IPv4, SOCK_STREAM = TCP.
     if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
@@ -30,6 +146,7 @@ int main(void) {
     }
 
     // Set up the server address to connect to.
+    memset(&serv_addr, 0, sizeof(serv_addr));
     serv_addr.sin_family = AF_INET;
     serv_addr.sin_port   = htons(PORT);
 
@@ -52,6 +169,7 @@ int main(void) {
     fflush(stdout);
 
     // Prompt loop: runs until "exit", EOF, or a socket error.
+    int failed = 0;
     while (1) {
         // Print the prompt and flush so it appears before the user types.
         printf("$ ");
@@ -77,44 +195,45 @@ int main(void) {
         if (strchr(send_buf, '\033') != NULL)
             continue;
 
-        // Send the command to the server.
-        if (send(sock, send_buf, len, 0) < 0) {
-            perror("send failed");
-            break;
-        }
-
-        // If the command is "exit", wait for the server to close the socket,
-        // then print the disconnect message and exit.
-        // "exit" was already sent above so the server can log the disconnect.
+        // If the command is "exit", collect the outstanding responses, send it
+        // so the server can log the disconnect, then wait for the socket to close.
         if (strcmp(send_buf, "exit") == 0) {
-            bytes = recv(sock, recv_buf, BUFFER_SIZE - 1, 0);
-            if (bytes < 0)
+            while (inflight > 0 && !failed)
+                if (wait_oldest(sock) < 0) failed = 1;
+            if (failed) break;
+            if (proto_send_frame(sock, next_id++, PROTO_REQUEST, send_buf, len) < 0) {
+                perror("send failed");
+                break;
+            }
+            char drain[BUFFER_SIZE];
+            if (recv(sock, drain, sizeof(drain), 0) < 0)
                 perror("recv failed while waiting for server to close");
             printf("Disconnected from server.\n");
-            break;
+            close(sock);
+            return 0;
         }
 
-        // Receive the server's response.
-        // recv() returns 0 if the server closed the connection, -1 on error.
-        bytes = recv(sock, recv_buf, BUFFER_SIZE - 1, 0);
-        if (bytes <= 0) {
-            if (bytes == 0)
-                printf("Server disconnected.\n");
-            else
-                perror("recv failed");
+        // Send the command to the server and remember it until answered.
+        Pending *p = &pending[(head + inflight) % MAX_DEPTH];
+        memset(p, 0, sizeof(Pending));
+        p->id = next_id++;
+        if (proto_send_frame(sock, p->id, PROTO_REQUEST, send_buf, len) < 0) {
+            perror("send failed");
             break;
         }
+        inflight++;
 
-        // Null-terminate before printing so printf treats it as a string.
-        recv_buf[bytes] = '\0';
-        printf("%s", recv_buf);
-
-        // If the output does not end with a newline, add one so the next
-        // prompt appears on a clean line.
-        if (recv_buf[bytes - 1] != '\n')
-            printf("\n");
+        // Block for the oldest response only once the pipeline is full.
+        if (inflight >= depth && wait_oldest(sock) < 0) {
+            failed = 1;
+            break;
+        }
     }
 
+    // EOF on stdin: print whatever is still outstanding.
+    while (inflight > 0 && !failed)
+        if (wait_oldest(sock) < 0) failed = 1;
+
     close(sock);
     return 0;
 }
@@ -0,0 +1,448 @@
+#define _GNU_SOURCE              // splice() on Linux
+#define _POSIX_C_SOURCE 200809L
+
+#include "conn.h"
+#include "protocol.h"
+#include "metrics.h"
+#include "log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// client_num → Conn registry; the lock also guards every Conn's refs field
+static Conn           *g_conns[CONN_BUCKETS];
+static pthread_mutex_t g_conns_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// cleared the first time splice() refuses a pipe/socket pair; output is then
+// copied. Read and written by every reactor, so only through __atomic builtins.
+static int             g_splice_ok  = 1;
+
+
+// Drops one reference; the last one closes the socket and frees everything.
+static void conn_put(Conn *c) {
+    pthread_mutex_lock(&g_conns_lock);
+    int last = (--c->refs == 0);
+    pthread_mutex_unlock(&g_conns_lock);
+    if (!last) return;
+
+    close(c->fd);  // only now may the fd number be reused by a new connection
+    OutChunk *ch = c->out_head;
+    while (ch) { OutChunk *next = ch->next; free(ch); ch = next; }
+    free(c->in);
+    pthread_mutex_destroy(&c->lock);
+    free(c);
+}
+
+
+// Looks up client_num and takes a reference. Returns NULL if it is not connected.
+static Conn *conn_get(int client_num) {
+    pthread_mutex_lock(&g_conns_lock);
+    Conn *c = g_conns[(unsigned)client_num % CONN_BUCKETS];
+    while (c && c->client_num != client_num) c = c->next;
+    if (c) c->refs++;
+    pthread_mutex_unlock(&g_conns_lock);
+    return c;
+}
+
+
+// Drops one stream reference; the last one frees s and its connection reference.
+static void stream_put(OutStream *s) {
+    Conn *c = s->conn;
+    pthread_mutex_lock(&c->lock);
+    int last = (--s->refs == 0);
+    pthread_mutex_unlock(&c->lock);
+    if (!last) return;
+    free(s);
+    conn_put(c);
+}
+
+
+// (Re)registers s's pipe with the reactor, honouring flow control.
+// Must be called with s->conn->lock held.
+static void stream_attach(OutStream *s) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events   = s->paused ? 0 : EPOLLIN;
+    ev.data.ptr = s;
+    if (epoll_ctl(s->conn->epoll_fd, EPOLL_CTL_ADD, s->fd, &ev) == 0) s->detached = 0;
+}
+
+
+// Takes s's pipe out of epoll while a spliced frame still owns the bytes in it.
+// Deregistering (rather than clearing the interest set) matters: EPOLLHUP is
+// reported regardless of the interest set and would spin the reactor.
+// Must be called with s->conn->lock held.
+static void stream_detach(OutStream *s) {
+    if (epoll_ctl(s->conn->epoll_fd, EPOLL_CTL_DEL, s->fd, NULL) == 0) s->detached = 1;
+}
+
+
+// Sets s's pipe interest to EPOLLIN or to nothing. EPOLLHUP is reported either
+// way, so a paused stream still notices its child exiting.
+// Must be called with s->conn->lock held.
+static void set_paused(OutStream *s, int paused) {
+    if (s->paused == paused) return;
+    if (s->detached) { s->paused = paused; return; }  // applied by stream_attach()
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events   = paused ? 0 : EPOLLIN;
+    ev.data.ptr = s;
+    if (epoll_ctl(s->conn->epoll_fd, EPOLL_CTL_MOD, s->fd, &ev) == 0) s->paused = paused;
+}
+
+
+// Resumes every paused stream once the queue has drained below the low-water mark.
+// Must be called with c->lock held.
+static void resume_streams(Conn *c) {
+    if (c->out_bytes >= CONN_LOW_WATER) return;
+    for (OutStream *s = c->streams; s != NULL; s = s->next)
+        set_paused(s, 0);
+}
+
+
+// Switches the epoll interest set between EPOLLIN and EPOLLIN|EPOLLOUT.
+// epoll_ctl() is thread-safe, so repliers may arm EPOLLOUT directly.
+// Must be called with c->lock held.
+static void set_want_write(Conn *c, int on) {
+    if (c->want_write == on || c->closed) return;
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events   = EPOLLIN | EPOLLRDHUP | (on ? EPOLLOUT : 0);
+    ev.data.ptr = c;
+    if (epoll_ctl(c->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev) == 0) c->want_write = on;
+}
+
+
+// Replaces the splice chunk at the head of the queue with a data chunk holding
+// the same pipe bytes, for when splice() does not work between this pipe and
+// socket. Returns 0, or -1 on error. Must be called with c->lock held.
+static int unsplice_head(Conn *c) {
+    OutChunk *ch   = c->out_head;
+    size_t    left = ch->len - ch->off;
+    OutChunk *copy = malloc(sizeof(OutChunk) + left);
+    if (!copy) return -1;
+    size_t got = 0;
+    while (got < left) {
+        ssize_t n = read(ch->splice_from->fd, copy->data + got, left - got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) { free(copy); return -1; }  // the bytes were counted, so this is fatal
+        got += (size_t)n;
+    }
+    copy->next        = ch->next;
+    copy->splice_from = NULL;
+    copy->len         = left;
+    copy->off         = 0;
+    c->out_head = copy;
+    if (c->out_tail == ch) c->out_tail = copy;
+    stream_attach(ch->splice_from);
+    free(ch);
+    return 0;
+}
+
+
+// Sends queued chunks until the queue is empty or the socket would block. Splice
+// chunks move their bytes straight from the pipe; when one completes its stream
+// goes back into epoll to read more.
+// Returns -1 on a hard socket error, 0 otherwise. Must be called with c->lock held.
+static int flush_locked(Conn *c) {
+    while (c->out_head) {
+        OutChunk *ch = c->out_head;
+        ssize_t   n;
+        if (ch->splice_from) {
+            n = splice(ch->splice_from->fd, NULL, c->fd, NULL, ch->len - ch->off,
+                       SPLICE_F_NONBLOCK | SPLICE_F_MOVE);
+            if (n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+                __atomic_store_n(&g_splice_ok, 0, __ATOMIC_RELAXED);
+                if (unsplice_head(c) < 0) return -1;
+                continue;
+            }
+            if (n == 0) return -1;  // pipe ran dry before the announced length
+        } else {
+            n = send(c->fd, ch->data + ch->off, ch->len - ch->off, MSG_DONTWAIT | MSG_NOSIGNAL);
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -1;
+        }
+        ch->off      += (size_t)n;
+        c->out_bytes -= (size_t)n;
+        metrics_add(MC_BYTES_SENT, (uint64_t)n);
+        if (ch->off < ch->len) return 0;  // socket buffer full
+
+        c->out_head = ch->next;
+        if (!c->out_head) c->out_tail = NULL;
+        if (ch->splice_from) stream_attach(ch->splice_from);
+        free(ch);
+    }
+    return 0;
+}
+
+
+// Allocates a data chunk holding one whole frame (header + payload).
+static OutChunk *make_frame(uint32_t id, int32_t status, const void *payload, size_t len) {
+    OutChunk *ch = malloc(sizeof(OutChunk) + PROTO_HEADER_SIZE + len);
+    if (!ch) return NULL;
+    proto_encode_header((unsigned char *)ch->data, (uint32_t)len, id, status);
+    if (payload != NULL && len > 0) memcpy(ch->data + PROTO_HEADER_SIZE, payload, len);
+    ch->next        = NULL;
+    ch->splice_from = NULL;
+    ch->len         = PROTO_HEADER_SIZE + len;
+    ch->off         = 0;
+    return ch;
+}
+
+
+// Appends ch to the queue and sends as much as the socket takes right away;
+// whatever it does not take is left for the reactor's EPOLLOUT handler.
+// Frees ch and returns -1 if the connection is closed.
+// Must be called with c->lock held.
+static int enqueue_locked(Conn *c, OutChunk *ch) {
+    if (c->closed) { free(ch); return -1; }
+    if (c->out_tail) c->out_tail->next = ch;
+    else             c->out_head       = ch;
+    c->out_tail   = ch;
+    c->out_bytes += ch->len;
+    flush_locked(c);  // a hard error surfaces to the reactor as EPOLLERR/EPOLLHUP
+    set_want_write(c, c->out_head != NULL);
+    resume_streams(c);
+    return 0;
+}
+
+
+Conn *conn_create(int fd, int client_num, int epoll_fd) {
+    Conn *c = calloc(1, sizeof(Conn));
+    if (!c) return NULL;
+    c->kind       = CONN_SOCKET;
+    c->fd         = fd;
+    c->client_num = client_num;
+    c->epoll_fd   = epoll_fd;
+    c->refs       = 1;  // the reactor's reference
+    pthread_mutex_init(&c->lock, NULL);
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events   = EPOLLIN | EPOLLRDHUP;
+    ev.data.ptr = c;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        pthread_mutex_destroy(&c->lock);
+        free(c);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&g_conns_lock);
+    Conn **bucket = &g_conns[(unsigned)client_num % CONN_BUCKETS];
+    c->next = *bucket;
+    *bucket = c;
+    pthread_mutex_unlock(&g_conns_lock);
+    return c;
+}
+
+
+// Streams still attached to c are switched back to plain EPOLLIN: their next
+// event sees c->closed and discards the pipe, so no child stays blocked on a
+// paused pipe or on a spliced frame that will never be sent.
+void conn_close(Conn *c) {
+    pthread_mutex_lock(&g_conns_lock);
+    Conn **link = &g_conns[(unsigned)c->client_num % CONN_BUCKETS];
+    while (*link && *link != c) link = &(*link)->next;
+    if (*link) *link = c->next;
+    pthread_mutex_unlock(&g_conns_lock);
+
+    pthread_mutex_lock(&c->lock);
+    c->closed = 1;  // late repliers now discard their output
+    epoll_ctl(c->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    for (OutStream *s = c->streams; s != NULL; s = s->next) {
+        set_paused(s, 0);
+        if (s->detached) stream_attach(s);
+    }
+    pthread_mutex_unlock(&c->lock);
+
+    conn_put(c);
+}
+
+
+int conn_reply(int client_num, uint32_t id, int32_t status, const void *payload, size_t len) {
+    Conn *c = conn_get(client_num);
+    if (!c) return -1;
+
+    int       rc = -1;
+    OutChunk *ch = make_frame(id, status, payload, len);
+    if (ch) {
+        pthread_mutex_lock(&c->lock);
+        rc = enqueue_locked(c, ch);
+        pthread_mutex_unlock(&c->lock);
+    }
+    conn_put(c);
+    return rc;
+}
+
+
+void conn_flush(Conn *c) {
+    pthread_mutex_lock(&c->lock);
+    flush_locked(c);
+    set_want_write(c, c->out_head != NULL);
+    resume_streams(c);
+    pthread_mutex_unlock(&c->lock);
+}
+
+
+// The stream keeps the reference taken by conn_get() until it is freed, so the
+// Conn outlives a client disconnect for as long as the pipe is registered.
+OutStream *conn_stream(int client_num, uint32_t req_id, int pipe_fd, int hold) {
+    Conn *c = conn_get(client_num);
+    if (!c) return NULL;
+
+    OutStream *s = calloc(1, sizeof(OutStream));
+    if (!s) { conn_put(c); return NULL; }
+    s->kind     = CONN_STREAM;
+    s->fd       = pipe_fd;
+    s->req_id   = req_id;
+    s->conn     = c;
+    s->hold     = hold;
+    s->refs     = hold ? 2 : 1;  // the reactor's, plus the caller's for a held stream
+    s->detached = 1;             // until stream_attach() succeeds
+
+    // the reactor must never block on a pipe
+    int flags = fcntl(pipe_fd, F_GETFL);
+    if (flags >= 0) fcntl(pipe_fd, F_SETFL, flags | O_NONBLOCK);
+
+    int ok = 0;
+    pthread_mutex_lock(&c->lock);
+    if (!c->closed) {
+        stream_attach(s);
+        if (!s->detached) {
+            s->next    = c->streams;
+            c->streams = s;
+            ok = 1;
+        }
+    }
+    pthread_mutex_unlock(&c->lock);
+
+    if (!ok) {
+        if (flags >= 0) fcntl(pipe_fd, F_SETFL, flags);
+        free(s);
+        conn_put(c);
+        return NULL;
+    }
+    return s;
+}
+
+
+// Queues the final frame once the pipe is drained and, for a held stream, the
+// status is known. Must be called with s->conn->lock held.
+static void stream_complete_locked(OutStream *s) {
+    if (s->finished || !s->eof || (s->hold && !s->has_status)) return;
+    s->finished = 1;
+
+    Conn     *c  = s->conn;
+    OutChunk *ch = make_frame(s->req_id, s->hold ? s->status : PROTO_OK, NULL, 0);
+    if (ch && enqueue_locked(c, ch) == 0 && s->total > 0) {
+        log_msg(LL_INFO, c->client_num, "sent", "[%d]<<< %zu bytes sent", c->client_num, s->total);
+    }
+}
+
+
+void conn_stream_finish(OutStream *s, int32_t status) {
+    pthread_mutex_lock(&s->conn->lock);
+    s->has_status = 1;
+    s->status     = status;
+    stream_complete_locked(s);
+    pthread_mutex_unlock(&s->conn->lock);
+    stream_put(s);
+}
+
+
+// Unregisters s from its connection and the reactor, closes the pipe and, unless
+// the client is gone, queues the final frame. Drops the reactor's reference.
+static void stream_end(OutStream *s) {
+    Conn *c = s->conn;
+    pthread_mutex_lock(&c->lock);
+    OutStream **link = &c->streams;
+    while (*link && *link != s) link = &(*link)->next;
+    if (*link) *link = s->next;
+
+    epoll_ctl(c->epoll_fd, EPOLL_CTL_DEL, s->fd, NULL);
+    close(s->fd);  // a child still writing gets EPIPE (SIGPIPE is ignored)
+    s->eof = 1;
+    stream_complete_locked(s);
+    pthread_mutex_unlock(&c->lock);
+
+    stream_put(s);
+}
+
+
+// Forwards whatever the pipe holds as one PROTO_OUTPUT frame. With splice the
+// frame is a header chunk plus a splice chunk for the FIONREAD byte count, and
+// the pipe leaves epoll until those bytes are on the socket so they cannot be
+// claimed twice. Otherwise the bytes are read once, straight into the frame chunk.
+// Output is sent as it arrives (SIGSTOP/SIGCONT do not affect the pipe), and the
+// final frame follows at EOF, when the child and anything it forked have exited.
+void conn_stream_event(OutStream *s, uint32_t events) {
+    Conn *c = s->conn;
+
+    if (c->closed) {  // client went away; drop the output
+        stream_end(s);
+        return;
+    }
+
+    int avail = 0;
+    if (ioctl(s->fd, FIONREAD, &avail) < 0) avail = 0;
+    if (avail <= 0) {
+        // EPOLLHUP with an empty pipe: every writer has exited
+        if (events & (EPOLLHUP | EPOLLERR)) stream_end(s);
+        return;
+    }
+
+    int err = 0;  // why nothing could be queued
+    pthread_mutex_lock(&c->lock);
+    if (__atomic_load_n(&g_splice_ok, __ATOMIC_RELAXED)) {
+        OutChunk *hdr  = make_frame(s->req_id, PROTO_OUTPUT, NULL, 0);
+        OutChunk *body = malloc(sizeof(OutChunk));
+        if (hdr && body) {
+            proto_encode_header((unsigned char *)hdr->data, (uint32_t)avail, s->req_id, PROTO_OUTPUT);
+            body->next        = NULL;
+            body->splice_from = s;
+            body->len         = (size_t)avail;
+            body->off         = 0;
+            s->total += (size_t)avail;
+            stream_detach(s);
+            enqueue_locked(c, hdr);   // both chunks are queued under one lock hold,
+            enqueue_locked(c, body);  // so no other frame can land between them
+        } else {
+            err = ENOMEM;
+            free(hdr);
+            free(body);
+        }
+    } else {
+        OutChunk *ch = make_frame(s->req_id, PROTO_OUTPUT, NULL, (size_t)avail);
+        ssize_t   n  = ch ? read(s->fd, ch->data + PROTO_HEADER_SIZE, (size_t)avail) : -1;
+        if (n > 0) {
+            proto_encode_header((unsigned char *)ch->data, (uint32_t)n, s->req_id, PROTO_OUTPUT);
+            ch->len   = PROTO_HEADER_SIZE + (size_t)n;
+            s->total += (size_t)n;
+            enqueue_locked(c, ch);
+        } else {
+            if (ch == NULL)                                     err = ENOMEM;
+            else if (n < 0 && errno != EAGAIN && errno != EINTR) err = errno;
+            free(ch);
+        }
+    }
+    if (c->out_bytes > CONN_HIGH_WATER) set_paused(s, 1);  // let the child block instead
+    pthread_mutex_unlock(&c->lock);
+
+    if (err != 0) {
+        // the pipe is level-triggered and still readable, so leaving it armed
+        // would spin the reactor: end the stream and drop the rest of the output
+        log_msg(LL_ERROR, c->client_num, "error", "[%d] output dropped: %s",
+                c->client_num, strerror(err));
+        stream_end(s);
+    }
+}
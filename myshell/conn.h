@@ -0,0 +1,121 @@
+// conn.h
+// Server-side connection registry and reply path.
+//
+// Reactors (server.c) own the sockets: they create a Conn per accepted client,
+// read requests from it, and flush its output queue on EPOLLOUT. Any other thread
+// (the scheduler workers) answers a request with conn_reply(), addressing the
+// connection by client number rather than by fd. Replies are queued as whole
+// frames under the connection's lock, so responses to concurrent tasks of one
+// client never interleave, and a reply to a client that has gone away is dropped
+// instead of being written to a recycled fd.
+//
+// A child's output pipe is attached to the client's reactor with conn_stream().
+// The reactor forwards each chunk as a PROTO_OUTPUT frame as soon as the child
+// writes it, and sends the final frame at EOF. Where the kernel allows it the
+// bytes go from the pipe to the socket with splice(), so output is never copied
+// through user space. Once more than CONN_HIGH_WATER bytes are queued for a slow
+// client the reactor stops reading the pipe, and the child blocks in write()
+// until the queue drains below CONN_LOW_WATER.
+
+#ifndef CONN_H
+#define CONN_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CONN_BUCKETS     1024           // hash buckets of the client_num → Conn registry
+#define CONN_HIGH_WATER  (256 * 1024)   // queued output bytes that pause pipe reading
+#define CONN_LOW_WATER   (64 * 1024)    // queued output bytes that resume it
+
+// First member of every object registered with a reactor's epoll, so the event
+// loop can tell sockets from program pipes.
+typedef enum { CONN_SOCKET = 1, CONN_STREAM } ConnKind;
+
+struct OutStream;
+
+// One queued piece of output. A data chunk holds len bytes in data[]; a splice
+// chunk (splice_from != NULL) stands for the next len bytes waiting in that
+// stream's pipe. off counts the bytes already sent.
+typedef struct OutChunk {
+    struct OutChunk  *next;
+    struct OutStream *splice_from;
+    size_t            len;
+    size_t            off;
+    char              data[];
+} OutChunk;
+
+typedef struct Conn {
+    ConnKind         kind;          // CONN_SOCKET
+    int              fd;
+    int              client_num;
+    int              epoll_fd;      // epoll instance of the owning reactor
+    int              refs;          // registry + in-flight repliers; guarded by the registry lock
+    int              closed;        // set once the reactor has torn the connection down
+
+    pthread_mutex_t  lock;          // guards the output queue, want_write and streams
+    OutChunk        *out_head;
+    OutChunk        *out_tail;
+    size_t           out_bytes;     // queued bytes not yet accepted by the socket
+    int              want_write;    // EPOLLOUT is armed
+    struct OutStream *streams;      // pipes still forwarding to this client
+
+    char            *in;            // reactor only: bytes of a partially received frame
+    size_t           in_len;
+    size_t           in_cap;
+
+    struct Conn     *next;          // registry hash chain
+} Conn;
+
+// A child's output pipe being forwarded to a client. Fields other than kind,
+// fd, req_id and conn are guarded by conn->lock.
+typedef struct OutStream {
+    ConnKind          kind;         // CONN_STREAM
+    int               fd;           // non-blocking read end of the pipe
+    uint32_t          req_id;       // request the output belongs to
+    Conn             *conn;         // holds a reference on the connection
+    int               refs;         // reactor, plus the caller of a held stream
+    int               paused;       // EPOLLIN disarmed by flow control
+    int               detached;     // out of epoll while a spliced frame drains
+    int               eof;          // pipe closed; only the final frame is left
+    int               hold;         // final frame waits for conn_stream_finish()
+    int               has_status;   // conn_stream_finish() has been called
+    int32_t           status;       // final frame status for a held stream
+    int               finished;     // final frame queued
+    size_t            total;        // bytes forwarded so far
+    struct OutStream *next;         // conn->streams chain
+} OutStream;
+
+// Creates a Conn for fd, registers it under client_num and adds it to epoll_fd
+// with EPOLLIN. Returns NULL on failure (the fd is left open for the caller).
+Conn *conn_create(int fd, int client_num, int epoll_fd);
+
+// Called by the owning reactor: unregisters c, removes it from epoll and drops the
+// reactor's reference. The fd is closed and c freed once no replier still uses it.
+void conn_close(Conn *c);
+
+// Queues one frame for client_num and starts sending it without blocking.
+// Returns 0 if queued, -1 if the client is gone or memory is exhausted.
+int conn_reply(int client_num, uint32_t id, int32_t status, const void *payload, size_t len);
+
+// Called by the owning reactor on EPOLLOUT: writes queued output until the socket
+// would block, and disarms EPOLLOUT once the queue is empty.
+void conn_flush(Conn *c);
+
+// Hands pipe_fd (the read end of a child's output pipe) to client_num's reactor,
+// which forwards its contents as replies to req_id and closes it at EOF.
+// Without hold the reactor sends PROTO_OK at EOF by itself and the returned
+// pointer must not be used. With hold the caller must later pass the stream to
+// conn_stream_finish() with the final status.
+// Returns NULL on failure (client gone, OOM); the caller then still owns pipe_fd.
+OutStream *conn_stream(int client_num, uint32_t req_id, int pipe_fd, int hold);
+
+// Supplies the final status of a held stream and releases the caller's handle.
+// The final frame is sent after all of the pipe's output, whichever comes last.
+void conn_stream_finish(OutStream *s, int32_t status);
+
+// Called by the owning reactor on any event for s: forwards available output,
+// and finishes the stream at EOF or once the client has gone away.
+void conn_stream_event(OutStream *s, uint32_t events);
+
+#endif /* CONN_H */
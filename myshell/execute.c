@@ -1,3 +1,6 @@
+#define _GNU_SOURCE              // pipe2 on Linux
+#define _POSIX_C_SOURCE 200809L
+
 #include "execute.h"
 
 #include <errno.h>
@@ -9,179 +12,247 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
-// Opens the redirection files specified in cmd and calls dup2() to wire them
-// to STDIN, STDOUT, or STDERR. Called inside the child process before execvp().
-// Returns 0 on success, -1 if any open() or dup2() fails.
-static int apply_redirections(const Command *cmd) {
-    int fd;
-
-    // input redirection: open file for reading and connect to stdin
-    if (cmd->input_file != NULL) {
-        fd = open(cmd->input_file, O_RDONLY);
-        if (fd < 0) { perror(cmd->input_file); return -1; }
-        if (dup2(fd, STDIN_FILENO) < 0) { perror("dup2"); close(fd); return -1; }
-        close(fd);  // fd no longer needed; stdin now points at the file
-    }
+// Opens the redirection files specified in cmd, close-on-exec, into fds[0..2]
+// (stdin, stdout, stderr; -1 where the command has none). Called in the parent:
+// the spawn file actions dup2() them into place in the child.
+// Returns 0 on success, -1 if any open() fails, after reporting it on err_fd
+// and closing the files already opened.
+static int open_redirections(const Command *cmd, int fds[3], int err_fd) {
+    const char *files[3] = { cmd->input_file, cmd->output_file, cmd->error_file };
 
-    // output redirection: create/truncate file and connect to stdout
-    if (cmd->output_file != NULL) {
-        fd = open(cmd->output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-        if (fd < 0) { perror(cmd->output_file); return -1; }
-        if (dup2(fd, STDOUT_FILENO) < 0) { perror("dup2"); close(fd); return -1; }
-        close(fd);
+    fds[0] = fds[1] = fds[2] = -1;
+    for (int i = 0; i < 3; i++) {
+        if (files[i] == NULL) continue;
+        // input is opened for reading; output and error create/truncate the file
+        fds[i] = (i == 0) ? open(files[i], O_RDONLY | O_CLOEXEC)
+                          : open(files[i], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fds[i] < 0) {
+            dprintf(err_fd, "%s: %s\n", files[i], strerror(errno));
+            for (int j = 0; j < i; j++) if (fds[j] >= 0) close(fds[j]);
+            return -1;
+        }
     }
+    return 0;
+}
+
+// Closes the descriptors and frees the arguments of a builtin that has not run.
+static void drop_builtin(Job *job) {
+    if (job->builtin == NULL) return;
+    for (int k = 0; k < 3; k++) close(job->builtin_fds[k]);
+    for (int j = 0; j < job->builtin_argc; j++) free(job->builtin_argv[j]);
+    free(job->builtin_argv);
+    job->builtin      = NULL;
+    job->builtin_argv = NULL;
+    job->builtin_argc = 0;
+}
 
-    // error redirection: create/truncate file and connect to stderr
-    if (cmd->error_file != NULL) {
-        fd = open(cmd->error_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-        if (fd < 0) { perror(cmd->error_file); return -1; }
-        if (dup2(fd, STDERR_FILENO) < 0) { perror("dup2"); close(fd); return -1; }
-        close(fd);
-    }
 
+// Records builtin b for cmd to run in pipeline_wait() on its own duplicates of
+// fds, so the caller may close the originals. Returns 0, or -1 on error.
+static int defer_builtin(Job *job, const Builtin *b, const Command *cmd, const int fds[3]) {
+    job->builtin_argv = calloc((size_t)cmd->argc + 1, sizeof(char *));
+    if (job->builtin_argv == NULL) return -1;
+    job->builtin = b;
+    for (int k = 0; k < 3; k++) job->builtin_fds[k] = -1;
+    for (int j = 0; j < cmd->argc; j++) {
+        if ((job->builtin_argv[j] = strdup(cmd->args[j])) == NULL) { drop_builtin(job); return -1; }
+        job->builtin_argc++;
+    }
+    for (int k = 0; k < 3; k++) {
+        if ((job->builtin_fds[k] = fcntl(fds[k], F_DUPFD_CLOEXEC, 3)) < 0) {
+            drop_builtin(job);
+            return -1;
+        }
+    }
     return 0;
 }
 
-// Executes every command in the pipeline.
-// For each command: creates a pipe (except for the last), forks a child,
-// wires up the inter-process pipe fds, applies redirections, then exec's.
-// The parent waits for all children to finish before returning.
-// Returns 0 on success, -1 on any internal error.
-int execute_pipeline(const Pipeline *pipeline) {
-    int    prev_read_fd = -1;      // read end of the previous command's pipe
-    int    pipe_fds[2]  = {-1, -1}; // pipe connecting current command to next
-    pid_t *child_pids;             // array of all forked PIDs for waitpid
+
+void job_init(Job *job) {
+    job->pids         = NULL;
+    job->count        = 0;
+    job->pgid         = -1;
+    job->last_status  = 0;
+    job->builtin      = NULL;
+    job->builtin_argv = NULL;
+    job->builtin_argc = 0;
+}
+
+
+// Decodes a waitpid() status the way a POSIX shell reports it.
+static int exit_code(int status) {
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+// For each command: creates a close-on-exec pipe to the next one (except for the
+// last), opens its redirections, then spawns it with those fds as its stdio, or
+// runs (or defers) it as a builtin.
+// Only the fd numbers are prepared here; posix_spawn does the dup2() calls in
+// the child, so no copy of this process ever runs shell code.
+int pipeline_start(const Pipeline *pipeline, const SpawnIO *io, Job *job) {
+    int prev_read_fd = -1;        // read end of the previous command's pipe
+    int pipe_fds[2]  = {-1, -1};  // pipe connecting current command to next
+    int err_fd       = io->err_fd >= 0 ? io->err_fd : STDERR_FILENO;
+
+    job_init(job);
 
     // guard against null or empty pipeline
     if (pipeline == NULL || pipeline->commands == NULL || pipeline->command_count <= 0)
         return -1;
 
-    // allocate PID array so parent can wait for every child
-    child_pids = malloc((size_t)pipeline->command_count * sizeof(pid_t));
-    if (child_pids == NULL) { perror("malloc"); return -1; }
+    // allocate PID array so the caller can wait for every child
+    job->pids = malloc((size_t)pipeline->command_count * sizeof(pid_t));
+    if (job->pids == NULL) { perror("malloc"); return -1; }
+    job->count = pipeline->command_count;
+    for (int i = 0; i < job->count; i++) job->pids[i] = -1;
 
     for (int i = 0; i < pipeline->command_count; i++) {
         const Command *cmd     = &pipeline->commands[i];
+        const char    *name    = cmd->args[0] ? cmd->args[0] : "(null)";
         int            is_last = (i == pipeline->command_count - 1);
+        int            status  = 0;
+        int            redir[3];
 
         // create a new pipe for every command except the last
-        if (!is_last) {
-            if (pipe(pipe_fds) < 0) {
-                perror("pipe");
-                if (prev_read_fd != -1) close(prev_read_fd);
-                for (int j = 0; j < i; j++) waitpid(child_pids[j], NULL, 0);
-                free(child_pids);
-                return -1;
-            }
+        if (!is_last && pipe2(pipe_fds, O_CLOEXEC) < 0) {
+            perror("pipe");
+            goto fail;
         }
 
-        // fork a child for this command
-        child_pids[i] = fork();
-        if (child_pids[i] < 0) {
-            perror("fork");
-            if (!is_last) { close(pipe_fds[0]); close(pipe_fds[1]); }
-            if (prev_read_fd != -1) close(prev_read_fd);
-            for (int j = 0; j < i; j++) waitpid(child_pids[j], NULL, 0);
-            free(child_pids);
-            return -1;
-        }
-
-        if (child_pids[i] == 0) {
-            // --- child process ---
-
-            // connect the previous pipe's read end to stdin
-            if (prev_read_fd != -1) {
-                if (dup2(prev_read_fd, STDIN_FILENO) < 0) { perror("dup2"); _exit(EXIT_FAILURE); }
-            }
-
-            // connect stdout to the write end of the current pipe
-            if (!is_last) {
-                if (dup2(pipe_fds[1], STDOUT_FILENO) < 0) { perror("dup2"); _exit(EXIT_FAILURE); }
-            }
+        // this command's stdio: its own redirections win over the pipes, which
+        // win over the pipeline's stdio
+        SpawnIO s;
+        if (open_redirections(cmd, redir, err_fd) < 0) {
+            dprintf(err_fd, "Error: Redirection failed for command: %s\n", name);
+            status = 1;
+        } else {
+            s.in_fd  = redir[0] >= 0 ? redir[0] : prev_read_fd >= 0 ? prev_read_fd : io->in_fd;
+            s.out_fd = redir[1] >= 0 ? redir[1] : !is_last ? pipe_fds[1] : io->out_fd;
+            s.err_fd = redir[2] >= 0 ? redir[2] : io->err_fd;
+            s.pgroup = (io->pgroup == 0 && job->pgid > 0) ? job->pgid : io->pgroup;
 
-            // close inherited fds the child no longer needs
-            if (prev_read_fd != -1) close(prev_read_fd);
-            if (!is_last) { close(pipe_fds[0]); close(pipe_fds[1]); }
+            // the builtin's actual descriptors, with -1 resolved to ours
+            const Builtin *b      = builtin_find(cmd->argc, cmd->args);
+            int            fds[3] = {
+                s.in_fd  >= 0 ? s.in_fd  : STDIN_FILENO,
+                s.out_fd >= 0 ? s.out_fd : STDOUT_FILENO,
+                s.err_fd >= 0 ? s.err_fd : STDERR_FILENO,
+            };
 
-            // apply <, >, and 2> redirections specified in the command
-            if (apply_redirections(cmd) < 0) {
-                fprintf(stderr, "Error: Redirection failed for command: %s\n",
-                        cmd->args[0] ? cmd->args[0] : "(null)");
-                _exit(EXIT_FAILURE);
-            }
-
-            // handle "echo" as a shell builtin before trying execvp
-            if (cmd->argc > 0 && strcmp(cmd->args[0], "echo") == 0) {
-                int interpret_escapes = 0;  // set when -e flag is present
-                int start = 1;              // index of the first argument to print
-                if (cmd->argc > 1 && strcmp(cmd->args[1], "-e") == 0) {
-                    interpret_escapes = 1;
-                    start = 2;  // skip the -e flag itself
+            if (b != NULL && b->bounded) {
+                // the output is bounded by the request size, far below a pipe's
+                // capacity, so writing it before the reader starts cannot block
+                status = b->run(cmd->argc, cmd->args, fds[0], fds[1], fds[2]);
+            } else if (b != NULL && is_last) {
+                if (defer_builtin(job, b, cmd, fds) < 0) {
+                    perror("builtin");
+                    for (int k = 0; k < 3; k++) if (redir[k] >= 0) close(redir[k]);
+                    goto fail;
                 }
-                for (int j = start; j < cmd->argc; ++j) {
-                    if (j > start) printf(" ");  // space between arguments
-                    if (interpret_escapes) {
-                        // walk each character and expand \n, \t, \\ sequences
-                        for (char *p = cmd->args[j]; *p; ++p) {
-                            if (*p == '\\' && *(p + 1)) {
-                                ++p;
-                                if      (*p == 'n')  putchar('\n');
-                                else if (*p == 't')  putchar('\t');
-                                else if (*p == '\\') putchar('\\');
-                                else                 putchar(*p);
-                            } else {
-                                putchar(*p);
-                            }
-                        }
-                    } else {
-                        printf("%s", cmd->args[j]);  // print argument as-is
-                    }
+            } else if ((job->pids[i] = spawn_process(cmd->args, &s)) < 0) {
+                if (errno == EAGAIN || errno == ENOMEM) {
+                    perror("posix_spawn");
+                    for (int k = 0; k < 3; k++) if (redir[k] >= 0) close(redir[k]);
+                    if (!is_last) { close(pipe_fds[0]); close(pipe_fds[1]); }
+                    goto fail;
                 }
-                printf("\n");   // echo always ends with a newline
-                fflush(stdout);
-                _exit(0);       // builtin handled; exit child without exec
+                dprintf(s.err_fd >= 0 ? s.err_fd : STDERR_FILENO,
+                        "Error: Command not found: %s\n", name);
+                status = 127;
+            } else if (io->pgroup == 0 && job->pgid < 0) {
+                job->pgid = job->pids[i];  // the first command started leads the group
             }
-
-            // replace the child image with the requested program
-            execvp(cmd->args[0], cmd->args);
-            // execvp only returns on failure
-            fprintf(stderr, "Error: Command not found: %s\n",
-                    cmd->args[0] ? cmd->args[0] : "(null)");
-            _exit(127);
+            for (int k = 0; k < 3; k++) if (redir[k] >= 0) close(redir[k]);
         }
+        if (is_last) job->last_status = status;
 
-        // --- parent process ---
-
-        // done with previous pipe's read end; child already duplicated it
+        // done with previous pipe's read end; the child already has it
         if (prev_read_fd != -1) close(prev_read_fd);
 
         if (!is_last) {
-            close(pipe_fds[1]);           // parent doesn't write to this pipe
+            close(pipe_fds[1]);           // only the child writes to this pipe
             prev_read_fd = pipe_fds[0];   // save read end for the next child's stdin
         } else {
             prev_read_fd = -1;
         }
     }
+    return 0;
 
-    // safety close: should be -1 here, but guard anyway
+fail:
+    // the commands already started see EOF or EPIPE and exit
     if (prev_read_fd != -1) close(prev_read_fd);
+    drop_builtin(job);
+    pipeline_wait(job);
+    pipeline_release(job);
+    return -1;
+}
 
-    // wait for every child in the pipeline to finish
-    for (int i = 0; i < pipeline->command_count; i++) {
-        int   status;
-        pid_t waited_pid;
-        // retry on EINTR (signal interrupted the wait)
-        do {
-            waited_pid = waitpid(child_pids[i], &status, 0);
-        } while (waited_pid < 0 && errno == EINTR);
-
-        if (waited_pid < 0) {
-            perror("waitpid");
-            free(child_pids);
-            return -1;
+
+// Runs the deferred builtin first, as it may be what drains the other commands'
+// output, then waits for every started command. The group leader is only
+// waited for with WNOWAIT: it stays a zombie, which keeps its pid (the pgid)
+// reserved while the caller may still signal the group.
+int pipeline_wait(Job *job) {
+    int failed = 0;
+
+    if (job->builtin != NULL) {
+        job->last_status = job->builtin->run(job->builtin_argc, job->builtin_argv,
+                                             job->builtin_fds[0], job->builtin_fds[1],
+                                             job->builtin_fds[2]);
+        drop_builtin(job);  // closing its stdin lets writers upstream see EPIPE
+    }
+
+    int status = job->last_status;
+    for (int i = 0; i < job->count; i++) {
+        pid_t pid = job->pids[i];
+        if (pid < 0) continue;
+
+        int st;
+        if (pid == job->pgid) {
+            siginfo_t info;
+            memset(&info, 0, sizeof(info));
+            // retry on EINTR (signal interrupted the wait)
+            while (waitid(P_PID, (id_t)pid, &info, WEXITED | WNOWAIT) < 0) {
+                if (errno != EINTR) { perror("waitid"); failed = 1; break; }
+            }
+            st = (info.si_code == CLD_EXITED) ? info.si_status : 128 + info.si_status;
+        } else {
+            int raw = 0;
+            while (waitpid(pid, &raw, 0) < 0) {
+                if (errno != EINTR) { perror("waitpid"); failed = 1; break; }
+            }
+            st = exit_code(raw);
         }
+
+        // like a POSIX shell, the pipeline's status is its last command's
+        if (i == job->count - 1) status = st;
     }
+    return failed ? -1 : status;
+}
 
-    free(child_pids);
-    return 0;
+
+// Reaps the zombie group leader left by pipeline_wait() and frees the pid array
+// and a builtin that never ran.
+void pipeline_release(Job *job) {
+    drop_builtin(job);
+    if (job->pgid > 0)
+        while (waitpid(job->pgid, NULL, 0) < 0 && errno == EINTR) {}
+    free(job->pids);
+    job->pids  = NULL;
+    job->count = 0;
+    job->pgid  = -1;
+}
+
+
+// Executes every command in the pipeline with the caller's stdin, stdout and
+// stderr, in the caller's process group, and waits for all of them.
+// Returns the last command's exit status, or -1 on any internal error.
+int execute_pipeline(const Pipeline *pipeline) {
+    SpawnIO io = SPAWN_IO_INHERIT;
+    Job     job;
+
+    if (pipeline_start(pipeline, &io, &job) < 0) return -1;
+    int status = pipeline_wait(&job);
+    pipeline_release(&job);
+    return status;
 }
@@ -1,15 +1,55 @@
 // execute.h
-// Declares execute_pipeline(), which forks and execs every command in a
-// parsed Pipeline, wires pipes between them, and applies redirections.
+// Declares the pipeline executor: it starts every command of a parsed Pipeline
+// through the spawn layer (spawn.c), wires pipes between them, applies
+// redirections, and waits for them. Builtins (builtin.c) run in this process.
 
 #ifndef EXECUTE_H
 #define EXECUTE_H
 
 #include "parse.h"
+#include "spawn.h"
+#include "builtin.h"
 
-// Executes all commands in the pipeline. For a single command, one child
-// is forked. For N commands, N children are created and connected with pipes.
-// Returns 0 on success, -1 if a pipe, fork, or malloc call fails.
+#include <sys/types.h>
+
+// The running commands of one pipeline, filled in by pipeline_start().
+typedef struct {
+    pid_t *pids;         // one per command; -1 for a command that did not start
+    int    count;
+    pid_t  pgid;         // process group of the commands when io->pgroup was 0, else -1
+    int    last_status;  // status of the last command if it did not start
+
+    const Builtin *builtin;         // last command, run in process by pipeline_wait(); NULL = none
+    char         **builtin_argv;    // its arguments (owned, NULL-terminated)
+    int            builtin_argc;
+    int            builtin_fds[3];  // its stdin, stdout and stderr (owned)
+} Job;
+
+// Initialises an empty job, for which pipeline_wait() returns 0.
+void job_init(Job *job);
+
+// Starts every command of the pipeline without waiting for them. io gives the
+// pipeline's stdin (first command), stdout (last command) and stderr (all),
+// and io->pgroup == 0 puts the commands in a new process group led by the first
+// one started. A command that cannot start (not found, bad redirection) reports
+// the error on its stderr and gets status 127 or 1. A bounded builtin runs at
+// once; any other builtin in the last stage is deferred to pipeline_wait(), so
+// the commands feeding it are running (and killable) before it starts.
+// Returns 0, or -1 if a pipe or fork fails (nothing is left running).
+int pipeline_start(const Pipeline *pipeline, const SpawnIO *io, Job *job);
+
+// Runs a deferred builtin, then waits for every command of job and returns the
+// last one's exit status (128 +
+// signal number if it was killed), or -1 if waitpid() fails. A group leader is
+// left unreaped, so job->pgid cannot be recycled until pipeline_release().
+int pipeline_wait(Job *job);
+
+// Reaps the group leader, if any, and frees job.
+void pipeline_release(Job *job);
+
+// Runs the pipeline with the caller's stdio and waits for it.
+// Returns the exit status of the last command, or -1 if a pipe, fork, or malloc
+// call fails.
 int execute_pipeline(const Pipeline *pipeline);
 
 #endif /* EXECUTE_H */
@@ -0,0 +1,199 @@
+#define _GNU_SOURCE              // pipe2, SOCK_CLOEXEC and MSG_CMSG_CLOEXEC on Linux
+#define _POSIX_C_SOURCE 200809L
+
+#include "helper.h"
+#include "log.h"
+#include "pcache.h"
+#include "shell.h"
+#include "spawn.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+#define HELPER_MAX_CMD 4096   // longest command text a request may carry
+
+
+// Sends one reply message. Returns 0 on success, -1 on error.
+static int send_reply(int sock, int32_t kind, int32_t value, int32_t in_helper, int32_t cached) {
+    HelperReply r = { kind, value, in_helper, cached };
+    ssize_t     n;
+    while ((n = send(sock, &r, sizeof(r), MSG_NOSIGNAL)) < 0 && errno == EINTR) {}
+    return n == (ssize_t)sizeof(r) ? 0 : -1;
+}
+
+
+// Receives one reply message of the expected kind into *r. Returns its value,
+// or INT32_MIN if the helper is gone or out of step.
+static int32_t recv_reply(int sock, int32_t kind, HelperReply *r) {
+    ssize_t n;
+    while ((n = recv(sock, r, sizeof(*r), 0)) < 0 && errno == EINTR) {}
+    if (n != (ssize_t)sizeof(*r) || r->kind != kind) return INT32_MIN;
+    return r->value;
+}
+
+
+// The helper's socket is close-on-exec in the server and dup2()ed to HELPER_FD
+// in the child, so no other process inherits it.
+int helper_start(Helper *h) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) {
+        log_msg(LL_ERROR, LOG_NO_CLIENT, "error", "[HELPER] socketpair: %s", strerror(errno));
+        return -1;
+    }
+
+    char   *argv[] = { "myshell-helper", HELPER_ARG, NULL };
+    SpawnIO io     = SPAWN_IO_INHERIT;
+    pid_t   pid    = spawn_process_fd(HELPER_PATH, (char *const *)argv, &io, sv[1], HELPER_FD);
+    close(sv[1]);
+    if (pid < 0) {
+        log_msg(LL_ERROR, LOG_NO_CLIENT, "error", "[HELPER] spawn: %s", strerror(errno));
+        close(sv[0]);
+        return -1;
+    }
+    h->sock = sv[0];
+    h->pid  = pid;
+    return 0;
+}
+
+
+void helper_stop(Helper *h) {
+    if (h->sock < 0) return;
+    close(h->sock);
+    while (waitpid(h->pid, NULL, 0) < 0 && errno == EINTR) {}
+    h->sock = -1;
+    h->pid  = -1;
+}
+
+
+// The pipe is created here so the read end never leaves the server; only the
+// write end travels to the helper, and our copy is closed once it is sent.
+int helper_begin(Helper *h, const char *cmd, int *out_fd, pid_t *pgid, int *in_helper) {
+    int pipefd[2];
+    if (pipe2(pipefd, O_CLOEXEC) < 0) return -1;
+
+    // the command text as the payload, the write end as ancillary data
+    union {
+        char           buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } ctl;
+    struct iovec  iov = { (void *)cmd, strlen(cmd) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    memset(&ctl, 0, sizeof(ctl));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = ctl.buf;
+    msg.msg_controllen = sizeof(ctl.buf);
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type  = SCM_RIGHTS;
+    cm->cmsg_len   = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cm), &pipefd[1], sizeof(int));
+
+    ssize_t n;
+    while ((n = sendmsg(h->sock, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR) {}
+    close(pipefd[1]);
+    HelperReply r;
+    int32_t     group = (n < 0) ? INT32_MIN : recv_reply(h->sock, HELPER_STARTED, &r);
+    if (group == INT32_MIN) {
+        close(pipefd[0]);
+        helper_stop(h);
+        return -1;
+    }
+    *out_fd    = pipefd[0];
+    *pgid      = group;
+    *in_helper = r.in_helper;
+    pcache_count(r.cached != 0, r.cached == 0);
+    return 0;
+}
+
+
+// A failed helper is left for the caller to stop: it stays an unreaped child
+// until then, so its pid cannot be recycled while the caller may still kill it.
+int helper_end(Helper *h) {
+    HelperReply r;
+    int32_t     status = recv_reply(h->sock, HELPER_DONE, &r);
+    return status == INT32_MIN ? -1 : status;
+}
+
+
+// Receives one request into cmd (NUL-terminated) and its output fd.
+// Returns 1 on success, 0 at EOF, -1 on a malformed request.
+static int recv_request(int sock, char *cmd, size_t size, int *fd) {
+    union {
+        char           buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } ctl;
+    struct iovec  iov = { cmd, size - 1 };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = ctl.buf;
+    msg.msg_controllen = sizeof(ctl.buf);
+
+    ssize_t n;
+    while ((n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR) {}
+    if (n <= 0) return 0;
+    cmd[n] = '\0';
+
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    if (cm == NULL || cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS)
+        return -1;
+    memcpy(fd, CMSG_DATA(cm), sizeof(int));
+    if (msg.msg_flags & MSG_TRUNC) { close(*fd); return -1; }
+    return 1;
+}
+
+
+// Serves requests one at a time until the server closes the socket. The helper
+// runs no threads and allocates little, so it stays small however busy the
+// server is.
+int helper_main(int sock) {
+    char cmd[HELPER_MAX_CMD + 1];
+    Job  job;
+
+    fcntl(sock, F_SETFD, FD_CLOEXEC);  // keep it out of the commands we spawn
+    signal(SIGPIPE, SIG_IGN);          // a client may go away mid-write; commands get SIG_DFL back
+    job_init(&job);
+
+    for (;;) {
+        int fd;
+        int r = recv_request(sock, cmd, sizeof(cmd), &fd);
+        if (r == 0) break;
+
+        // the server has cleared its record of the previous group by now
+        pipeline_release(&job);
+
+        if (r < 0) {
+            send_reply(sock, HELPER_STARTED, -1, 0, 0);
+            send_reply(sock, HELPER_DONE, 1, 0, 0);
+            continue;
+        }
+
+        PCacheStats before, after;
+        pcache_stats(&before);
+        int rc = shell_run(cmd, fd, &job);
+        pcache_stats(&after);
+        if (rc < 0) {
+            const char *err = "Error: fork failed\n";
+            ssize_t     n   = write(fd, err, strlen(err));
+            (void)n;
+        }
+        close(fd);  // the commands hold the only write references now
+        int in_helper = (rc == 0 && job.builtin != NULL);
+        int cached    = (after.hits != before.hits);
+        if (send_reply(sock, HELPER_STARTED, rc < 0 ? -1 : job.pgid, in_helper, cached) < 0) break;
+        int status = rc < 0 ? 1 : pipeline_wait(&job);
+        if (send_reply(sock, HELPER_DONE, status, 0, 0) < 0) break;
+    }
+    pipeline_release(&job);
+    return 0;
+}
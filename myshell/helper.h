@@ -0,0 +1,66 @@
+// helper.h
+// Pre-started helper processes that run shell commands for the server.
+//
+// Each shell worker thread owns one helper: a copy of the server binary
+// started in helper mode (HELPER_ARG), connected by a SOCK_SEQPACKET socket
+// pair. The worker sends the command text together with the write end of the
+// command's output pipe (SCM_RIGHTS); the helper parses it and spawns the
+// pipeline onto that pipe. The server itself then only makes the pipe: parsing,
+// spawning and reaping happen in the helper's small address space.
+//
+// Messages: a request is the command text with one fd attached; the helper
+// answers with a HelperReply of HELPER_STARTED (value = the pipeline's process
+// group, or -1 if nothing started; in_helper set if the last command is a
+// builtin the helper runs itself; cached set if the helper's own parse cache
+// already held the command), then one of HELPER_DONE (value = the exit
+// status). The group leader stays a zombie in the helper until the next request
+// arrives, so the server may signal the group until it has seen HELPER_DONE and
+// cleared its record of it.
+
+#ifndef HELPER_H
+#define HELPER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define HELPER_ARG  "--helper"   // argv[1] that starts the server binary as a helper
+#define HELPER_FD   3            // the helper's end of the socket pair
+#define HELPER_PATH "/proc/self/exe"
+
+typedef enum { HELPER_STARTED = 1, HELPER_DONE } HelperReplyKind;
+
+typedef struct {
+    int32_t kind;       // HelperReplyKind
+    int32_t value;      // pgid for HELPER_STARTED, exit status for HELPER_DONE
+    int32_t in_helper;  // HELPER_STARTED: the helper itself runs the last command
+    int32_t cached;     // HELPER_STARTED: the command was a parse-cache hit
+} HelperReply;
+
+// The server's handle on one helper process.
+typedef struct {
+    int   sock;   // server end of the socket pair; -1 = not running
+    pid_t pid;
+} Helper;
+
+// Starts a helper process for h. Returns 0 on success, -1 on error.
+int helper_start(Helper *h);
+
+// Closes the socket (the helper exits at EOF) and reaps the helper.
+void helper_stop(Helper *h);
+
+// Sends cmd to the helper to run with stdout and stderr on a new pipe. Stores
+// the pipe's read end (close-on-exec) in *out_fd and the process group of the
+// pipeline in *pgid (-1 if nothing started). *in_helper is set if the helper
+// runs a builtin itself, so cancelling the command means killing h->pid.
+// The helper's parse-cache hit or miss is added to this process's counters.
+// Returns 0 on success, -1 if the helper is unusable (it is stopped then).
+int helper_begin(Helper *h, const char *cmd, int *out_fd, pid_t *pgid, int *in_helper);
+
+// Waits for the command started by helper_begin() and returns its exit status,
+// or -1 if the helper died; the caller must then helper_stop() it.
+int helper_end(Helper *h);
+
+// Main loop of a helper process serving requests on sock; returns at EOF.
+int helper_main(int sock);
+
+#endif /* HELPER_H */
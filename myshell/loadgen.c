@@ -0,0 +1,697 @@
+// loadgen.c
+// Load generator for the scheduler: replays a workload over many concurrent
+// connections and reports throughput with turnaround, waiting and response
+// percentiles, once per scheduling policy.
+// Usage: ./loadgen [options] [trace]
+//   trace     workload to replay, one job per line: "<arrival_ms> <conn> <burst_ms|-> <command>"
+//             ('#' starts a comment; burst "-" for shell commands). Without a trace
+//             a workload is generated from the options below
+//   -n jobs   generated jobs (default 20)
+//   -R rate   mean arrivals per second; arrivals are a Poisson process (default 1)
+//   -c conns  connections of a generated workload; job i goes on conn i % conns (default 4)
+//   -d dist   burst distribution in seconds: fixed:S, uni:LO:HI, exp:MEAN or
+//             bi:SHORT:LONG:P (SHORT with probability P) (default exp:2)
+//   -e cmd    program template; %s becomes the burst in seconds (default "./demo %s")
+//   -u unit   bursts are rounded up to a multiple of unit seconds (default 1, since
+//             ./demo takes whole seconds)
+//   -x frac   fraction of generated jobs that are shell commands instead (default 0)
+//   -S seed   random seed of the generator (default 1)
+//   -w file   also write the workload as a trace, to replay it later
+//   -s server start this server binary for each run, as "server -E '' -P policy args..."
+//   -P list   comma-separated policies to run with -s, at most LG_MAX_POLICIES
+//             (default srjf)
+//   -a args   further arguments for the server, split at spaces
+//   -l label  name of the run when -s is not given (default "server")
+//   -o file   write the results, one JSON object per line and run
+//   -C file   compare with the results of an earlier -o: exit 1 if the p95 or p99
+//             turnaround of a run with the same name got more than -T percent worse
+//   -T pct    tolerance of -C (default 10)
+//   -t sec    give up on a run that has not finished after sec seconds (default 600)
+//   -H host, -p port   server address (default 127.0.0.1:3000)
+//
+// For each job, measured from the moment its request is sent:
+//   turnaround   until the final response frame
+//   response     until the first response frame (first output, or the result)
+//   waiting      turnaround minus the burst: time spent not running (programs only)
+// Percentiles count only jobs that succeeded; errors are reported separately.
+
+#define _GNU_SOURCE              // erand48 and epoll on Linux
+#define _POSIX_C_SOURCE 200809L
+
+#include "protocol.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#define NSEC_PER_SEC 1000000000LL
+#define NSEC_PER_MS     1000000LL
+#define LG_PORT           3000   // must match PORT in server.c
+#define LG_MAX_CONNS     10000
+#define LG_MAX_POLICIES     16
+#define LG_MAX_ARGS         32   // -a words passed on to the server
+#define LG_LINE_MAX       4096
+#define LG_READY_MS       5000   // wait for a started server to accept connections
+
+// one job of the workload and what the current run measured for it
+typedef struct {
+    int64_t at_ns;          // arrival, relative to the start of the run
+    int     conn;
+    int64_t burst_ns;       // -1 if unknown (shell commands)
+    char   *command;
+    int     seq;            // position in the trace; orders equal arrivals
+
+    int64_t sent_ns;        // CLOCK_MONOTONIC times; 0 = not yet
+    int64_t first_ns;
+    int64_t done_ns;
+    int     status;         // PROTO_OK or PROTO_ERROR once done
+    int     lost;           // its connection closed before it finished
+} Job;
+
+// one connection and its position in the frame being received
+typedef struct {
+    int           fd;
+    unsigned char hdr[PROTO_HEADER_SIZE];
+    int           hlen;     // header bytes collected
+    uint32_t      skip;     // payload bytes of the current frame still to discard
+} LgConn;
+
+// mean, percentiles and maximum of one metric, in nanoseconds
+typedef struct {
+    int64_t mean, p50, p95, p99, max;
+} Dist;
+
+// results of one run
+typedef struct {
+    char    label[64];
+    int     jobs, ok, errors, lost;
+    double  duration_s;     // first request sent to last response received
+    double  throughput;     // successful jobs per second over duration_s
+    Dist    turnaround, waiting, response;
+} RunResult;
+
+typedef struct {
+    const char *host;
+    int         port;
+    int64_t     limit_ns;
+    const char *server;
+    char       *server_args[LG_MAX_ARGS];
+    int         nserver_args;
+} Options;
+
+static Job *jobs;
+static int  njobs;
+static int  nconns;
+
+
+// Current CLOCK_MONOTONIC time in nanoseconds.
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+
+// Appends a job, keeping a private copy of command. Exits on OOM.
+static void add_job(int64_t at_ns, int conn, int64_t burst_ns, const char *command) {
+    static int cap;
+    if (njobs == cap) {
+        cap  = cap ? cap * 2 : 64;
+        jobs = realloc(jobs, (size_t)cap * sizeof(Job));
+        if (!jobs) { perror("realloc"); exit(EXIT_FAILURE); }
+    }
+    Job *j = &jobs[njobs++];
+    memset(j, 0, sizeof(Job));
+    j->at_ns    = at_ns;
+    j->conn     = conn;
+    j->burst_ns = burst_ns;
+    j->seq      = njobs - 1;
+    j->command  = strdup(command);
+    if (!j->command) { perror("strdup"); exit(EXIT_FAILURE); }
+    if (conn + 1 > nconns) nconns = conn + 1;
+}
+
+
+// Orders jobs by arrival; equal arrivals keep their order in the trace.
+static int job_cmp(const void *a, const void *b) {
+    const Job *x = a, *y = b;
+    if (x->at_ns != y->at_ns) return x->at_ns < y->at_ns ? -1 : 1;
+    return x->seq < y->seq ? -1 : 1;
+}
+
+
+// Reads a trace file. Returns 0 on success, -1 on error (reported).
+static int load_trace(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) { perror(path); return -1; }
+
+    char line[LG_LINE_MAX];
+    int  lineno = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        line[strcspn(line, "\r\n")] = '\0';
+        char *p = line + strspn(line, " \t");
+        if (*p == '\0' || *p == '#') continue;
+
+        double at_ms, burst_ms = -1;
+        int    conn, off;
+        char   burst[32];
+        if (sscanf(p, "%lf %d %31s %n", &at_ms, &conn, burst, &off) != 3 ||
+            at_ms < 0 || conn < 0 || conn >= LG_MAX_CONNS || p[off] == '\0' ||
+            (strcmp(burst, "-") != 0 && (sscanf(burst, "%lf", &burst_ms) != 1 || burst_ms < 0))) {
+            fprintf(stderr, "%s:%d: expected \"<arrival_ms> <conn> <burst_ms|-> <command>\"\n",
+                    path, lineno);
+            fclose(f);
+            return -1;
+        }
+        add_job((int64_t)(at_ms * NSEC_PER_MS), conn,
+                burst_ms < 0 ? -1 : (int64_t)(burst_ms * NSEC_PER_MS), p + off);
+    }
+    fclose(f);
+    qsort(jobs, (size_t)njobs, sizeof(Job), job_cmp);
+    return 0;
+}
+
+
+// shell commands mixed into a generated workload by -x
+static const char *const shell_mix[] = {
+    "echo hello",
+    "pwd",
+    "ls",
+    "ls -l /usr/bin | wc -l",
+    "cat /etc/hostname",
+};
+
+
+// Draws one burst in seconds from dist (see -d). Returns -1 if dist is malformed.
+static double draw_burst(const char *dist, unsigned short rng[3]) {
+    double a, b, p;
+    double u = erand48(rng);
+    if (sscanf(dist, "fixed:%lf", &a) == 1 && a > 0)                 return a;
+    if (sscanf(dist, "uni:%lf:%lf", &a, &b) == 2 && a > 0 && b >= a) return a + u * (b - a);
+    if (sscanf(dist, "exp:%lf", &a) == 1 && a > 0)                   return -a * log(1.0 - u);
+    if (sscanf(dist, "bi:%lf:%lf:%lf", &a, &b, &p) == 3 && a > 0 && b > 0 && p >= 0 && p <= 1)
+        return erand48(rng) < p ? a : b;
+    return -1;
+}
+
+
+// Generates n jobs arriving at rate per second on conns connections. Returns 0,
+// or -1 if dist or the template is malformed.
+static int generate(int n, double rate, int conns, const char *dist, const char *tmpl,
+                    double unit, double shell_frac, long seed) {
+    const char *hole = strstr(tmpl, "%s");
+    if (!hole) {
+        fprintf(stderr, "Error: the program template needs a %%s for the burst\n");
+        return -1;
+    }
+    unsigned short rng[3] = { 0x330e, (unsigned short)seed, (unsigned short)(seed >> 16) };
+    double         at     = 0;
+    for (int i = 0; i < n; i++) {
+        if (i > 0) at += -log(1.0 - erand48(rng)) / rate;
+        if (erand48(rng) < shell_frac) {
+            const char *cmd = shell_mix[(int)(erand48(rng) * (sizeof(shell_mix) / sizeof(shell_mix[0])))];
+            add_job((int64_t)(at * NSEC_PER_SEC), i % conns, -1, cmd);
+            continue;
+        }
+        double burst = draw_burst(dist, rng);
+        if (burst < 0) {
+            fprintf(stderr, "Error: bad burst distribution '%s'\n", dist);
+            return -1;
+        }
+        burst = ceil(burst / unit - 1e-9) * unit;   // whole units, at least one
+        if (burst < unit) burst = unit;
+
+        char cmd[LG_LINE_MAX];
+        snprintf(cmd, sizeof(cmd), "%.*s%g%s", (int)(hole - tmpl), tmpl, burst, hole + 2);
+        add_job((int64_t)(at * NSEC_PER_SEC), i % conns, (int64_t)(burst * NSEC_PER_SEC), cmd);
+    }
+    return 0;
+}
+
+
+// Writes the workload as a trace. Returns 0 on success, -1 on error.
+static int write_trace(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) { perror(path); return -1; }
+    fprintf(f, "# arrival_ms conn burst_ms command\n");
+    for (int i = 0; i < njobs; i++) {
+        fprintf(f, "%.3f %d ", (double)jobs[i].at_ns / NSEC_PER_MS, jobs[i].conn);
+        if (jobs[i].burst_ns < 0) fprintf(f, "- ");
+        else                      fprintf(f, "%.3f ", (double)jobs[i].burst_ns / NSEC_PER_MS);
+        fprintf(f, "%s\n", jobs[i].command);
+    }
+    if (fclose(f) != 0) { perror(path); return -1; }
+    return 0;
+}
+
+
+// Opens a TCP connection to host:port with Nagle off. Returns the fd or -1.
+static int connect_to(const char *host, int port) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+        fprintf(stderr, "Error: invalid address %s\n", host);
+        return -1;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+
+// Starts the server binary with -E '' (no learned bursts carried between runs),
+// -P policy and the -a arguments, its output discarded, and waits until it
+// accepts connections. Returns its pid, or -1 on error.
+static pid_t start_server(const Options *o, const char *policy) {
+    char *argv[LG_MAX_ARGS + 6];
+    int   argc = 0;
+    argv[argc++] = (char *)o->server;
+    argv[argc++] = "-E";
+    argv[argc++] = "";
+    argv[argc++] = "-P";
+    argv[argc++] = (char *)policy;
+    for (int i = 0; i < o->nserver_args; i++) argv[argc++] = o->server_args[i];
+    argv[argc] = NULL;
+
+    pid_t pid = fork();
+    if (pid < 0) { perror("fork"); return -1; }
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0) { dup2(null, STDOUT_FILENO); dup2(null, STDERR_FILENO); }
+        execv(o->server, argv);
+        _exit(127);
+    }
+
+    for (int waited = 0; waited < LG_READY_MS; waited += 20) {
+        int fd = connect_to(o->host, o->port);
+        if (fd >= 0) { close(fd); return pid; }
+        if (waitpid(pid, NULL, WNOHANG) == pid) break;   // exited: bad arguments or port taken
+        usleep(20 * 1000);
+    }
+    fprintf(stderr, "Error: %s did not start accepting connections\n", o->server);
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+
+// Stops a server started by start_server().
+static void stop_server(pid_t pid) {
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+}
+
+
+// Accounts len received bytes of connection c: every frame header completes
+// a response event of the job it names; payloads are discarded.
+static void consume(LgConn *c, const unsigned char *data, size_t len, int64_t now, int *done) {
+    while (len > 0) {
+        if (c->skip > 0) {
+            size_t n = len < c->skip ? len : c->skip;
+            c->skip -= (uint32_t)n;
+            data    += n;
+            len     -= n;
+            continue;
+        }
+        size_t n = PROTO_HEADER_SIZE - (size_t)c->hlen;
+        if (n > len) n = len;
+        memcpy(c->hdr + c->hlen, data, n);
+        c->hlen += (int)n;
+        data    += n;
+        len     -= n;
+        if (c->hlen < PROTO_HEADER_SIZE) break;
+
+        FrameHeader h;
+        proto_decode_header(c->hdr, &h);
+        c->hlen = 0;
+        c->skip = h.length;
+        if (h.id == 0 || h.id > (uint32_t)njobs) continue;   // not one of ours
+        Job *j = &jobs[h.id - 1];
+        if (j->done_ns || j->lost) continue;
+        if (!j->first_ns) j->first_ns = now;
+        if (h.status == PROTO_OK || h.status == PROTO_ERROR) {
+            j->done_ns = now;
+            j->status  = h.status;
+            (*done)++;
+        }
+    }
+}
+
+
+// Replays the workload once: connects, sends each job at its arrival time
+// (request id = job index + 1) and records its response events until every
+// job has finished or o->limit_ns has passed. Returns 0, or -1 if the server
+// could not be reached.
+static int replay(const Options *o) {
+    LgConn *conns = calloc((size_t)nconns, sizeof(LgConn));
+    int     ep    = epoll_create1(EPOLL_CLOEXEC);
+    if (!conns || ep < 0) { perror("replay"); free(conns); return -1; }
+
+    int rc = 0;
+    for (int i = 0; i < nconns; i++) conns[i].fd = -1;
+    for (int i = 0; i < nconns; i++) {
+        if ((conns[i].fd = connect_to(o->host, o->port)) < 0) {
+            fprintf(stderr, "Error: connect %s:%d: %s\n", o->host, o->port, strerror(errno));
+            rc = -1;
+            goto out;
+        }
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = (uint32_t)i };
+        epoll_ctl(ep, EPOLL_CTL_ADD, conns[i].fd, &ev);
+    }
+    for (int i = 0; i < njobs; i++) {
+        jobs[i].sent_ns = jobs[i].first_ns = jobs[i].done_ns = 0;
+        jobs[i].status  = 0;
+        jobs[i].lost    = 0;
+    }
+
+    int64_t start = now_ns();
+    int     next  = 0, done = 0;
+    while (done < njobs) {
+        int64_t now = now_ns();
+        if (now - start > o->limit_ns) break;
+
+        // send every job that has arrived; requests are small, so a blocking
+        // send() returns at once
+        for (; next < njobs && jobs[next].at_ns <= now - start; next++) {
+            Job *j = &jobs[next];
+            if (j->lost) continue;  // its connection is gone
+            j->sent_ns = now_ns();
+            if (proto_send_frame(conns[j->conn].fd, (uint32_t)next + 1, PROTO_REQUEST,
+                                 j->command, strlen(j->command)) < 0) {
+                fprintf(stderr, "Error: send: %s\n", strerror(errno));
+                rc = -1;
+                goto out;
+            }
+        }
+
+        int64_t wait_ns = next < njobs ? start + jobs[next].at_ns - now_ns() : 100 * NSEC_PER_MS;
+        int     timeout = wait_ns <= 0 ? 0 : (int)((wait_ns + NSEC_PER_MS - 1) / NSEC_PER_MS);
+        struct epoll_event events[64];
+        int n = epoll_wait(ep, events, 64, timeout);
+        if (n < 0 && errno != EINTR) { perror("epoll_wait"); rc = -1; goto out; }
+
+        for (int e = 0; e < n; e++) {
+            LgConn       *c = &conns[events[e].data.u32];
+            unsigned char buf[65536];
+            ssize_t       got = recv(c->fd, buf, sizeof(buf), MSG_DONTWAIT);
+            if (got > 0) {
+                consume(c, buf, (size_t)got, now_ns(), &done);
+            } else if (got == 0 || (errno != EAGAIN && errno != EINTR)) {
+                // no answer will come: its unfinished jobs, sent or not, are lost
+                int conn = (int)events[e].data.u32;
+                fprintf(stderr, "Error: server closed connection %d\n", conn);
+                epoll_ctl(ep, EPOLL_CTL_DEL, c->fd, NULL);
+                close(c->fd);
+                c->fd = -1;
+                for (int i = 0; i < njobs; i++) {
+                    if (jobs[i].conn != conn || jobs[i].done_ns || jobs[i].lost) continue;
+                    jobs[i].lost = 1;
+                    done++;
+                }
+            }
+        }
+    }
+
+out:
+    for (int i = 0; i < nconns; i++)
+        if (conns[i].fd >= 0) close(conns[i].fd);
+    close(ep);
+    free(conns);
+    return rc;
+}
+
+
+static int cmp_i64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+
+// Sorts the n samples in v and summarises them; the percentiles are nearest-rank.
+static Dist summarise(int64_t *v, int n) {
+    Dist d = { 0, 0, 0, 0, 0 };
+    if (n == 0) return d;
+    qsort(v, (size_t)n, sizeof(int64_t), cmp_i64);
+    double sum = 0;
+    for (int i = 0; i < n; i++) sum += (double)v[i];
+    int r95 = (int)ceil(0.95 * n), r99 = (int)ceil(0.99 * n);
+    d.mean = (int64_t)(sum / n);
+    d.p50  = v[(int)ceil(0.50 * n) - 1];
+    d.p95  = v[r95 - 1];
+    d.p99  = v[r99 - 1];
+    d.max  = v[n - 1];
+    return d;
+}
+
+
+// Computes the results of the last replay().
+static void collect(RunResult *r) {
+    int64_t *turn = malloc((size_t)njobs * sizeof(int64_t));
+    int64_t *wait = malloc((size_t)njobs * sizeof(int64_t));
+    int64_t *resp = malloc((size_t)njobs * sizeof(int64_t));
+    if (!turn || !wait || !resp) { perror("malloc"); exit(EXIT_FAILURE); }
+
+    int     nturn = 0, nwait = 0;
+    int64_t first = 0, last = 0;
+    r->jobs = njobs;
+    r->ok = r->errors = r->lost = 0;
+    for (int i = 0; i < njobs; i++) {
+        Job *j = &jobs[i];
+        if (j->sent_ns && (!first || j->sent_ns < first)) first = j->sent_ns;
+        if (!j->done_ns)                 { r->lost++;   continue; }
+        if (j->done_ns > last) last = j->done_ns;
+        if (j->status != PROTO_OK)       { r->errors++; continue; }
+        r->ok++;
+        resp[nturn]   = j->first_ns - j->sent_ns;
+        turn[nturn++] = j->done_ns  - j->sent_ns;
+        if (j->burst_ns >= 0) {
+            int64_t w = j->done_ns - j->sent_ns - j->burst_ns;
+            wait[nwait++] = w > 0 ? w : 0;
+        }
+    }
+    r->duration_s = last > first ? (double)(last - first) / NSEC_PER_SEC : 0;
+    r->throughput = r->duration_s > 0 ? r->ok / r->duration_s : 0;
+    r->turnaround = summarise(turn, nturn);
+    r->response   = summarise(resp, nturn);
+    r->waiting    = summarise(wait, nwait);
+    free(turn);
+    free(wait);
+    free(resp);
+}
+
+
+static double sec(int64_t ns) {
+    return (double)ns / NSEC_PER_SEC;
+}
+
+
+// Prints one row of the report table.
+static void print_result(const RunResult *r) {
+    printf("%-8s %5d %5d %5d %8.3f   %7.3f %7.3f %7.3f   %7.3f %7.3f %7.3f   %7.3f %7.3f %7.3f\n",
+           r->label, r->ok, r->errors, r->lost, r->throughput,
+           sec(r->turnaround.p50), sec(r->turnaround.p95), sec(r->turnaround.p99),
+           sec(r->waiting.p50),    sec(r->waiting.p95),    sec(r->waiting.p99),
+           sec(r->response.p50),   sec(r->response.p95),   sec(r->response.p99));
+    fflush(stdout);
+}
+
+
+static void json_dist(FILE *f, const char *name, const Dist *d) {
+    fprintf(f, ",\"%s\":{\"mean\":%.6f,\"p50\":%.6f,\"p95\":%.6f,\"p99\":%.6f,\"max\":%.6f}",
+            name, sec(d->mean), sec(d->p50), sec(d->p95), sec(d->p99), sec(d->max));
+}
+
+
+// Appends r to f as one JSON object on its own line; times are in seconds.
+static void write_json(FILE *f, const RunResult *r) {
+    fprintf(f, "{\"label\":\"%s\",\"jobs\":%d,\"ok\":%d,\"errors\":%d,\"lost\":%d,"
+               "\"duration\":%.6f,\"throughput\":%.6f",
+            r->label, r->jobs, r->ok, r->errors, r->lost, r->duration_s, r->throughput);
+    json_dist(f, "turnaround", &r->turnaround);
+    json_dist(f, "waiting",    &r->waiting);
+    json_dist(f, "response",   &r->response);
+    fprintf(f, "}\n");
+}
+
+
+// Finds the run called label in a results file written by -o and reads its p95
+// and p99 turnaround. Returns 1 if found, 0 if not.
+static int baseline_of(const char *path, const char *label, double *p95, double *p99) {
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    static const char key[] = "{\"label\":\"";
+    char   line[LG_LINE_MAX];
+    size_t klen  = sizeof(key) - 1;
+    size_t len   = strlen(label);
+    int    found = 0;
+    while (!found && fgets(line, sizeof(line), f)) {
+        // the label field must be exactly label, not merely start with it
+        const char *v = strncmp(line, key, klen) == 0 ? line + klen : NULL;
+        if (!v || strncmp(v, label, len) != 0 || strncmp(v + len, "\",", 2) != 0) continue;
+        const char *t = strstr(line, "\"turnaround\":{");
+        const char *a = t ? strstr(t, "\"p95\":") : NULL;
+        const char *b = t ? strstr(t, "\"p99\":") : NULL;
+        found = a && b && sscanf(a, "\"p95\":%lf", p95) == 1 && sscanf(b, "\"p99\":%lf", p99) == 1;
+    }
+    fclose(f);
+    return found;
+}
+
+
+// Compares r with its baseline. Returns 1 if the p95 or p99 turnaround grew by
+// more than tolerance percent, else 0.
+static int regressed(const char *path, const RunResult *r, double tolerance) {
+    double p95, p99;
+    if (!baseline_of(path, r->label, &p95, &p99)) {
+        printf("%-8s no baseline in %s\n", r->label, path);
+        return 0;
+    }
+    double now95 = sec(r->turnaround.p95), now99 = sec(r->turnaround.p99);
+    double lim   = 1.0 + tolerance / 100.0;
+    int    bad   = now95 > p95 * lim || now99 > p99 * lim;
+    printf("%-8s turnaround p95 %.3f (was %.3f), p99 %.3f (was %.3f): %s\n",
+           r->label, now95, p95, now99, p99, bad ? "REGRESSION" : "ok");
+    return bad;
+}
+
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-n jobs] [-R rate] [-c conns] [-d dist] [-e cmd] [-u unit]"
+                    " [-x frac] [-S seed] [-w trace_out] [-s server] [-P policies] [-a args]"
+                    " [-l label] [-o results] [-C baseline] [-T pct] [-t sec] [-H host]"
+                    " [-p port] [trace]\n", prog);
+}
+
+
+int main(int argc, char *argv[]) {
+    Options     o         = { "127.0.0.1", LG_PORT, 600 * NSEC_PER_SEC, NULL, { NULL }, 0 };
+    int         n         = 20, conns = 4;
+    double      rate      = 1, unit = 1, shell_frac = 0, tolerance = 10;
+    long        seed      = 1;
+    const char *dist      = "exp:2";
+    const char *tmpl      = "./demo %s";
+    const char *trace_out = NULL, *results = NULL, *baseline = NULL;
+    const char *label     = "server";
+    char       *policies  = "srjf";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:R:c:d:e:u:x:S:w:s:P:a:l:o:C:T:t:H:p:")) != -1) {
+        switch (opt) {
+        case 'n': n          = atoi(optarg); break;
+        case 'R': rate       = atof(optarg); break;
+        case 'c': conns      = atoi(optarg); break;
+        case 'd': dist       = optarg;       break;
+        case 'e': tmpl       = optarg;       break;
+        case 'u': unit       = atof(optarg); break;
+        case 'x': shell_frac = atof(optarg); break;
+        case 'S': seed       = atol(optarg); break;
+        case 'w': trace_out  = optarg;       break;
+        case 's': o.server   = optarg;       break;
+        case 'P': policies   = optarg;       break;
+        case 'l': label      = optarg;       break;
+        case 'o': results    = optarg;       break;
+        case 'C': baseline   = optarg;       break;
+        case 'T': tolerance  = atof(optarg); break;
+        case 't': o.limit_ns = (int64_t)(atof(optarg) * NSEC_PER_SEC); break;
+        case 'H': o.host     = optarg;       break;
+        case 'p': o.port     = atoi(optarg); break;
+        case 'a':
+            for (char *w = strtok(optarg, " "); w; w = strtok(NULL, " ")) {
+                if (o.nserver_args == LG_MAX_ARGS) {
+                    fprintf(stderr, "Error: at most %d server arguments\n", LG_MAX_ARGS);
+                    return EXIT_FAILURE;
+                }
+                o.server_args[o.nserver_args++] = w;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (n < 1 || rate <= 0 || conns < 1 || conns > LG_MAX_CONNS || unit <= 0 ||
+        shell_frac < 0 || shell_frac > 1 || o.limit_ns <= 0 || optind < argc - 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // one run per policy with -s, else one run against the server already up
+    const char *names[LG_MAX_POLICIES];
+    int         nnames = 0;
+    if (o.server) {
+        for (char *p = strtok(policies, ","); p; p = strtok(NULL, ",")) {
+            if (nnames == LG_MAX_POLICIES) {
+                fprintf(stderr, "Error: at most %d policies\n", LG_MAX_POLICIES);
+                return EXIT_FAILURE;
+            }
+            names[nnames++] = p;
+        }
+    } else {
+        names[nnames++] = label;
+    }
+
+    if (optind < argc) {
+        if (load_trace(argv[optind]) < 0) return EXIT_FAILURE;
+        if (njobs == 0) { fprintf(stderr, "Error: the trace has no jobs\n"); return EXIT_FAILURE; }
+    } else if (generate(n, rate, conns, dist, tmpl, unit, shell_frac, seed) < 0) {
+        return EXIT_FAILURE;
+    }
+    if (trace_out && write_trace(trace_out) < 0) return EXIT_FAILURE;
+
+    signal(SIGPIPE, SIG_IGN);
+    printf("%d jobs over %d connections, last arrival at %.3f s\n",
+           njobs, nconns, sec(jobs[njobs - 1].at_ns));
+    printf("%-8s %5s %5s %5s %8s   %-23s   %-23s   %-23s\n", "run", "ok", "err", "lost", "jobs/s",
+           "turnaround p50/95/99 s", "waiting p50/95/99 s", "response p50/95/99 s");
+
+    RunResult runs[LG_MAX_POLICIES];
+    int       nruns  = 0;
+    int       status = EXIT_SUCCESS;
+    for (int i = 0; i < nnames; i++) {
+        pid_t pid = -1;
+        if (o.server && (pid = start_server(&o, names[i])) < 0) { status = EXIT_FAILURE; break; }
+        int rc = replay(&o);
+        if (pid > 0) stop_server(pid);
+        if (rc < 0) { status = EXIT_FAILURE; break; }
+
+        RunResult *r = &runs[nruns++];
+        snprintf(r->label, sizeof(r->label), "%s", names[i]);
+        collect(r);
+        print_result(r);
+    }
+
+    // compare before writing, so -C and -o may name the same file
+    for (int i = 0; i < nruns && baseline; i++)
+        if (regressed(baseline, &runs[i], tolerance)) status = EXIT_FAILURE;
+    if (results && nruns > 0) {
+        FILE *out = fopen(results, "w");
+        if (!out) { perror(results); return EXIT_FAILURE; }
+        for (int i = 0; i < nruns; i++) write_json(out, &runs[i]);
+        if (fclose(out) != 0) { perror(results); status = EXIT_FAILURE; }
+    }
+    for (int i = 0; i < njobs; i++) free(jobs[i].command);
+    free(jobs);
+    return status;
+}
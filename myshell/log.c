@@ -0,0 +1,309 @@
+#define _GNU_SOURCE              // eventfd on Linux
+#define _POSIX_C_SOURCE 200809L
+
+#include "log.h"
+#include "metrics.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define REC_SKIP  -1   // level of the filler that pads a ring to its end
+
+// start of every record: enough to step over the filler
+typedef struct {
+    uint32_t size;         // bytes the record takes in the ring, a multiple of 8
+    int32_t  level;        // LogLevel, or REC_SKIP
+} RecHead;
+
+typedef struct {
+    RecHead     h;
+    int32_t     client;
+    uint32_t    len;       // message length
+    int64_t     ts_ns;     // CLOCK_MONOTONIC time of the call
+    const char *event;
+    char       *heap;      // the message if it did not fit inline; NULL otherwise
+    char        text[];    // the message, NUL-terminated, when heap is NULL
+} LogRec;
+
+// one thread's buffer: head is advanced only by its thread, tail only by the
+// writer; both count bytes since the start and are reduced modulo LOG_RING_SIZE
+typedef struct LogRing {
+    uint64_t        head;
+    uint64_t        dropped;     // messages lost to a full ring, written by the owner
+    char            pad[48];     // keeps the writer's tail off the owner's cache line
+    uint64_t        tail;
+    uint64_t        reported;    // drops already reported, writer only
+    int             id;          // thread number shown in JSON output
+    struct LogRing *next;
+    char           *buf;
+} LogRing;
+
+static const char *level_name[] = { "debug", "info", "warn", "error" };
+
+static LogLevel          g_min_level = LL_INFO;
+static int               g_json;
+static int64_t           g_wall_offset_ns;   // CLOCK_REALTIME minus CLOCK_MONOTONIC at log_init()
+static int               g_started;
+static int               g_wake_fd = -1;     // eventfd the writer sleeps on
+static int               g_next_id = 1;      // 0 is the main thread before log_start()
+static LogRing          *g_rings;            // every ring ever allocated; only grows
+static __thread LogRing *my_ring;
+static pthread_mutex_t   g_write_lock = PTHREAD_MUTEX_INITIALIZER;  // held while writing output
+
+
+static int64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+void log_init(LogLevel min_level, int json) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    g_wall_offset_ns = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec - mono_ns();
+    g_min_level      = min_level;
+    g_json           = json;
+}
+
+
+int log_level_parse(const char *name) {
+    for (int l = LL_DEBUG; l <= LL_ERROR; l++)
+        if (strcmp(name, level_name[l]) == 0) return l;
+    return -1;
+}
+
+
+// Writes s as the body of a JSON string.
+static void json_escape(FILE *out, const char *s, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        unsigned char ch = (unsigned char)s[i];
+        if      (ch == '"')  fputs("\\\"", out);
+        else if (ch == '\\') fputs("\\\\", out);
+        else if (ch == '\n') fputs("\\n", out);
+        else if (ch == '\t') fputs("\\t", out);
+        else if (ch < 0x20)  fprintf(out, "\\u%04x", ch);
+        else                 putc(ch, out);
+    }
+}
+
+
+// Writes one message in the configured format. Must be called with
+// g_write_lock held.
+static void write_line(int level, int thread, int client, const char *event,
+                       int64_t ts_ns, const char *msg, size_t len) {
+    if (!g_json) {
+        FILE *out = level >= LL_WARN ? stderr : stdout;
+        fwrite(msg, 1, len, out);
+        putc('\n', out);
+        return;
+    }
+    int64_t   wall = ts_ns + g_wall_offset_ns;
+    time_t    sec  = (time_t)(wall / 1000000000LL);
+    struct tm tm;
+    char      stamp[32];
+    gmtime_r(&sec, &tm);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tm);
+    printf("{\"ts\":\"%s.%06ldZ\",\"level\":\"%s\",\"thread\":%d", stamp,
+           (long)(wall % 1000000000LL / 1000), level_name[level], thread);
+    if (client != LOG_NO_CLIENT) printf(",\"client\":%d", client);
+    printf(",\"event\":\"%s\",\"msg\":\"", event);
+    json_escape(stdout, msg, len);
+    fputs("\"}\n", stdout);
+}
+
+
+// Returns the calling thread's ring, allocating and publishing it on first
+// use; NULL if memory ran out.
+static LogRing *ring(void) {
+    if (my_ring != NULL) return my_ring;
+    LogRing *r = calloc(1, sizeof(LogRing));
+    if (r == NULL) return NULL;
+    if ((r->buf = malloc(LOG_RING_SIZE)) == NULL) { free(r); return NULL; }
+    r->id   = __atomic_fetch_add(&g_next_id, 1, __ATOMIC_RELAXED);
+    r->next = __atomic_load_n(&g_rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&g_rings, &r->next, r, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+    return my_ring = r;
+}
+
+
+// Appends a record to the calling thread's ring. Returns 0, or -1 if the ring
+// has no room (nothing is written then).
+static int ring_push(LogRing *r, int level, int client, const char *event, int64_t ts_ns,
+                     const char *msg, size_t len, char *heap) {
+    size_t   need = (sizeof(LogRec) + (heap ? 0 : len + 1) + 7) & ~(size_t)7;
+    uint64_t head = r->head;
+    uint64_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    size_t   pos  = (size_t)(head % LOG_RING_SIZE);
+    size_t   room = LOG_RING_SIZE - pos;
+
+    if (room < need) {
+        // too close to the end: fill the rest with a filler and start over at 0
+        if (head + room + need - tail > LOG_RING_SIZE) return -1;
+        RecHead *skip = (RecHead *)(r->buf + pos);
+        skip->size  = (uint32_t)room;
+        skip->level = REC_SKIP;
+        head += room;
+        pos   = 0;
+    } else if (head + need - tail > LOG_RING_SIZE) {
+        return -1;
+    }
+
+    LogRec *rec = (LogRec *)(r->buf + pos);
+    rec->h.size  = (uint32_t)need;
+    rec->h.level = level;
+    rec->client  = client;
+    rec->len     = (uint32_t)len;
+    rec->ts_ns   = ts_ns;
+    rec->event   = event;
+    rec->heap    = heap;
+    if (!heap) {
+        memcpy(rec->text, msg, len);
+        rec->text[len] = '\0';
+    }
+    __atomic_store_n(&r->head, head + need, __ATOMIC_RELEASE);
+
+    // wake the writer early when this message fills the ring past half
+    if (head - tail <= LOG_RING_SIZE / 2 && head + need - tail > LOG_RING_SIZE / 2) {
+        uint64_t one = 1;
+        if (write(g_wake_fd, &one, sizeof(one)) < 0) { /* the timeout wakes it anyway */ }
+    }
+    return 0;
+}
+
+
+void log_msg(LogLevel level, int client, const char *event, const char *fmt, ...) {
+    if (level < g_min_level) return;
+
+    char    line[LOG_INLINE_MAX];
+    char   *heap = NULL;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    size_t len = (size_t)n;
+    if (len >= sizeof(line)) {
+        // too long to pass inline: format it again into a heap copy, or truncate
+        if ((heap = malloc(len + 1)) != NULL) {
+            va_start(ap, fmt);
+            vsnprintf(heap, len + 1, fmt, ap);
+            va_end(ap);
+        } else {
+            len = sizeof(line) - 1;
+        }
+    }
+    int64_t ts_ns = mono_ns();
+
+    LogRing *r = __atomic_load_n(&g_started, __ATOMIC_ACQUIRE) ? ring() : NULL;
+    if (r == NULL) {
+        // not started yet (or out of memory): write it here
+        pthread_mutex_lock(&g_write_lock);
+        write_line(level, 0, client, event, ts_ns, heap ? heap : line, len);
+        fflush(level >= LL_WARN && !g_json ? stderr : stdout);
+        pthread_mutex_unlock(&g_write_lock);
+        free(heap);
+        return;
+    }
+    if (ring_push(r, level, client, event, ts_ns, heap ? heap : line, len, heap) < 0) {
+        __atomic_store_n(&r->dropped, r->dropped + 1, __ATOMIC_RELAXED);
+        free(heap);
+    }
+}
+
+
+// Returns the oldest unwritten record of r, stepping over fillers, or NULL if
+// it has none. Must be called with g_write_lock held.
+static LogRec *ring_peek(LogRing *r) {
+    uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    uint64_t tail = r->tail;
+    LogRec  *rec  = NULL;
+    while (tail < head) {
+        RecHead *h = (RecHead *)(r->buf + tail % LOG_RING_SIZE);
+        if (h->level != REC_SKIP) { rec = (LogRec *)h; break; }
+        tail += h->size;
+    }
+    if (tail != r->tail) __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+    return rec;
+}
+
+
+// Writes what every ring holds, oldest message first across all rings, then
+// any drops since the last call.
+void log_flush(void) {
+    pthread_mutex_lock(&g_write_lock);
+    LogRing *rings = __atomic_load_n(&g_rings, __ATOMIC_ACQUIRE);
+    while (1) {
+        LogRing *oldest = NULL;
+        LogRec  *rec    = NULL;
+        for (LogRing *r = rings; r != NULL; r = r->next) {
+            LogRec *p = ring_peek(r);
+            if (p != NULL && (rec == NULL || p->ts_ns < rec->ts_ns)) { oldest = r; rec = p; }
+        }
+        if (rec == NULL) break;
+        write_line(rec->h.level, oldest->id, rec->client, rec->event, rec->ts_ns,
+                   rec->heap ? rec->heap : rec->text, rec->len);
+        free(rec->heap);
+        __atomic_store_n(&oldest->tail, oldest->tail + rec->h.size, __ATOMIC_RELEASE);
+    }
+
+    uint64_t dropped = 0;
+    for (LogRing *r = rings; r != NULL; r = r->next) {
+        uint64_t d = __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+        dropped    += d - r->reported;
+        r->reported = d;
+    }
+    if (dropped > 0) {
+        char msg[64];
+        int  n = snprintf(msg, sizeof(msg), "[LOG] %llu messages dropped", (unsigned long long)dropped);
+        write_line(LL_WARN, 0, LOG_NO_CLIENT, "dropped", mono_ns(), msg, (size_t)n);
+        metrics_add(MC_LOG_DROPPED, dropped);
+    }
+    fflush(stdout);
+    fflush(stderr);
+    pthread_mutex_unlock(&g_write_lock);
+}
+
+
+// Writer thread: drains the rings every LOG_FLUSH_MS, or when woken.
+static void *log_run(void *arg) {
+    (void)arg;
+    struct pollfd pfd = { g_wake_fd, POLLIN, 0 };
+    while (1) {
+        if (poll(&pfd, 1, LOG_FLUSH_MS) > 0) {
+            uint64_t n;
+            if (read(g_wake_fd, &n, sizeof(n)) < 0) { /* already drained */ }
+        }
+        log_flush();
+    }
+    return NULL;
+}
+
+
+int log_start(void) {
+    g_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (g_wake_fd < 0) return -1;
+
+    pthread_t th;
+    int       rc = pthread_create(&th, NULL, log_run, NULL);
+    if (rc != 0) {
+        close(g_wake_fd);
+        g_wake_fd = -1;
+        errno = rc;
+        return -1;
+    }
+    pthread_detach(th);
+    atexit(log_flush);
+    __atomic_store_n(&g_started, 1, __ATOMIC_RELEASE);
+    return 0;
+}
@@ -0,0 +1,59 @@
+// log.h
+// Asynchronous server log: levels, plain-text or JSON-lines output.
+//
+// The scheduler and reactor threads log every state transition, often with
+// q->mutex or a connection lock held, so a log call must never wait for the
+// terminal or the disk. Each thread formats its message and appends it to a
+// ring buffer of its own (single producer, single consumer, no lock); one
+// writer thread drains every ring every LOG_FLUSH_MS, or sooner once a ring is
+// half full, merges the messages by time and writes them. A message that finds
+// its ring full is dropped and counted rather than waited for; the writer
+// reports the count. Messages longer than LOG_INLINE_MAX are copied to the
+// heap and only their pointer goes through the ring.
+//
+// Text output is the message alone, one line per message: warnings and errors
+// on stderr, the rest on stdout. JSON output is one object per line on stdout:
+//   {"ts":"2026-01-01T12:00:00.123456Z","level":"info","thread":3,"client":1,
+//    "event":"created","msg":"[1]--- created (2.000)"}
+// where "client" is left out for messages about no particular client.
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdint.h>
+
+#define LOG_RING_SIZE (256 * 1024)   // bytes of each thread's ring buffer
+#define LOG_INLINE_MAX        512    // longer messages are passed by pointer
+#define LOG_FLUSH_MS           10    // writer's drain interval
+
+typedef enum {
+    LL_DEBUG = 0,
+    LL_INFO  = 1,
+    LL_WARN  = 2,
+    LL_ERROR = 3
+} LogLevel;
+
+#define LOG_NO_CLIENT -1
+
+// Sets the least level written and the output format (json = 1 for JSON
+// lines). Call once before any thread logs.
+void log_init(LogLevel min_level, int json);
+
+// Parses "debug", "info", "warn" or "error". Returns -1 for anything else.
+int log_level_parse(const char *name);
+
+// Starts the writer thread and the per-thread buffering. Messages logged
+// before, or if this fails, are written directly by the calling thread.
+// Returns 0 on success, -1 on error (errno set).
+int log_start(void);
+
+// Logs one message. event names the kind of message in JSON output and must
+// be a string literal; client is the client it concerns or LOG_NO_CLIENT.
+void log_msg(LogLevel level, int client, const char *event, const char *fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+
+// Writes every message buffered so far; registered with atexit() by
+// log_start(), so an exit() does not lose the last messages.
+void log_flush(void);
+
+#endif /* LOG_H */
@@ -0,0 +1,300 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "metrics.h"
+#include "log.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define HIST_EXPORT_BITS 36   // exported buckets: le = 2^0 .. 2^36 us (about 19 hours)
+#define ADMIN_REQ_SIZE 1024   // request bytes read; the rest of the headers is ignored
+
+// one thread's counters; written only by that thread, read by any
+typedef struct Shard {
+    uint64_t      counters[MC_COUNT];
+    uint64_t      buckets[MH_COUNT][2][HIST_BUCKETS];
+    uint64_t      sum_ns[MH_COUNT][2];
+    struct Shard *next;
+} Shard;
+
+static const struct {
+    const char *name;
+    const char *help;
+} counter_info[MC_COUNT] = {
+    [MC_REQUESTS]        = { "myshell_requests_total",         "Commands accepted into the scheduler." },
+    [MC_REJECTED]        = { "myshell_rejected_total",         "Commands refused by the per-client queue limit." },
+    [MC_PROGRAMS_DONE]   = { "myshell_programs_done_total",    "Programs that ran to completion." },
+    [MC_SHELL_DONE]      = { "myshell_shell_done_total",       "Shell commands that finished." },
+    [MC_CANCELLED]       = { "myshell_cancelled_total",        "Tasks dropped because their client disconnected." },
+    [MC_SLICES]          = { "myshell_slices_total",           "Program slices run on a simulated CPU." },
+    [MC_PREEMPTIONS]     = { "myshell_preemptions_total",      "Slices cut short by a preemption request." },
+    [MC_CPU_SWITCHES]    = { "myshell_cpu_switches_total",     "Slices that ran a different task than the CPU's previous one." },
+    [MC_CSW_VOLUNTARY]   = { "myshell_program_voluntary_context_switches_total",
+                             "Kernel context switches of finished programs from blocking." },
+    [MC_CSW_INVOLUNTARY] = { "myshell_program_involuntary_context_switches_total",
+                             "Kernel context switches of finished programs forced by the kernel." },
+    [MC_BYTES_SENT]      = { "myshell_bytes_sent_total",       "Bytes written to client sockets." },
+    [MC_LOG_DROPPED]     = { "myshell_log_dropped_total",      "Log messages lost to a full buffer." },
+};
+
+static const struct {
+    const char *name;
+    const char *help;
+} hist_info[MH_COUNT] = {
+    [MH_QUEUE_WAIT] = { "myshell_queue_wait_seconds", "Time a task spent ready but not running." },
+    [MH_TURNAROUND] = { "myshell_turnaround_seconds", "Time from a task's arrival to its completion." },
+    [MH_RESPONSE]   = { "myshell_response_seconds",   "Time from a task's arrival to its first run." },
+};
+
+static const char   *kind_name[2] = { "program", "shell" };
+static const double  quantiles[]  = { 0.5, 0.9, 0.99, 0.999 };
+
+// every shard ever allocated; only grows, pushed with a compare-and-swap
+static Shard           *g_shards;
+static __thread Shard  *my_shard;
+static MetricsGaugeFn   g_gauges;
+static int              g_admin_fd = -1;
+
+
+// Returns the calling thread's shard, allocating and publishing it on first
+// use; NULL if memory ran out (the update is then dropped).
+static Shard *shard(void) {
+    if (my_shard != NULL) return my_shard;
+    Shard *s = calloc(1, sizeof(Shard));
+    if (s == NULL) return NULL;
+    s->next = __atomic_load_n(&g_shards, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&g_shards, &s->next, s, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+    return my_shard = s;
+}
+
+
+// Single-writer add: no read-modify-write instruction is needed, only a store
+// that a concurrent reader cannot see half-done.
+static void bump(uint64_t *p, uint64_t v) {
+    __atomic_store_n(p, __atomic_load_n(p, __ATOMIC_RELAXED) + v, __ATOMIC_RELAXED);
+}
+
+
+// Bucket of a value in microseconds: values below HIST_SUB get one bucket
+// each, larger ones the sub-bucket given by the HIST_SUB_BITS bits that follow
+// their leading one.
+static int bucket_of(uint64_t us) {
+    if (us < HIST_SUB) return (int)us;
+    if (us >= (1ULL << HIST_MAX_BITS)) us = (1ULL << HIST_MAX_BITS) - 1;
+    int msb = 63 - __builtin_clzll(us);
+    return (msb - HIST_SUB_BITS + 1) * HIST_SUB + (int)((us >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+
+// Exclusive upper bound, in microseconds, of the values in bucket b.
+static uint64_t bucket_limit(int b) {
+    if (b < HIST_SUB) return (uint64_t)b + 1;
+    int shift = b / HIST_SUB - 1;
+    return (uint64_t)(HIST_SUB + b % HIST_SUB + 1) << shift;
+}
+
+
+void metrics_add(MetricCounter c, uint64_t v) {
+    Shard *s = shard();
+    if (s != NULL) bump(&s->counters[c], v);
+}
+
+
+void metrics_observe(MetricHist h, int kind, int64_t ns) {
+    Shard *s = shard();
+    if (s == NULL) return;
+    if (ns < 0) ns = 0;
+    bump(&s->buckets[h][kind][bucket_of((uint64_t)ns / 1000)], 1);
+    bump(&s->sum_ns[h][kind], (uint64_t)ns);
+}
+
+
+// Sums one histogram over every shard into buckets[], returning the sample
+// count and storing the sum of the samples in *sum_ns.
+static uint64_t merge_hist(MetricHist h, int kind, uint64_t *buckets, uint64_t *sum_ns) {
+    uint64_t count = 0;
+    memset(buckets, 0, HIST_BUCKETS * sizeof(uint64_t));
+    *sum_ns = 0;
+    for (Shard *s = __atomic_load_n(&g_shards, __ATOMIC_ACQUIRE); s; s = s->next) {
+        for (int b = 0; b < HIST_BUCKETS; b++) {
+            uint64_t n = __atomic_load_n(&s->buckets[h][kind][b], __ATOMIC_RELAXED);
+            buckets[b] += n;
+            count      += n;
+        }
+        *sum_ns += __atomic_load_n(&s->sum_ns[h][kind], __ATOMIC_RELAXED);
+    }
+    return count;
+}
+
+
+// Writes one histogram: the cumulative count at every power of two of
+// microseconds, then the sum and count.
+static void write_hist(FILE *out, MetricHist h, int kind) {
+    uint64_t    buckets[HIST_BUCKETS], sum_ns;
+    uint64_t    count = merge_hist(h, kind, buckets, &sum_ns);
+    const char *name  = hist_info[h].name;
+    const char *k     = kind_name[kind];
+
+    uint64_t cumulative = 0;
+    int      b          = 0;
+    for (int e = 0; e <= HIST_EXPORT_BITS; e++) {
+        uint64_t le = 1ULL << e;
+        for (; b < HIST_BUCKETS && bucket_limit(b) <= le; b++) cumulative += buckets[b];
+        fprintf(out, "%s_bucket{kind=\"%s\",le=\"%.6f\"} %llu\n",
+                name, k, (double)le / 1e6, (unsigned long long)cumulative);
+    }
+    fprintf(out, "%s_bucket{kind=\"%s\",le=\"+Inf\"} %llu\n", name, k, (unsigned long long)count);
+    fprintf(out, "%s_sum{kind=\"%s\"} %.6f\n", name, k, (double)sum_ns / 1e9);
+    fprintf(out, "%s_count{kind=\"%s\"} %llu\n", name, k, (unsigned long long)count);
+}
+
+
+// Writes the quantiles of one histogram as gauges: for each, the highest value
+// of the bucket that holds it, which is within 1/HIST_SUB of the true value.
+static void write_quantiles(FILE *out, MetricHist h, int kind) {
+    uint64_t buckets[HIST_BUCKETS], sum_ns;
+    uint64_t count = merge_hist(h, kind, buckets, &sum_ns);
+    if (count == 0) return;
+    for (size_t i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); i++) {
+        uint64_t rank = (uint64_t)(quantiles[i] * (double)count + 0.5);
+        uint64_t seen = 0;
+        int      b    = 0;
+        if (rank < 1) rank = 1;
+        while (b < HIST_BUCKETS - 1 && (seen += buckets[b]) < rank) b++;
+        fprintf(out, "%s_quantile{kind=\"%s\",quantile=\"%g\"} %.6f\n", hist_info[h].name,
+                kind_name[kind], quantiles[i], (double)(bucket_limit(b) - 1) / 1e6);
+    }
+}
+
+
+void metrics_write(FILE *out, MetricsGaugeFn gauges) {
+    for (int c = 0; c < MC_COUNT; c++) {
+        uint64_t total = 0;
+        for (Shard *s = __atomic_load_n(&g_shards, __ATOMIC_ACQUIRE); s; s = s->next)
+            total += __atomic_load_n(&s->counters[c], __ATOMIC_RELAXED);
+        fprintf(out, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", counter_info[c].name,
+                counter_info[c].help, counter_info[c].name, counter_info[c].name,
+                (unsigned long long)total);
+    }
+    for (int h = 0; h < MH_COUNT; h++) {
+        fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n",
+                hist_info[h].name, hist_info[h].help, hist_info[h].name);
+        write_hist(out, (MetricHist)h, METRIC_PROGRAM);
+        write_hist(out, (MetricHist)h, METRIC_SHELL);
+        fprintf(out, "# HELP %s_quantile %s Quantile estimates.\n# TYPE %s_quantile gauge\n",
+                hist_info[h].name, hist_info[h].help, hist_info[h].name);
+        write_quantiles(out, (MetricHist)h, METRIC_PROGRAM);
+        write_quantiles(out, (MetricHist)h, METRIC_SHELL);
+    }
+    if (gauges != NULL) gauges(out);
+}
+
+
+// Sends all len bytes of buf, giving up on error.
+static void send_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        buf += n;
+        len -= (size_t)n;
+    }
+}
+
+
+// Answers one admin connection: the metrics for GET /metrics (or /), 404 for
+// any other path. A client has a second to send its request line.
+static void admin_serve(int fd) {
+    struct timeval tv = { 1, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    char   req[ADMIN_REQ_SIZE];
+    size_t len = 0;
+    while (len < sizeof(req) - 1 && !memchr(req, '\n', len)) {
+        ssize_t n = recv(fd, req + len, sizeof(req) - 1 - len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        len += (size_t)n;
+    }
+    req[len] = '\0';
+
+    char  *body = NULL;
+    size_t body_len = 0;
+    int    found = strncmp(req, "GET /metrics ", 13) == 0 || strncmp(req, "GET / ", 6) == 0;
+    FILE  *out   = open_memstream(&body, &body_len);
+    if (out == NULL) return;
+    if (found) metrics_write(out, g_gauges);
+    else       fputs("not found\n", out);
+    fclose(out);
+
+    char head[160];
+    int  n = snprintf(head, sizeof(head),
+                      "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                      "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+                      found ? "200 OK" : "404 Not Found", body_len);
+    send_all(fd, head, (size_t)n);
+    send_all(fd, body, body_len);
+    free(body);
+}
+
+
+// Admin thread: serves one connection at a time; a scrape takes well under a
+// millisecond, so there is no need for more.
+static void *admin_run(void *arg) {
+    (void)arg;
+    while (1) {
+        int fd = accept(g_admin_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            log_msg(LL_ERROR, LOG_NO_CLIENT, "error", "[METRICS] accept: %s", strerror(errno));
+            sleep(1);  // EMFILE and friends: retry later
+            continue;
+        }
+        admin_serve(fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+
+int metrics_start(int port, MetricsGaugeFn gauges) {
+    int opt = 1;
+    g_gauges   = gauges;
+    g_admin_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (g_admin_fd < 0) return -1;
+    setsockopt(g_admin_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    // loopback only: the endpoint is unauthenticated
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port        = htons((uint16_t)port);
+    if (bind(g_admin_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(g_admin_fd, 16) < 0) {
+        int err = errno;
+        close(g_admin_fd);
+        g_admin_fd = -1;
+        errno = err;
+        return -1;
+    }
+
+    pthread_t th;
+    int       rc = pthread_create(&th, NULL, admin_run, NULL);
+    if (rc != 0) {
+        close(g_admin_fd);
+        g_admin_fd = -1;
+        errno = rc;
+        return -1;
+    }
+    pthread_detach(th);
+    return 0;
+}
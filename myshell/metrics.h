@@ -0,0 +1,72 @@
+// metrics.h
+// Process-wide metrics registry and the admin endpoint that exposes it.
+//
+// Counters and latency histograms are written on the hot path (every slice,
+// every send), so they never take a lock: each thread owns a shard that only
+// it writes, and a reader sums every shard when the metrics are scraped. A
+// shard is allocated on a thread's first update and lives until the process
+// exits (the server's threads never do). Histograms are HDR-style: logarithmic
+// buckets of microseconds, each octave split into HIST_SUB linear sub-buckets,
+// so any recorded value is known to within 1/HIST_SUB of itself from 1 us to
+// about 12 days. Gauges (queue depth and the like) are not stored here; the
+// owner of the state supplies them at scrape time through a callback.
+//
+// The admin endpoint is a plain HTTP/1.0 listener on 127.0.0.1 that answers
+// GET /metrics in the Prometheus text exposition format (version 0.0.4).
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define HIST_SUB_BITS        3                    // log2 of the sub-buckets per octave
+#define HIST_SUB            (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS       40                    // values of 2^40 us and beyond share the last bucket
+#define HIST_BUCKETS        ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef enum {
+    MC_REQUESTS,            // commands accepted into the scheduler
+    MC_REJECTED,            // commands refused by the -m quota
+    MC_PROGRAMS_DONE,       // programs that ran to completion
+    MC_SHELL_DONE,          // shell commands that finished
+    MC_CANCELLED,           // tasks dropped because their client disconnected
+    MC_SLICES,              // program slices run on a simulated CPU
+    MC_PREEMPTIONS,         // slices cut short by a preemption request
+    MC_CPU_SWITCHES,        // slices that ran a different task than the CPU's last one
+    MC_CSW_VOLUNTARY,       // kernel context switches of finished programs: blocking
+    MC_CSW_INVOLUNTARY,     //   and forced by the kernel's scheduler
+    MC_BYTES_SENT,          // bytes written to client sockets
+    MC_LOG_DROPPED,         // log messages lost to a full buffer (log.c)
+    MC_COUNT
+} MetricCounter;
+
+typedef enum {
+    MH_QUEUE_WAIT,          // time spent ready but not running, over the whole task
+    MH_TURNAROUND,          // arrival to completion
+    MH_RESPONSE,            // arrival to the first time the task ran
+    MH_COUNT
+} MetricHist;
+
+// task kinds a histogram is kept for
+#define METRIC_PROGRAM 0
+#define METRIC_SHELL   1
+
+// writes the current gauges, in exposition format, to out
+typedef void (*MetricsGaugeFn)(FILE *out);
+
+// Adds v to a counter of the calling thread's shard.
+void metrics_add(MetricCounter c, uint64_t v);
+
+// Records a latency of ns nanoseconds for a task of the given kind.
+void metrics_observe(MetricHist h, int kind, int64_t ns);
+
+// Writes every counter and histogram, merged over all threads, then the gauges
+// from gauges (may be NULL), in Prometheus text format.
+void metrics_write(FILE *out, MetricsGaugeFn gauges);
+
+// Starts a detached thread serving GET /metrics on 127.0.0.1:port.
+// Returns 0 on success, -1 if the port cannot be bound (errno set).
+int metrics_start(int port, MetricsGaugeFn gauges);
+
+#endif /* METRICS_H */
@@ -12,257 +12,195 @@
 #define ERROR_REDIR  '2'
 
 // forward declarations for internal helpers
-static int   tokenize_command(const char *cmd_str, Command *cmd);
-static char *next_token_quoted(const char **cursor, int *unmatched_quote);
-static char *trim_whitespace(char *str);
-static int   has_syntax_error(const char *input, char *error_msg);
-static int   find_pipe_positions(const char *input, int *positions, int max_pipes);
-
-
-// Scans input and records the byte index of every '|' that is outside quotes.
-// This prevents splitting on pipes inside quoted strings like: grep "a|b" file.
-// Returns the total number of unquoted pipes found.
-static int find_pipe_positions(const char *input, int *positions, int max_pipes) {
-    int count     = 0;
-    int in_single = 0, in_double = 0;
-
-    for (int i = 0; input[i]; i++) {
-        if      (input[i] == '\'' && !in_double) in_single = !in_single;  // toggle single-quote mode
-        else if (input[i] == '"'  && !in_single) in_double = !in_double;  // toggle double-quote mode
-        else if (input[i] == '|'  && !in_single && !in_double) {
-            if (count < max_pipes) positions[count] = i;  // record pipe position
-            count++;
-        }
-    }
-    return count;
-}
+static char *read_word(const char **cursor, char **text, int *unmatched_quote);
+static int   is_word_end(const char *p);
+
 
-// Prints a parser error to stderr in a consistent "Error: <message>" format.
+// Where print_parse_error() sends messages on this thread: stderr when NULL,
+// otherwise the caller's buffer (see parse_input_quiet()).
+static __thread char  *parse_err_buf;
+static __thread size_t parse_err_size;
+
+// Prints a parser error to stderr in a consistent "Error: <message>" format,
+// or stores the first one in the buffer given to parse_input_quiet().
 void print_parse_error(const char *message) {
-    fprintf(stderr, "Error: %s\n", message);
+    if (parse_err_buf == NULL)
+        fprintf(stderr, "Error: %s\n", message);
+    else if (parse_err_buf[0] == '\0')
+        snprintf(parse_err_buf, parse_err_size, "Error: %s\n", message);
+}
+
+
+// Parses input like parse_input(), but stores the error message (with its
+// trailing newline) in err instead of printing it. err is "" if there is none.
+Pipeline parse_input_quiet(const char *input, char *err, size_t err_size) {
+    err[0]         = '\0';
+    parse_err_buf  = err;
+    parse_err_size = err_size;
+    Pipeline pipeline = parse_input(input);
+    parse_err_buf  = NULL;
+    return pipeline;
 }
 
 
 // Converts the raw input string into a Pipeline of Commands.
-// Steps: syntax check → find pipe positions → count segments →
-//        allocate commands array → tokenize each segment.
-// Sets command_count to -1 and prints an error if anything fails.
+// The whole pipeline lives in one allocation (pipeline.commands): the Command
+// array followed by the text of every token. Its size is bounded up front, as
+// each unquoted '|' adds at most one Command and no token is longer than its
+// source text plus a NUL, so one pass over the input fills it in place.
+// Syntax checks (misplaced pipes, missing file names, quotes) happen in that
+// same pass, so the cost stays linear in the input however many pipes it has.
+// Sets command_count to -1 and prints an error, with the 1-based column where
+// it was found, if anything fails.
 Pipeline parse_input(const char *input) {
     Pipeline pipeline  = {NULL, 0};  // start with an empty, valid pipeline
-    char     error_msg[256];
 
     // treat null or empty input as zero commands (not an error)
-    if (input == NULL || strlen(input) == 0) {
+    if (input == NULL || input[0] == '\0') {
         pipeline.command_count = 0;
         return pipeline;
     }
 
-    // reject obvious syntax errors before doing any allocation
-    if (has_syntax_error(input, error_msg)) {
-        print_parse_error(error_msg);
-        pipeline.command_count = -1;
-        return pipeline;
-    }
-
-    // locate all unquoted pipes so we know how many segments exist
-    int pipe_positions[MAX_ARGS];
-    int pipe_count    = find_pipe_positions(input, pipe_positions, MAX_ARGS);
-    int segment_count = pipe_count + 1;  // N pipes produce N+1 segments
-
-    // first pass: count non-empty segments to know how many Commands to allocate
-    int cmd_count = 0;
-    int seg_start = 0;
-    for (int p = 0; p < segment_count; p++) {
-        // segment ends at the next pipe position, or at end of string
-        int   seg_end = (p < pipe_count) ? pipe_positions[p] : (int)strlen(input);
-        int   seg_len = seg_end - seg_start;
-        char *seg     = malloc(seg_len + 1);
-        if (!seg) { perror("malloc"); pipeline.command_count = -1; return pipeline; }
-        strncpy(seg, input + seg_start, seg_len);
-        seg[seg_len] = '\0';
-        if (strlen(trim_whitespace(seg)) > 0) cmd_count++;  // only count non-blank segments
-        free(seg);
-        seg_start = seg_end + 1;  // skip past the '|'
-    }
-    if (cmd_count == 0) {
-        print_parse_error("Empty command");
-        pipeline.command_count = -1;
-        return pipeline;
-    }
-
-    // allocate the Command array now that we know the exact count
-    pipeline.commands = malloc(cmd_count * sizeof(Command));
-    if (!pipeline.commands) {
+    // size the arena: one Command per '|' (quoted ones included) plus one,
+    // then at most two bytes of token text per input byte
+    size_t len      = 0;
+    int    max_cmds = 1;
+    for (const char *p = input; *p; p++, len++)
+        if (*p == PIPE_CHAR) max_cmds++;
+    Command *cmds = malloc((size_t)max_cmds * sizeof(Command) + 2 * len + 2);
+    if (!cmds) {
         perror("malloc");
         pipeline.command_count = -1;
         return pipeline;
     }
+    char *text = (char *)(cmds + max_cmds);  // token text follows the Command array
+
+    const char *msg       = NULL;  // parse error, if any
+    const char *err_at    = NULL;  // where in input the error was found
+    const char *cursor    = input;
+    const char *last_pipe = NULL;  // the '|' that opened the current segment
+    int         ncmds     = 0;
+    const char *redir_at  = NULL;  // first redirection of the current segment
+    Command    *cmd       = &cmds[0];
+    memset(cmd, 0, sizeof(Command));
+
+    while (msg == NULL) {
+        while (*cursor && isspace((unsigned char)*cursor)) cursor++;
+
+        // end of a segment: it must hold a command unless the line is blank
+        if (*cursor == '\0' || *cursor == PIPE_CHAR) {
+            if (cmd->argc > 0) {
+                cmd->args[cmd->argc] = NULL;  // null-terminate the argv-style array
+                cmd = &cmds[++ncmds];
+            } else if (redir_at != NULL) {
+                // a segment that is only operators would leave argc == 0
+                msg    = "Empty command between pipes";
+                err_at = redir_at;
+                break;
+            } else if (*cursor == PIPE_CHAR) {
+                msg    = last_pipe == NULL ? "Pipe cannot be at the beginning"
+                                        : "Invalid pipe operator";
+                err_at = cursor;
+                break;
+            } else if (last_pipe != NULL) {
+                msg    = "Pipe cannot be at the end";
+                err_at = last_pipe;
+                break;
+            }
+            if (*cursor == '\0') break;
+            last_pipe = cursor++;  // skip past the '|'
+            redir_at  = NULL;
+            memset(cmd, 0, sizeof(Command));
+            continue;
+        }
 
-    // second pass: tokenize each non-blank segment into a Command struct
-    int cmd_idx = 0;
-    seg_start   = 0;
-    for (int p = 0; p < segment_count; p++) {
-        int   seg_end = (p < pipe_count) ? pipe_positions[p] : (int)strlen(input);
-        int   seg_len = seg_end - seg_start;
-        char *seg     = malloc(seg_len + 1);
-        if (!seg) {
-            perror("malloc");
-            free_pipeline(&pipeline);
-            pipeline.command_count = -1;
-            return pipeline;
+        // <, > and 2> take the next word as their file name
+        char      **target = NULL;
+        const char *op     = cursor;
+        if (*cursor == INPUT_REDIR) {
+            target = &cmd->input_file;  msg = "Missing filename after '<'";  cursor += 1;
+        } else if (*cursor == OUTPUT_REDIR) {
+            target = &cmd->output_file; msg = "Missing filename after '>'";  cursor += 1;
+        } else if (*cursor == ERROR_REDIR && cursor[1] == OUTPUT_REDIR) {
+            target = &cmd->error_file;  msg = "Missing filename after '2>'"; cursor += 2;
         }
-        strncpy(seg, input + seg_start, seg_len);
-        seg[seg_len]  = '\0';
-        char *trimmed = trim_whitespace(seg);  // strip leading/trailing spaces
-
-        if (strlen(trimmed) > 0) {
-            Command *cmd = &pipeline.commands[cmd_idx];
-            cmd->argc        = 0;     // no arguments yet
-            cmd->input_file  = NULL;  // no redirections yet
-            cmd->output_file = NULL;
-            cmd->error_file  = NULL;
-
-            // fill the Command with args and any redirections found in this segment
-            if (tokenize_command(trimmed, cmd) == -1) {
-                free(seg);
-                free_pipeline(&pipeline);
-                pipeline.command_count = -1;
-                return pipeline;
+
+        if (target != NULL) {
+            if (redir_at == NULL) redir_at = op;
+            while (*cursor && isspace((unsigned char)*cursor)) cursor++;
+            if (target == &cmd->output_file && cursor[0] == ERROR_REDIR && cursor[1] == OUTPUT_REDIR) {
+                msg    = "Invalid operator '2>' without space";
+                err_at = cursor;
+                break;
             }
-            // a segment that is only whitespace or operators would leave argc == 0
-            if (cmd->argc == 0) {
-                print_parse_error("Empty command between pipes");
-                free(seg);
-                free_pipeline(&pipeline);
-                pipeline.command_count = -1;
-                return pipeline;
+            if (*cursor == '\0' || *cursor == PIPE_CHAR ||
+                *cursor == INPUT_REDIR || *cursor == OUTPUT_REDIR ||
+                (cursor[0] == ERROR_REDIR && cursor[1] == OUTPUT_REDIR)) {
+                err_at = op;  // msg already names the operator
+                break;
             }
-            cmd_idx++;
+            msg = NULL;
+        } else if (cmd->argc == MAX_ARGS - 1) {
+            msg    = "Too many arguments";
+            err_at = cursor;
+            break;
         }
-        free(seg);
-        seg_start = seg_end + 1;  // move past the '|'
-    }
-
-    pipeline.command_count = cmd_count;
-    return pipeline;
-}
-
 
-// Breaks a single command string (no pipes) into tokens.
-// Handles <, >, and 2> as redirection operators; everything else becomes an arg.
-// Returns 0 on success, -1 on parse error.
-static int tokenize_command(const char *cmd_str, Command *cmd) {
-    const char *cursor         = cmd_str;
-    int         unmatched_quote = 0;
-    char       *token          = next_token_quoted(&cursor, &unmatched_quote);
-
-    while (token != NULL && cmd->argc < MAX_ARGS - 1) {
-
-        if (strcmp(token, "<") == 0) {
-            // input redirection: next token is the source file
-            free(token);
-            token = next_token_quoted(&cursor, &unmatched_quote);
-            if (unmatched_quote) { print_parse_error("Unmatched quote"); return -1; }
-            if (token == NULL)   { print_parse_error("Missing filename after '<'"); return -1; }
-            cmd->input_file = malloc(strlen(token) + 1);
-            if (!cmd->input_file) { perror("malloc"); free(token); return -1; }
-            strcpy(cmd->input_file, token);
-            free(token);
-
-        } else if (strcmp(token, ">") == 0) {
-            // output redirection: next token is the destination file
-            free(token);
-            token = next_token_quoted(&cursor, &unmatched_quote);
-            if (unmatched_quote) { print_parse_error("Unmatched quote"); return -1; }
-            if (token == NULL)   { print_parse_error("Missing filename after '>'"); return -1; }
-            // catch "2>" mistakenly parsed as ">" followed by "2>" token
-            if (strlen(token) > 1 && token[0] == '2' && token[1] == '>') {
-                print_parse_error("Invalid operator '2>' without space");
-                free(token);
-                return -1;
-            }
-            cmd->output_file = malloc(strlen(token) + 1);
-            if (!cmd->output_file) { perror("malloc"); free(token); return -1; }
-            strcpy(cmd->output_file, token);
-            free(token);
-
-        } else if (strcmp(token, "2>") == 0) {
-            // stderr redirection: next token is the error output file
-            free(token);
-            token = next_token_quoted(&cursor, &unmatched_quote);
-            if (unmatched_quote) { print_parse_error("Unmatched quote"); return -1; }
-            if (token == NULL)   { print_parse_error("Missing filename after '2>'"); return -1; }
-            cmd->error_file = malloc(strlen(token) + 1);
-            if (!cmd->error_file) { perror("malloc"); free(token); return -1; }
-            strcpy(cmd->error_file, token);
-            free(token);
-
-        } else {
-            // ordinary argument: copy the token into the args array
-            size_t len = strlen(token);
-            char  *arg = malloc(len + 1);
-            if (!arg) { perror("malloc"); free(token); return -1; }
-            memcpy(arg, token, len + 1);  // memcpy preserves backslashes that strcpy would not
-            cmd->args[cmd->argc++] = arg;
-            free(token);
+        int   unmatched = 0;
+        char *word      = read_word(&cursor, &text, &unmatched);
+        if (unmatched) {
+            msg    = "Unmatched quote";
+            err_at = cursor;  // read_word left it on the opening quote
+            break;
         }
+        if (target != NULL) *target = word;
+        else                cmd->args[cmd->argc++] = word;
+    }
 
-        // advance to the next token and check for unmatched quotes
-        token = next_token_quoted(&cursor, &unmatched_quote);
-        if (unmatched_quote) { print_parse_error("Unmatched quote"); return -1; }
+    if (msg == NULL && ncmds == 0) msg = "Empty command";
+    if (msg != NULL) {
+        char located[128];
+        if (err_at != NULL) {
+            snprintf(located, sizeof(located), "%s at column %zu",
+                     msg, (size_t)(err_at - input) + 1);
+            msg = located;
+        }
+        print_parse_error(msg);
+        free(cmds);
+        pipeline.command_count = -1;
+        return pipeline;
     }
 
-    cmd->args[cmd->argc] = NULL;  // null-terminate the argv-style array
-    free(token);
-    return 0;
+    pipeline.commands      = cmds;
+    pipeline.command_count = ncmds;
+    return pipeline;
 }
 
 
-// Extracts the next token from *cursor, respecting single/double quotes and
-// backslash escapes. Advances *cursor past the token.
-// Returns a heap-allocated string, or NULL on EOF or unmatched-quote error.
-static char *next_token_quoted(const char **cursor, int *unmatched_quote) {
-    const char *ptr = *cursor;
-    *unmatched_quote = 0;
-
-    // skip any whitespace before the next token
-    while (*ptr && isspace((unsigned char)*ptr)) ptr++;
-
-    // nothing left in the input
-    if (*ptr == '\0') { *cursor = ptr; return NULL; }
-
-    // '<' and '>' are returned as standalone single-character tokens
-    if (*ptr == '<' || *ptr == '>') {
-        char *token = malloc(2);
-        if (!token) { perror("malloc"); return NULL; }
-        token[0] = *ptr; token[1] = '\0';
-        *cursor = ptr + 1;
-        return token;
-    }
-
-    // "2>" is returned as a standalone two-character token
-    if (*ptr == '2' && *(ptr + 1) == '>') {
-        char *token = malloc(3);
-        if (!token) { perror("malloc"); return NULL; }
-        token[0] = '2'; token[1] = '>'; token[2] = '\0';
-        *cursor = ptr + 2;
-        return token;
-    }
+// Returns 1 if the unquoted character at p ends a word: whitespace, '|', or the
+// start of a redirection operator.
+static int is_word_end(const char *p) {
+    return isspace((unsigned char)*p) || *p == PIPE_CHAR ||
+           *p == INPUT_REDIR || *p == OUTPUT_REDIR ||
+           (*p == ERROR_REDIR && p[1] == OUTPUT_REDIR);
+}
 
-    // allocate worst-case size (remaining input length)
-    size_t max_len = strlen(ptr);
-    char  *token   = malloc(max_len + 1);
-    if (!token) { perror("malloc"); return NULL; }
 
-    size_t out_idx  = 0;
-    int    in_single = 0;  // inside single quotes
-    int    in_double = 0;  // inside double quotes
+// Copies the word at *cursor into *text, respecting single/double quotes and
+// backslash escapes, and NUL-terminates it. Advances *cursor past the word and
+// *text past the copy. Returns the copy, or NULL with *unmatched_quote set and
+// *cursor on the opening quote if a quote is never closed.
+static char *read_word(const char **cursor, char **text, int *unmatched_quote) {
+    const char *ptr       = *cursor;
+    char       *token     = *text;
+    size_t      out_idx   = 0;
+    int         in_single = 0;  // inside single quotes
+    int         in_double = 0;  // inside double quotes
+    const char *quote     = NULL;  // the quote currently open
 
     while (*ptr) {
         if (!in_single && !in_double) {
-            if (isspace((unsigned char)*ptr)) break;          // whitespace ends the token
-            if (*ptr == '<' || *ptr == '>') break;            // redirection operator starts a new token
-            if (*ptr == '2' && *(ptr + 1) == '>') break;      // "2>" operator starts a new token
+            if (is_word_end(ptr)) break;  // whitespace, pipe or operator ends the word
 
             if (*ptr == '\\') {
                 char next = *(ptr + 1);
@@ -276,8 +214,8 @@ static char *next_token_quoted(const char **cursor, int *unmatched_quote) {
                 }
                 continue;
             }
-            if (*ptr == '\'') { in_single = 1; ptr++; continue; }  // open single quote (not copied)
-            if (*ptr == '"')  { in_double = 1; ptr++; continue; }  // open double quote (not copied)
+            if (*ptr == '\'') { in_single = 1; quote = ptr++; continue; }  // open single quote (not copied)
+            if (*ptr == '"')  { in_double = 1; quote = ptr++; continue; }  // open double quote (not copied)
 
         } else if (in_single) {
             // inside single quotes: everything is literal; only closing quote is special
@@ -306,73 +244,24 @@ static char *next_token_quoted(const char **cursor, int *unmatched_quote) {
 
     // a quote was opened but never closed — report the error
     if (in_single || in_double) {
-        free(token);
         *unmatched_quote = 1;
+        *cursor          = quote;
         return NULL;
     }
 
-    token[out_idx] = '\0';  // null-terminate the built token
-    *cursor = ptr;           // advance the caller's cursor past this token
+    token[out_idx++] = '\0';  // null-terminate the built token
+    *cursor = ptr;             // advance the caller's cursor past this word
+    *text   = token + out_idx;
     return token;
 }
 
 
-// Strips leading and trailing whitespace from str in place.
-// Returns a pointer to the first non-whitespace character.
-static char *trim_whitespace(char *str) {
-    while (*str && isspace((unsigned char)*str)) str++;  // skip leading spaces
-    char *end = str + strlen(str) - 1;
-    while (end > str && isspace((unsigned char)*end)) end--;  // find last non-space
-    *(end + 1) = '\0';  // chop off trailing spaces
-    return str;
-}
-
-
-// Scans input for structural syntax errors.
-// Currently catches: leading pipe, trailing pipe, and double pipe ("||").
-// Writes a descriptive message into error_msg and returns 1 if an error is found.
-static int has_syntax_error(const char *input, char *error_msg) {
-    const char *ptr = input;
-    while (*ptr) {
-        if (*ptr == '|') {
-            // check whether everything before this '|' is whitespace (leading pipe)
-            const char *before = input;
-            while (before < ptr && isspace((unsigned char)*before)) before++;
-            if (before == ptr) {
-                strcpy(error_msg, "Pipe cannot be at the beginning");
-                return 1;
-            }
-
-            // look ahead past whitespace to find double pipe or trailing pipe
-            const char *temp = ptr + 1;
-            while (*temp && isspace((unsigned char)*temp)) temp++;
-            if (*temp == '|')  { strcpy(error_msg, "Invalid pipe operator"); return 1; }
-            if (*temp == '\0') { strcpy(error_msg, "Pipe cannot be at the end"); return 1; }
-        }
-        ptr++;
-    }
-    return 0;
-}
-
-
-// Releases all memory owned by pipeline: each Command's args and redirection
-// file strings, the commands array itself, and resets the struct fields.
+// Releases the pipeline's single allocation (commands, arguments and file
+// names) and resets the struct fields.
 void free_pipeline(Pipeline *pipeline) {
     if (pipeline == NULL || pipeline->commands == NULL) return;
 
-    for (int i = 0; i < pipeline->command_count; i++) {
-        Command *cmd = &pipeline->commands[i];
-
-        // free each individually heap-allocated argument string
-        for (int j = 0; j < cmd->argc; j++) free(cmd->args[j]);
-
-        // free redirection filenames if they were set
-        if (cmd->input_file)  free(cmd->input_file);
-        if (cmd->output_file) free(cmd->output_file);
-        if (cmd->error_file)  free(cmd->error_file);
-    }
-
-    free(pipeline->commands);      // free the Command array itself
-    pipeline->commands     = NULL;
+    free(pipeline->commands);
+    pipeline->commands      = NULL;
     pipeline->command_count = 0;
 }
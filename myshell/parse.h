@@ -23,6 +23,7 @@ typedef struct {
 } Pipeline;
 
 Pipeline parse_input(const char *input);
+Pipeline parse_input_quiet(const char *input, char *err, size_t err_size);
 void     free_pipeline(Pipeline *pipeline);
 void     print_parse_error(const char *message);
 
@@ -0,0 +1,221 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "pathcache.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#define PATH_DEFAULT "/bin:/usr/bin"   // what execvp() searches when PATH is unset
+#define PATH_EVENTS  (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | \
+                      IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+// one remembered name; path is NULL if no PATH directory has it
+typedef struct PathEntry {
+    struct PathEntry *next;          // hash-bucket chain
+    char             *path;
+    char              name[];
+} PathEntry;
+
+// the cache; every field is guarded by lock
+static pthread_mutex_t  lock = PTHREAD_MUTEX_INITIALIZER;
+static PathEntry       *buckets[PATH_CACHE_BUCKETS];
+static int              nentries;
+static char            *path_env;     // the PATH the directories below came from
+static char           **dirs;         // its entries, split
+static int              ndirs;
+static int              usable;       // every entry is an absolute directory
+static int              watch_fd = -1;  // inotify instance watching dirs; -1 = polling mtimes
+static struct timespec *mtimes;       // per directory, when polling
+static int64_t          checked_ns;   // last mtime poll
+
+
+// current CLOCK_MONOTONIC time in nanoseconds
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+// Same string hash as the parse cache (FNV-1a).
+static uint64_t hash_name(const char *name) {
+    uint64_t h = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+
+// Forgets every resolved name.
+static void flush(void) {
+    for (int b = 0; b < PATH_CACHE_BUCKETS; b++) {
+        PathEntry *e = buckets[b];
+        while (e) { PathEntry *next = e->next; free(e->path); free(e); e = next; }
+        buckets[b] = NULL;
+    }
+    nentries = 0;
+}
+
+
+// Reads the directories' mtimes into mtimes[]; a missing directory reads as 0.
+static void read_mtimes(struct timespec *out) {
+    struct stat st;
+    for (int i = 0; i < ndirs; i++) {
+        if (stat(dirs[i], &st) == 0) out[i] = st.st_mtim;
+        else                         memset(&out[i], 0, sizeof(out[i]));
+    }
+}
+
+
+// Drops everything and starts over from env: splits it into directories and
+// watches each of them (or records their mtimes if inotify is unavailable).
+// A directory that does not exist yet is not watched.
+static void reload(const char *env) {
+    flush();
+    if (watch_fd >= 0) close(watch_fd);
+    free(path_env);
+    free(dirs);
+    free(mtimes);
+    watch_fd = -1;
+    dirs     = NULL;
+    mtimes   = NULL;
+    ndirs    = 0;
+    usable   = 0;
+
+    if ((path_env = strdup(env)) == NULL) return;
+    int n = 1;
+    for (const char *p = path_env; *p; p++) if (*p == ':') n++;
+    dirs   = malloc((size_t)n * sizeof(char *) + strlen(env) + 1);
+    mtimes = calloc((size_t)n, sizeof(struct timespec));
+    if (dirs == NULL || mtimes == NULL) return;
+
+    // copy the text after the pointer array and cut it at each ':'
+    char *text = (char *)(dirs + n);
+    strcpy(text, env);
+    usable = 1;
+    for (char *d = text; ; ) {
+        char *colon = strchr(d, ':');
+        if (colon) *colon = '\0';
+        if (d[0] != '/') usable = 0;  // "" and relative entries depend on the cwd
+        dirs[ndirs++] = d;
+        if (!colon) break;
+        d = colon + 1;
+    }
+
+    watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch_fd >= 0) {
+        for (int i = 0; i < ndirs; i++)
+            inotify_add_watch(watch_fd, dirs[i], PATH_EVENTS);
+    } else {
+        read_mtimes(mtimes);
+        checked_ns = now_ns();
+    }
+}
+
+
+// Brings the cache up to date with $PATH and its directories.
+// Must be called with lock held.
+static void revalidate(void) {
+    const char *env = getenv("PATH");
+    if (env == NULL) env = PATH_DEFAULT;
+    if (path_env == NULL || strcmp(env, path_env) != 0) {
+        reload(env);
+        return;
+    }
+
+    if (watch_fd >= 0) {
+        // any event at all (including a queue overflow) means start over;
+        // reload() also re-adds the watch of a directory that was replaced;
+        // the events themselves are never looked at
+        char events[4096];
+        if (read(watch_fd, events, sizeof(events)) > 0) reload(env);
+        return;
+    }
+
+    int64_t now = now_ns();
+    if (mtimes == NULL || now - checked_ns < PATH_RECHECK_MS * 1000000LL) return;
+    checked_ns = now;
+    for (int i = 0; i < ndirs; i++) {
+        struct stat st;
+        struct timespec m = {0, 0};
+        if (stat(dirs[i], &st) == 0) m = st.st_mtim;
+        if (m.tv_sec != mtimes[i].tv_sec || m.tv_nsec != mtimes[i].tv_nsec) {
+            flush();
+            read_mtimes(mtimes);
+            return;
+        }
+    }
+}
+
+
+// Searches the PATH directories for name as execvp() would: the first regular
+// file we may execute wins. Returns PATH_FOUND with the path in buf,
+// PATH_MISSING, or PATH_SEARCH if only a file without execute permission was
+// found (execvp() then reports EACCES). Must be called with lock held.
+static PathResult search(const char *name, char *buf, size_t size) {
+    PathResult result = PATH_MISSING;
+    for (int i = 0; i < ndirs; i++) {
+        int n = snprintf(buf, size, "%s/%s", dirs[i], name);
+        if (n < 0 || (size_t)n >= size) continue;
+
+        struct stat st;
+        if (stat(buf, &st) < 0 || !S_ISREG(st.st_mode)) continue;
+        if (access(buf, X_OK) == 0) return PATH_FOUND;
+        result = PATH_SEARCH;
+    }
+    return result;
+}
+
+
+// The answer is remembered only if it is definite (found or missing), so an
+// odd case is always left to posix_spawnp() and reported with its errno.
+PathResult path_resolve(const char *name, char *buf, size_t size) {
+    if (name[0] == '\0' || strchr(name, '/') != NULL) return PATH_SEARCH;
+
+    pthread_mutex_lock(&lock);
+    revalidate();
+    if (!usable) {
+        pthread_mutex_unlock(&lock);
+        return PATH_SEARCH;
+    }
+
+    uint64_t   b = hash_name(name) % PATH_CACHE_BUCKETS;
+    PathEntry *e = buckets[b];
+    while (e != NULL && strcmp(e->name, name) != 0) e = e->next;
+
+    PathResult result;
+    if (e != NULL) {
+        result = e->path != NULL ? PATH_FOUND : PATH_MISSING;
+        if (e->path != NULL && snprintf(buf, size, "%s", e->path) >= (int)size)
+            result = PATH_SEARCH;
+    } else {
+        result = search(name, buf, size);
+        if (result != PATH_SEARCH) {
+            if (nentries >= PATH_CACHE_MAX) flush();
+            size_t len = strlen(name) + 1;
+            e = malloc(sizeof(PathEntry) + len);
+            if (e != NULL) {
+                memcpy(e->name, name, len);
+                e->path = result == PATH_FOUND ? strdup(buf) : NULL;
+                if (result == PATH_FOUND && e->path == NULL) {
+                    free(e);
+                } else {
+                    e->next    = buckets[b];
+                    buckets[b] = e;
+                    nentries++;
+                }
+            }
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return result;
+}
@@ -0,0 +1,36 @@
+// pathcache.h
+// Resolves command names to executables once instead of on every launch.
+//
+// posix_spawnp(), like execvp(), finds a bare command name by trying execve()
+// on each PATH directory in turn, in the child, every time; with a long PATH
+// most of those calls fail. path_resolve() does the search in the parent,
+// remembers the answer (including "not found"), and spawn.c then starts the
+// absolute path directly. Everything cached is dropped as soon as a PATH
+// directory changes: inotify reports files created, removed, renamed or
+// chmod'ed there, and where inotify is unavailable the directories' mtimes are
+// compared at most once every PATH_RECHECK_MS. A change of $PATH itself also
+// starts over. A PATH directory that does not exist at that point is not
+// watched, so one created later is noticed only with the next other change.
+// Thread-safe.
+
+#ifndef PATHCACHE_H
+#define PATHCACHE_H
+
+#include <stddef.h>
+
+#define PATH_CACHE_BUCKETS 256    // hash buckets of the name → path table
+#define PATH_CACHE_MAX     1024   // names remembered before the table is cleared
+#define PATH_RECHECK_MS    1000   // mtime polling interval without inotify
+
+typedef enum {
+    PATH_FOUND,     // buf holds the path of an executable regular file
+    PATH_MISSING,   // no PATH directory has it; exec would fail with ENOENT
+    PATH_SEARCH     // not resolved here (a name with '/', a relative PATH entry,
+                    // a file without execute permission): let posix_spawnp() search
+} PathResult;
+
+// Looks name up in PATH as execvp() would and, for PATH_FOUND, stores the
+// full path of the executable in buf (size bytes).
+PathResult path_resolve(const char *name, char *buf, size_t size);
+
+#endif /* PATHCACHE_H */
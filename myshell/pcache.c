@@ -0,0 +1,161 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "pcache.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the cache; every field is guarded by lock
+static pthread_mutex_t  lock = PTHREAD_MUTEX_INITIALIZER;
+static PCacheEntry     *buckets[PCACHE_BUCKETS];
+static PCacheEntry     *lru_head;    // most recently used
+static PCacheEntry     *lru_tail;    // next to evict
+static PCacheStats      stats;
+
+
+// FNV-1a over the command text.
+static uint64_t hash_key(const char *key) {
+    uint64_t h = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)key; *p; p++) {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+
+// Frees an entry nobody references any more.
+static void entry_free(PCacheEntry *e) {
+    free_pipeline(&e->pipeline);
+    free(e);
+}
+
+
+// Unlinks e from the LRU list. Must be called with lock held.
+static void lru_unlink(PCacheEntry *e) {
+    if (e->prev) e->prev->next = e->next;
+    else         lru_head      = e->next;
+    if (e->next) e->next->prev = e->prev;
+    else         lru_tail      = e->prev;
+    e->prev = e->next = NULL;
+}
+
+
+// Puts e at the most recently used end. Must be called with lock held.
+static void lru_push(PCacheEntry *e) {
+    e->prev = NULL;
+    e->next = lru_head;
+    if (lru_head) lru_head->prev = e;
+    else          lru_tail       = e;
+    lru_head = e;
+}
+
+
+// Returns the cached entry for key with one more reference and marks it most
+// recently used, or NULL. Must be called with lock held.
+static PCacheEntry *lookup(const char *key, uint64_t hash) {
+    for (PCacheEntry *e = buckets[hash % PCACHE_BUCKETS]; e != NULL; e = e->hnext) {
+        if (e->hash != hash || strcmp(e->key, key) != 0) continue;
+        e->refs++;
+        lru_unlink(e);
+        lru_push(e);
+        return e;
+    }
+    return NULL;
+}
+
+
+// Removes the least recently used entry from the cache. Returns it if that was
+// its last reference (the caller frees it outside the lock), else NULL.
+// Must be called with lock held.
+static PCacheEntry *evict_one(void) {
+    PCacheEntry *e = lru_tail;
+    PCacheEntry **link = &buckets[e->hash % PCACHE_BUCKETS];
+    while (*link != e) link = &(*link)->hnext;
+    *link = e->hnext;
+    lru_unlink(e);
+    e->cached = 0;
+    stats.entries--;
+    stats.evictions++;
+    return --e->refs == 0 ? e : NULL;
+}
+
+
+// The command is parsed without the lock held, so a slow parse never stalls
+// other threads' hits. If two threads miss on the same text at once, the first
+// to insert wins and the other's copy is discarded.
+int pcache_get(const char *cmd, PCacheEntry **entry, char *err, size_t err_size) {
+    size_t   len  = strlen(cmd);
+    uint64_t hash = hash_key(cmd);
+
+    err[0] = '\0';
+    pthread_mutex_lock(&lock);
+    PCacheEntry *e = lookup(cmd, hash);
+    if (e != NULL) stats.hits++;
+    else           stats.misses++;
+    pthread_mutex_unlock(&lock);
+    if (e != NULL) {
+        *entry = e;
+        return e->pipeline.command_count;
+    }
+
+    e = malloc(sizeof(PCacheEntry) + len + 1);
+    if (e == NULL) return -1;
+    e->pipeline = parse_input_quiet(cmd, err, err_size);
+    if (e->pipeline.command_count <= 0) {
+        int count = e->pipeline.command_count;
+        free(e);
+        return count;
+    }
+    memcpy(e->key, cmd, len + 1);
+    e->hash   = hash;
+    e->refs   = 1;  // the caller's
+    e->cached = 0;
+    e->hnext  = e->prev = e->next = NULL;
+    *entry    = e;
+    if (len > PCACHE_MAX_KEY) return e->pipeline.command_count;
+
+    PCacheEntry *victim = NULL;
+    pthread_mutex_lock(&lock);
+    PCacheEntry *other = lookup(cmd, hash);
+    if (other == NULL) {
+        e->refs++;  // the cache's
+        e->cached = 1;
+        e->hnext  = buckets[hash % PCACHE_BUCKETS];
+        buckets[hash % PCACHE_BUCKETS] = e;
+        lru_push(e);
+        if (++stats.entries > PCACHE_CAPACITY) victim = evict_one();
+    }
+    pthread_mutex_unlock(&lock);
+
+    if (victim != NULL) entry_free(victim);
+    if (other != NULL) {
+        entry_free(e);
+        *entry = other;
+    }
+    return (*entry)->pipeline.command_count;
+}
+
+
+void pcache_put(PCacheEntry *entry) {
+    pthread_mutex_lock(&lock);
+    int last = (--entry->refs == 0);
+    pthread_mutex_unlock(&lock);
+    if (last) entry_free(entry);
+}
+
+
+void pcache_count(uint64_t hits, uint64_t misses) {
+    pthread_mutex_lock(&lock);
+    stats.hits   += hits;
+    stats.misses += misses;
+    pthread_mutex_unlock(&lock);
+}
+
+
+void pcache_stats(PCacheStats *out) {
+    pthread_mutex_lock(&lock);
+    *out = stats;
+    pthread_mutex_unlock(&lock);
+}
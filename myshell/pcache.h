@@ -0,0 +1,61 @@
+// pcache.h
+// Process-wide LRU cache of parsed commands, keyed by the command text.
+//
+// Clients send the same command strings over and over (health checks, polling
+// scripts), so each distinct string is parsed once and its Pipeline kept. An
+// entry is immutable once cached and reference-counted: a caller holds it from
+// pcache_get() until pcache_put(), so eviction of an entry another thread is
+// still starting from only drops the cache's own reference. All functions are
+// thread-safe.
+
+#ifndef PCACHE_H
+#define PCACHE_H
+
+#include "parse.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PCACHE_CAPACITY 256    // cached commands before the least recently used is evicted
+#define PCACHE_BUCKETS  512    // hash buckets of the command-text index
+#define PCACHE_MAX_KEY  4096   // longer commands are parsed every time, never cached
+
+// One cached command. pipeline and key are read-only after insertion; the rest
+// belongs to the cache and is guarded by its lock.
+typedef struct PCacheEntry {
+    Pipeline            pipeline;
+    uint64_t            hash;
+    int                 refs;      // the cache's own (while indexed) + one per holder
+    int                 cached;    // still indexed and on the LRU list
+    struct PCacheEntry *hnext;     // hash-bucket chain
+    struct PCacheEntry *prev;      // LRU list, most recently used first
+    struct PCacheEntry *next;
+    char                key[];     // NUL-terminated command text
+} PCacheEntry;
+
+// Counters since startup. hits and misses include those reported with
+// pcache_count(); evictions and entries describe this process's cache only.
+typedef struct {
+    uint64_t hits;        // commands answered from the cache
+    uint64_t misses;      // commands that had to be parsed
+    uint64_t evictions;   // entries dropped to stay within PCACHE_CAPACITY
+    int      entries;     // commands currently cached
+} PCacheStats;
+
+// Returns the parsed form of cmd in *entry, parsing and caching it on a miss.
+// Returns the pipeline's command_count: > 0 with *entry set, which the caller
+// must pcache_put(); 0 for blank input; -1 on a syntax error, with the message
+// (as from parse_input_quiet()) in err, or with err "" if memory ran out.
+// Inputs that do not parse to a pipeline are not cached.
+int pcache_get(const char *cmd, PCacheEntry **entry, char *err, size_t err_size);
+
+// Releases an entry returned by pcache_get(); it must not be used afterwards.
+void pcache_put(PCacheEntry *entry);
+
+// Adds lookups made elsewhere (a helper process's own cache) to the counters.
+void pcache_count(uint64_t hits, uint64_t misses);
+
+// Copies the current counters into *stats.
+void pcache_stats(PCacheStats *stats);
+
+#endif /* PCACHE_H */
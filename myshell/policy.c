@@ -0,0 +1,195 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "policy.h"
+
+#include <string.h>
+
+
+// Shared tie-breaks: earlier arrival (FCFS), then lower task_id so the order is total.
+static int fcfs_before(const Task *a, const Task *b) {
+    if (a->arrival_ns != b->arrival_ns) return a->arrival_ns < b->arrival_ns;
+    return a->task_id < b->task_id;
+}
+
+
+// The root of the heap.
+static int pick_best(TaskQueue *q, SchedCpu *cpu) {
+    (void)q; (void)cpu;
+    return 0;
+}
+
+
+// ── srjf: shortest remaining job first + two-level round robin ────────────
+
+static void srjf_enqueue(TaskQueue *q, Task *t, int arrived) {
+    (void)q; (void)t; (void)arrived;  // remaining_ns is kept by the scheduler
+}
+
+// Shorter remaining time first (SRJF), then FCFS.
+static int srjf_before(const Task *a, const Task *b) {
+    if (a->remaining_ns != b->remaining_ns) return a->remaining_ns < b->remaining_ns;
+    return fcfs_before(a, b);
+}
+
+// Skips the task this CPU ran last unless it is the only one available (avoids
+// starvation of other clients by running the same task twice in a row); the
+// runner-up is always one of the root's two children, so this stays O(1).
+static int srjf_pick_next(TaskQueue *q, SchedCpu *cpu) {
+    if (TASK(q, q->heap[0])->task_id != cpu->last_run_task_id || q->ready == 1) return 0;
+    if (q->ready > 2 && srjf_before(TASK(q, q->heap[2]), TASK(q, q->heap[1]))) return 2;
+    return 1;
+}
+
+// Round 1 uses the shorter quantum.
+static int64_t srjf_quantum(const TaskQueue *q, const Task *t) {
+    return t->round == 1 ? q->quantum_first_ns : q->quantum_rest_ns;
+}
+
+static void srjf_on_slice_end(TaskQueue *q, Task *t, int64_t used_ns, int expired) {
+    (void)q; (void)t; (void)used_ns; (void)expired;
+}
+
+// A shorter job preempts the running one with the most remaining time.
+static int srjf_preempts(const TaskQueue *q, const Task *t, const Task *running) {
+    (void)q;
+    return t->burst_ns < running->remaining_ns;
+}
+
+
+// ── mlfq: multi-level feedback queue ──────────────────────────────────────
+
+// New tasks start at the top level; every task rejoins the back of its level.
+static void mlfq_enqueue(TaskQueue *q, Task *t, int arrived) {
+    (void)q;
+    if (arrived) t->level = 0;
+    t->queued_ns = sched_now_ns();
+}
+
+// Higher level (lower number) first, FIFO within a level.
+static int mlfq_before(const Task *a, const Task *b) {
+    if (a->level     != b->level)     return a->level     < b->level;
+    if (a->queued_ns != b->queued_ns) return a->queued_ns < b->queued_ns;
+    return a->task_id < b->task_id;
+}
+
+// Every MLFQ_BOOST_MS moves all waiting tasks back to the top level, so a
+// stream of short jobs cannot starve the long ones at the bottom forever.
+static int mlfq_pick_next(TaskQueue *q, SchedCpu *cpu) {
+    (void)cpu;
+    int64_t now = sched_now_ns();
+    if (now - q->boost_ns >= MLFQ_BOOST_MS * NSEC_PER_MS) {
+        q->boost_ns = now;
+        for (int i = 0; i < q->ready; i++) TASK(q, q->heap[i])->level = 0;
+        sched_reorder(q);
+    }
+    return 0;
+}
+
+// Level n gets 2^n round-1 quanta.
+static int64_t mlfq_quantum(const TaskQueue *q, const Task *t) {
+    return q->quantum_first_ns << t->level;
+}
+
+// Using a whole quantum marks a CPU-bound task: it drops a level. A task that
+// was preempted keeps its level.
+static void mlfq_on_slice_end(TaskQueue *q, Task *t, int64_t used_ns, int expired) {
+    (void)q; (void)used_ns;
+    if (expired && t->level < MLFQ_LEVELS - 1) t->level++;
+}
+
+// A new task (top level) preempts one that has dropped below it.
+static int mlfq_preempts(const TaskQueue *q, const Task *t, const Task *running) {
+    (void)q;
+    return t->level < running->level;
+}
+
+
+// ── cfs: weighted fair share by virtual runtime ───────────────────────────
+
+// A new task starts at the smallest vruntime of the queue, so it neither
+// starves the others by bringing no history nor waits behind all of it.
+static void cfs_enqueue(TaskQueue *q, Task *t, int arrived) {
+    if (arrived && t->vruntime_ns < q->min_vruntime_ns) t->vruntime_ns = q->min_vruntime_ns;
+}
+
+// Least weighted running time first, then FCFS.
+static int cfs_before(const Task *a, const Task *b) {
+    if (a->vruntime_ns != b->vruntime_ns) return a->vruntime_ns < b->vruntime_ns;
+    return fcfs_before(a, b);
+}
+
+// -q is the period in which every waiting task should run once; the slice is
+// its share of that, but at least -q / CFS_MIN_SLICES.
+static int64_t cfs_quantum(const TaskQueue *q, const Task *t) {
+    (void)t;
+    int64_t slice = q->quantum_first_ns / (q->ready + 1);
+    int64_t floor = q->quantum_first_ns / CFS_MIN_SLICES;
+    return slice > floor ? slice : floor;
+}
+
+// Running time is charged inversely to the task's weight; min_vruntime only
+// moves forward, tracking the smallest vruntime still queued.
+static void cfs_on_slice_end(TaskQueue *q, Task *t, int64_t used_ns, int expired) {
+    (void)expired;
+    t->vruntime_ns += used_ns * CFS_WEIGHT_DEFAULT / (t->weight > 0 ? t->weight : CFS_WEIGHT_DEFAULT);
+    int64_t least = t->vruntime_ns;
+    if (q->ready > 0 && TASK(q, q->heap[0])->vruntime_ns < least)
+        least = TASK(q, q->heap[0])->vruntime_ns;
+    if (least > q->min_vruntime_ns) q->min_vruntime_ns = least;
+}
+
+// Preempt only a task that is a full minimum slice ahead, so arrivals do not
+// cut every slice short.
+static int cfs_preempts(const TaskQueue *q, const Task *t, const Task *running) {
+    return t->vruntime_ns + q->quantum_first_ns / CFS_MIN_SLICES < running->vruntime_ns;
+}
+
+
+// ── edf: earliest deadline first ──────────────────────────────────────────
+
+static void edf_enqueue(TaskQueue *q, Task *t, int arrived) {
+    (void)q;
+    if (arrived) t->deadline_ns = t->arrival_ns + EDF_STRETCH * t->burst_ns;
+}
+
+// Earlier deadline first, then FCFS.
+static int edf_before(const Task *a, const Task *b) {
+    if (a->deadline_ns != b->deadline_ns) return a->deadline_ns < b->deadline_ns;
+    return fcfs_before(a, b);
+}
+
+// Slices only bound how long a decision stands; the earliest deadline keeps
+// the CPU across them.
+static int64_t edf_quantum(const TaskQueue *q, const Task *t) {
+    (void)t;
+    return q->quantum_rest_ns;
+}
+
+static void edf_on_slice_end(TaskQueue *q, Task *t, int64_t used_ns, int expired) {
+    (void)q; (void)t; (void)used_ns; (void)expired;
+}
+
+static int edf_preempts(const TaskQueue *q, const Task *t, const Task *running) {
+    (void)q;
+    return t->deadline_ns < running->deadline_ns;
+}
+
+
+static const SchedPolicy policies[] = {
+    { "srjf", srjf_enqueue, srjf_before, srjf_pick_next, srjf_quantum, srjf_on_slice_end, srjf_preempts },
+    { "mlfq", mlfq_enqueue, mlfq_before, mlfq_pick_next, mlfq_quantum, mlfq_on_slice_end, mlfq_preempts },
+    { "cfs",  cfs_enqueue,  cfs_before,  pick_best,      cfs_quantum,  cfs_on_slice_end,  cfs_preempts  },
+    { "edf",  edf_enqueue,  edf_before,  pick_best,      edf_quantum,  edf_on_slice_end,  edf_preempts  },
+};
+
+
+const SchedPolicy *policy_find(const char *name) {
+    for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++)
+        if (strcmp(policies[i].name, name) == 0) return &policies[i];
+    return NULL;
+}
+
+
+const SchedPolicy *policy_default(void) {
+    return &policies[0];
+}
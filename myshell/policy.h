@@ -0,0 +1,61 @@
+// policy.h
+// Scheduling policies for program tasks.
+//
+// The scheduler keeps waiting programs in one ready heap and calls the active
+// policy at each decision point; the policy owns the per-task keys that order
+// the heap (Task.level, vruntime_ns, deadline_ns, ...). Four are built in:
+//   srjf  shortest remaining (predicted) time first, round-robin quanta of
+//         -q for round 1 and -Q after; the default
+//   mlfq  multi-level feedback queue: MLFQ_LEVELS FIFO levels with quanta
+//         -q, 2·-q, 4·-q...; a task that uses a whole quantum drops a level,
+//         and every MLFQ_BOOST_MS all waiting tasks return to the top
+//   cfs   weighted fair share: the task with the least weighted running time
+//         (vruntime) runs next, for a slice of -q divided among the waiting tasks
+//   edf   earliest deadline first; a task's deadline is its arrival plus
+//         EDF_STRETCH times its predicted burst
+// Every hook is called with q->mutex held.
+
+#ifndef POLICY_H
+#define POLICY_H
+
+#include "scheduler.h"
+
+#define MLFQ_LEVELS        3      // priority levels of the feedback queue
+#define MLFQ_BOOST_MS   10000     // period of the reset to the top level (ms)
+#define CFS_WEIGHT_DEFAULT 1024   // weight of an ordinary task
+#define CFS_MIN_SLICES     8      // a CFS slice is never shorter than -q / this
+#define EDF_STRETCH        2      // relative deadline in multiples of the burst
+
+typedef struct SchedPolicy {
+    const char *name;
+
+    // Sets the policy's keys of t before it is pushed on the ready heap: on its
+    // arrival (arrived = 1) or when it is requeued after a slice (arrived = 0).
+    void    (*enqueue)(TaskQueue *q, Task *t, int arrived);
+
+    // Heap order: returns 1 if a should run before b. Must be a total order.
+    int     (*before)(const Task *a, const Task *b);
+
+    // Chooses the next task for cpu and returns its position in q->heap
+    // (0 is the best by before()). q->ready > 0.
+    int     (*pick_next)(TaskQueue *q, SchedCpu *cpu);
+
+    // Length of the next slice of t in nanoseconds.
+    int64_t (*quantum)(const TaskQueue *q, const Task *t);
+
+    // Accounts a slice of used_ns after which t still has work left; expired is
+    // set if the whole quantum was used (rather than t being preempted).
+    void    (*on_slice_end)(TaskQueue *q, Task *t, int64_t used_ns, int expired);
+
+    // Returns 1 if the arriving task t should preempt running, the running
+    // program that before() ranks last.
+    int     (*preempts)(const TaskQueue *q, const Task *t, const Task *running);
+} SchedPolicy;
+
+// Returns the built-in policy called name, or NULL.
+const SchedPolicy *policy_find(const char *name);
+
+// The default policy (srjf).
+const SchedPolicy *policy_default(void);
+
+#endif /* POLICY_H */
@@ -0,0 +1,141 @@
+#include "pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define STR_HUGE_CLASS 0xff  // header value marking a malloc'd oversized string
+
+// Grows *array (of elem_size-byte elements) so it can hold at least need elements.
+// Capacity doubles to keep the amortised cost O(1). Returns 0 on success, -1 on OOM.
+static int grow_array(void **array, int *cap, int need, size_t elem_size) {
+    if (need <= *cap) return 0;
+    int new_cap = (*cap > 0) ? *cap : 8;
+    while (new_cap < need) new_cap *= 2;
+    void *p = realloc(*array, (size_t)new_cap * elem_size);
+    if (!p) return -1;
+    *array = p;
+    *cap   = new_cap;
+    return 0;
+}
+
+
+void slab_init(SlabPool *p, size_t obj_size, int per_slab) {
+    memset(p, 0, sizeof(SlabPool));
+    p->obj_size = obj_size;
+    p->per_slab = per_slab;
+}
+
+
+// Pops the most recently freed index (its memory is likely still in cache).
+// When none is left, allocates one zeroed slab and pushes all of its indices.
+int slab_alloc(SlabPool *p) {
+    if (p->nfree == 0) {
+        int base = p->nslabs * p->per_slab;
+        if (grow_array((void **)&p->slabs, &p->slabs_cap, p->nslabs + 1, sizeof(char *)) < 0)
+            return -1;
+        if (grow_array((void **)&p->free_stack, &p->free_cap, base + p->per_slab, sizeof(int)) < 0)
+            return -1;
+
+        char *slab = calloc((size_t)p->per_slab, p->obj_size);
+        if (!slab) return -1;
+        p->slabs[p->nslabs++] = slab;
+
+        // push in reverse so the lowest index comes out first
+        for (int i = p->per_slab - 1; i >= 0; i--)
+            p->free_stack[p->nfree++] = base + i;
+    }
+    return p->free_stack[--p->nfree];
+}
+
+
+// The free stack was sized for every index when its slab was added, so this never allocates.
+void slab_free(SlabPool *p, int idx) {
+    p->free_stack[p->nfree++] = idx;
+}
+
+
+int slab_capacity(const SlabPool *p) {
+    return p->nslabs * p->per_slab;
+}
+
+
+void slab_destroy(SlabPool *p) {
+    for (int i = 0; i < p->nslabs; i++) free(p->slabs[i]);
+    free(p->slabs);
+    free(p->free_stack);
+    slab_init(p, p->obj_size, p->per_slab);
+}
+
+
+void str_arena_init(StrArena *a) {
+    memset(a, 0, sizeof(StrArena));
+}
+
+
+// Returns the smallest class whose block holds size bytes, or -1 if none does.
+static int str_class_of(size_t size) {
+    size_t block = STR_MIN_CLASS;
+    for (int c = 0; c < STR_CLASSES; c++, block <<= 1)
+        if (size <= block) return c;
+    return -1;
+}
+
+
+// Carves one new chunk into blocks of class c and threads them onto its free list.
+static int str_arena_refill(StrArena *a, int c) {
+    size_t block = (size_t)STR_MIN_CLASS << c;
+    if (grow_array((void **)&a->chunks, &a->chunks_cap, a->nchunks + 1, sizeof(char *)) < 0)
+        return -1;
+    char *chunk = malloc(STR_CHUNK_SIZE);
+    if (!chunk) return -1;
+    a->chunks[a->nchunks++] = chunk;
+
+    for (size_t off = 0; off + block <= STR_CHUNK_SIZE; off += block) {
+        void **node = (void **)(chunk + off);  // free blocks store the next pointer in place
+        *node = a->free_lists[c];
+        a->free_lists[c] = node;
+    }
+    return 0;
+}
+
+
+// Each block starts with a one-byte header holding its class, so str_arena_free()
+// needs no size argument; the string itself follows the header.
+char *str_arena_dup(StrArena *a, const char *s) {
+    size_t len = strlen(s);
+    int    c   = str_class_of(len + 2);  // header byte + string + NUL
+
+    char *block;
+    if (c < 0) {
+        block = malloc(len + 2);  // larger than any class: fall back to the heap
+        if (!block) return NULL;
+        block[0] = (char)STR_HUGE_CLASS;
+    } else {
+        if (a->free_lists[c] == NULL && str_arena_refill(a, c) < 0) return NULL;
+        void **node = a->free_lists[c];
+        a->free_lists[c] = *node;
+        block    = (char *)node;
+        block[0] = (char)c;
+    }
+    memcpy(block + 1, s, len + 1);
+    return block + 1;
+}
+
+
+void str_arena_free(StrArena *a, char *s) {
+    if (s == NULL) return;
+    char         *block = s - 1;
+    unsigned char c     = (unsigned char)block[0];
+    if (c == STR_HUGE_CLASS) { free(block); return; }
+
+    void **node = (void **)block;
+    *node = a->free_lists[c];
+    a->free_lists[c] = node;
+}
+
+
+void str_arena_destroy(StrArena *a) {
+    for (int i = 0; i < a->nchunks; i++) free(a->chunks[i]);
+    free(a->chunks);
+    str_arena_init(a);
+}
@@ -0,0 +1,71 @@
+// pool.h
+// Declares two small allocators used by the scheduler so its memory grows with load:
+//   SlabPool — fixed-size objects addressed by integer index, allocated in slabs
+//              that never move, with freed indices recycled LIFO.
+//   StrArena — size-classed storage for immutable strings (command text).
+// Neither is thread-safe; callers serialise access (the scheduler uses q->mutex).
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+#define STR_MIN_CLASS    16     // smallest string block, header byte included
+#define STR_CLASSES       9     // 16, 32, ..., 4096-byte blocks
+#define STR_CHUNK_SIZE 65536    // bytes carved into blocks per refill
+
+// index-addressed object pool; objects stay at a fixed address once allocated
+typedef struct {
+    size_t  obj_size;     // bytes per object
+    int     per_slab;     // objects per slab
+    char  **slabs;        // slab base pointers
+    int     nslabs;
+    int     slabs_cap;
+    int    *free_stack;   // indices of free objects, most recently freed on top
+    int     nfree;
+    int     free_cap;
+} SlabPool;
+
+// size-classed string allocator; strings longer than the largest class use malloc
+typedef struct {
+    void  *free_lists[STR_CLASSES];  // singly linked free blocks per class
+    char **chunks;                   // every chunk carved so far, for destroy
+    int    nchunks;
+    int    chunks_cap;
+} StrArena;
+
+// Prepares an empty pool of obj_size-byte objects, per_slab per slab. Allocates nothing.
+void slab_init(SlabPool *p, size_t obj_size, int per_slab);
+
+// Returns the index of a zeroed-on-first-use object, growing by one slab when
+// no free index is left. Recycled objects keep their previous contents.
+// Returns -1 if memory is exhausted.
+int slab_alloc(SlabPool *p);
+
+// Returns idx to the pool for reuse.
+void slab_free(SlabPool *p, int idx);
+
+// Total objects in all slabs (allocated or free).
+int slab_capacity(const SlabPool *p);
+
+// Releases every slab; the pool can be reused after slab_init().
+void slab_destroy(SlabPool *p);
+
+// Address of object idx; valid for the lifetime of the pool.
+static inline void *slab_at(const SlabPool *p, int idx) {
+    return p->slabs[idx / p->per_slab] + (size_t)(idx % p->per_slab) * p->obj_size;
+}
+
+// Prepares an empty arena. Allocates nothing.
+void str_arena_init(StrArena *a);
+
+// Copies s into the smallest block that fits. Returns NULL if memory is exhausted.
+char *str_arena_dup(StrArena *a, const char *s);
+
+// Returns a string obtained from str_arena_dup() to its size class.
+void str_arena_free(StrArena *a, char *s);
+
+// Releases every chunk. Oversized strings must have been freed individually.
+void str_arena_destroy(StrArena *a);
+
+#endif /* POOL_H */
@@ -0,0 +1,260 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "predict.h"
+#include "log.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define NSEC_PER_SEC 1000000000LL
+
+// one learned estimate; key is "=" + the command text or "~" + its shape
+typedef struct Estimate {
+    struct Estimate *next;        // hash-bucket chain
+    int64_t          tau_ns;      // exponential average of measured running times
+    long             samples;     // runs folded in
+    char             key[];
+} Estimate;
+
+// the table; every field is guarded by lock
+static pthread_mutex_t  lock = PTHREAD_MUTEX_INITIALIZER;
+static Estimate        *buckets[PREDICT_BUCKETS];
+static int              nestimates;
+static int              dirty;        // learned something since the last save
+static char            *save_path;
+
+// held through a whole save, so concurrent saves never share the temporary
+// file and the last one renamed is the newest
+static pthread_mutex_t  save_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+// FNV-1a over the key.
+static uint64_t hash_key(const char *key) {
+    uint64_t h = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)key; *p; p++) {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+
+// Returns 1 and stores its value in *val if the len bytes at s are one number
+// ("20", "0.5", "-3"); returns 0 otherwise.
+static int is_number(const char *s, size_t len, double *val) {
+    char  buf[64];
+    char *end;
+    if (len == 0 || len >= sizeof(buf)) return 0;
+    memcpy(buf, s, len);
+    buf[len] = '\0';
+    *val = strtod(buf, &end);
+    return *end == '\0';
+}
+
+
+// Builds both keys of command: exact gets "=" and the words separated by single
+// spaces, shape gets "~", the program, and each argument as "#" (a number),
+// itself (an option starting with '-') or "*" (anything else). *scale is set to
+// the last argument if that is a positive number, else to 0.
+// Returns the number of words, or -1 if a key would not fit PREDICT_KEY_MAX.
+static int make_keys(const char *command, char *exact, char *shape, double *scale) {
+    size_t      e = 0, s = 0;
+    int         words = 0;
+    const char *p = command;
+    *scale = 0;
+    exact[e++] = '=';
+    shape[s++] = '~';
+
+    for (;;) {
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == '\0') break;
+        const char *w = p;
+        while (*p && !isspace((unsigned char)*p)) p++;
+        size_t len = (size_t)(p - w);
+
+        const char *kind    = w;
+        size_t      kindlen = len;
+        double      n       = 0;
+        if (words > 0 && is_number(w, len, &n)) { kind = "#"; kindlen = 1; }
+        else if (words > 0 && w[0] != '-') { kind = "*"; kindlen = 1; }
+        *scale = n > 0 ? n : 0;
+
+        if (e + len + 2 > PREDICT_KEY_MAX || s + kindlen + 2 > PREDICT_KEY_MAX) return -1;
+        if (words > 0) { exact[e++] = ' '; shape[s++] = ' '; }
+        memcpy(exact + e, w, len);
+        memcpy(shape + s, kind, kindlen);
+        e += len;
+        s += kindlen;
+        words++;
+    }
+    exact[e] = '\0';
+    shape[s] = '\0';
+    return words;
+}
+
+
+// Returns the estimate for key, or NULL. With create, adds an empty one if
+// there is room. Must be called with lock held.
+static Estimate *lookup(const char *key, int create) {
+    uint64_t  b = hash_key(key) % PREDICT_BUCKETS;
+    Estimate *e = buckets[b];
+    while (e != NULL && strcmp(e->key, key) != 0) e = e->next;
+    if (e != NULL || !create || nestimates >= PREDICT_MAX) return e;
+
+    size_t len = strlen(key) + 1;
+    if ((e = malloc(sizeof(Estimate) + len)) == NULL) return NULL;
+    memcpy(e->key, key, len);
+    e->tau_ns  = 0;
+    e->samples = 0;
+    e->next    = buckets[b];
+    buckets[b] = e;
+    nestimates++;
+    return e;
+}
+
+
+// Folds one sample into e. Must be called with lock held.
+static void update(Estimate *e, int64_t ran_ns) {
+    if (e->samples == 0) e->tau_ns = ran_ns;
+    else e->tau_ns = (int64_t)(PREDICT_ALPHA * (double)ran_ns +
+                               (1.0 - PREDICT_ALPHA) * (double)e->tau_ns);
+    e->samples++;
+    dirty = 1;
+}
+
+
+// Each line of the file is "<tau_ns> <samples> <key>"; malformed lines are skipped.
+void predict_init(const char *path) {
+    if (path == NULL) return;
+    save_path = strdup(path);
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return;
+    char line[PREDICT_KEY_MAX + 64];
+    pthread_mutex_lock(&lock);
+    while (fgets(line, sizeof(line), f) != NULL) {
+        long long tau;
+        long      samples;
+        int       off;
+        line[strcspn(line, "\n")] = '\0';
+        if (sscanf(line, "%lld %ld %n", &tau, &samples, &off) != 2) continue;
+        const char *key = line + off;
+        if (tau < 0 || samples <= 0 || (key[0] != '=' && key[0] != '~')) continue;
+        Estimate *e = lookup(key, 1);
+        if (e == NULL) break;
+        e->tau_ns  = tau;
+        e->samples = samples;
+    }
+    pthread_mutex_unlock(&lock);
+    fclose(f);
+}
+
+
+// A shape estimate is a time per unit of the last argument when that is a
+// number, so "./demo 20" learned from "./demo 2" is still predicted ten times
+// longer rather than equal to it.
+int64_t predict_burst(const char *command, int64_t fallback_ns) {
+    char   exact[PREDICT_KEY_MAX];
+    char   shape[PREDICT_KEY_MAX];
+    double scale;
+
+    if (make_keys(command, exact, shape, &scale) > 0) {
+        int64_t tau = -1;
+        pthread_mutex_lock(&lock);
+        Estimate *e = lookup(exact, 0);
+        if (e != NULL) tau = e->tau_ns;
+        else if ((e = lookup(shape, 0)) != NULL)
+            tau = scale > 0 ? (int64_t)((double)e->tau_ns * scale) : e->tau_ns;
+        pthread_mutex_unlock(&lock);
+        if (tau >= 0) return tau;
+    }
+
+    // never seen: "./demo N" style programs take N seconds (fractions allowed)
+    const char *last_space = strrchr(command, ' ');
+    if (last_space != NULL && *(last_space + 1) != '\0') {
+        double n = strtod(last_space + 1, NULL);
+        if (n > 0) return (int64_t)(n * (double)NSEC_PER_SEC);
+    }
+    return fallback_ns;
+}
+
+
+void predict_record(const char *command, int64_t ran_ns) {
+    char   exact[PREDICT_KEY_MAX];
+    char   shape[PREDICT_KEY_MAX];
+    double scale;
+    if (ran_ns <= 0 || make_keys(command, exact, shape, &scale) <= 0) return;
+
+    // the shape learns the time per unit of a numeric last argument
+    int64_t per_unit = ran_ns;
+    if (scale > 0) {
+        per_unit = (int64_t)((double)ran_ns / scale);
+        if (per_unit < 1) per_unit = 1;
+    }
+
+    pthread_mutex_lock(&lock);
+    Estimate *e = lookup(exact, 1);
+    if (e != NULL) update(e, ran_ns);
+    if ((e = lookup(shape, 1)) != NULL) update(e, per_unit);
+    pthread_mutex_unlock(&lock);
+}
+
+
+// The table is formatted in memory under lock, then written to a temporary
+// file that is synced and renamed over the old one with only save_lock held,
+// so predictions never wait for the disk and a crash mid-save never leaves a
+// truncated file behind.
+int predict_save(void) {
+    if (save_path == NULL) return 0;
+
+    char tmp[4096];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", save_path) >= (int)sizeof(tmp)) return -1;
+
+    pthread_mutex_lock(&save_lock);
+    char  *text = NULL;
+    size_t len  = 0;
+    pthread_mutex_lock(&lock);
+    if (!dirty) {
+        pthread_mutex_unlock(&lock);
+        pthread_mutex_unlock(&save_lock);
+        return 0;
+    }
+    FILE *mem = open_memstream(&text, &len);
+    if (mem != NULL) {
+        for (int b = 0; b < PREDICT_BUCKETS; b++)
+            for (Estimate *e = buckets[b]; e != NULL; e = e->next)
+                fprintf(mem, "%lld %ld %s\n", (long long)e->tau_ns, e->samples, e->key);
+        dirty = 0;
+    }
+    pthread_mutex_unlock(&lock);
+
+    int   rc = -1;
+    FILE *f  = NULL;
+    if (mem == NULL || fclose(mem) != 0) {
+        log_msg(LL_ERROR, LOG_NO_CLIENT, "error", "[PREDICT] open_memstream: %s", strerror(errno));
+    } else if ((f = fopen(tmp, "w")) == NULL) {
+        log_msg(LL_ERROR, LOG_NO_CLIENT, "error", "[PREDICT] fopen: %s", strerror(errno));
+    } else if (fwrite(text, 1, len, f) != len || fflush(f) != 0 || fsync(fileno(f)) < 0) {
+        log_msg(LL_ERROR, LOG_NO_CLIENT, "error", "[PREDICT] write: %s", strerror(errno));
+        fclose(f);
+        unlink(tmp);
+    } else if (fclose(f) != 0 || rename(tmp, save_path) < 0) {
+        log_msg(LL_ERROR, LOG_NO_CLIENT, "error", "[PREDICT] save: %s", strerror(errno));
+        unlink(tmp);
+    } else {
+        rc = 0;
+    }
+    free(text);
+    if (rc < 0) {
+        pthread_mutex_lock(&lock);
+        dirty = 1;  // try again at the next save
+        pthread_mutex_unlock(&lock);
+    }
+    pthread_mutex_unlock(&save_lock);
+    return rc;
+}
@@ -0,0 +1,43 @@
+// predict.h
+// Burst-time estimates for program commands, learned from their past runs.
+//
+// SRJF orders programs by their predicted burst. A fixed guess (the last
+// numeric argument, else DEFAULT_BURST) is only right for ./demo N, so each
+// finished program's measured running time is folded into an exponential
+// average, tau = PREDICT_ALPHA * t + (1 - PREDICT_ALPHA) * tau, kept under two
+// keys: the exact command text, and its shape (the program with each argument
+// reduced to its kind, e.g. "./sort -r * #" for "./sort -r in.txt 20").
+// When the last argument is a number the shape learns the time per unit of it,
+// and its prediction is scaled by the command's own last argument. A
+// prediction uses the exact text if it has run before, else the shape, else
+// the fixed guess. The table is saved to a file and read back at startup, so
+// the estimates survive restarts. All functions are thread-safe.
+
+#ifndef PREDICT_H
+#define PREDICT_H
+
+#include <stdint.h>
+
+#define PREDICT_ALPHA     0.5               // weight of the newest run
+#define PREDICT_BUCKETS   1024              // hash buckets of the estimate table
+#define PREDICT_MAX       8192              // keys learned before new ones are ignored
+#define PREDICT_FILE      "myshell-bursts.txt"  // default persistence file
+#define PREDICT_KEY_MAX   512               // longer commands are not learned
+
+// Loads saved estimates from path (a missing file is not an error) and saves
+// them there from now on; path NULL keeps them in memory only.
+// Call once from main before any thread uses the predictor.
+void predict_init(const char *path);
+
+// Predicted running time of command in nanoseconds; fallback_ns is used when
+// neither its text nor its shape has run before and it has no numeric last argument.
+int64_t predict_burst(const char *command, int64_t fallback_ns);
+
+// Folds one measured running time of command into its estimates.
+void predict_record(const char *command, int64_t ran_ns);
+
+// Writes the estimates to the file given to predict_init() if anything was
+// learned since the last save. Returns 0 on success or nothing to do, -1 on error.
+int predict_save(void);
+
+#endif /* PREDICT_H */
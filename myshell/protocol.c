@@ -0,0 +1,83 @@
+#include "protocol.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+void proto_encode_header(unsigned char *out, uint32_t length, uint32_t id, int32_t status) {
+    uint32_t fields[3] = { htonl(length), htonl(id), htonl((uint32_t)status) };
+    memcpy(out, fields, PROTO_HEADER_SIZE);
+}
+
+
+void proto_decode_header(const unsigned char *in, FrameHeader *h) {
+    uint32_t fields[3];
+    memcpy(fields, in, PROTO_HEADER_SIZE);  // memcpy: in may be unaligned
+    h->length = ntohl(fields[0]);
+    h->id     = ntohl(fields[1]);
+    h->status = (int32_t)ntohl(fields[2]);
+}
+
+
+// Sends all len bytes, retrying on short writes and EINTR. Returns 0 or -1.
+static int send_all(int fd, const void *buf, size_t len, int flags) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, flags | MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p   += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+
+// Reads exactly len bytes. Returns 1 on success, 0 on EOF before the first byte,
+// -1 on error or EOF part-way through.
+static int recv_all(int fd, void *buf, size_t len) {
+    char  *p   = buf;
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = recv(fd, p + got, len - got, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) return (got == 0) ? 0 : -1;
+        got += (size_t)n;
+    }
+    return 1;
+}
+
+
+// MSG_MORE on the header lets the kernel coalesce it with the payload into one segment.
+int proto_send_frame(int fd, uint32_t id, int32_t status, const void *payload, size_t len) {
+    unsigned char hdr[PROTO_HEADER_SIZE];
+    proto_encode_header(hdr, (uint32_t)len, id, status);
+    if (send_all(fd, hdr, sizeof(hdr), len > 0 ? MSG_MORE : 0) < 0) return -1;
+    if (len > 0 && send_all(fd, payload, len, 0) < 0) return -1;
+    return 0;
+}
+
+
+int proto_recv_frame(int fd, FrameHeader *h, char **payload) {
+    unsigned char hdr[PROTO_HEADER_SIZE];
+    int r = recv_all(fd, hdr, sizeof(hdr));
+    if (r <= 0) return r;
+
+    proto_decode_header(hdr, h);
+    if (h->length > PROTO_MAX_PAYLOAD) { errno = EPROTO; return -1; }
+
+    char *buf = malloc((size_t)h->length + 1);
+    if (!buf) return -1;
+    if (h->length > 0 && recv_all(fd, buf, h->length) != 1) { free(buf); return -1; }
+    buf[h->length] = '\0';
+    *payload = buf;
+    return 1;
+}
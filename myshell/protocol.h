@@ -0,0 +1,47 @@
+// protocol.h
+// Wire format shared by server.c and client.c.
+//
+// Every message in either direction is one frame:
+//   uint32 length   payload bytes that follow the header
+//   uint32 id       request id chosen by the client; echoed in every response frame
+//   int32  status   PROTO_* code below
+//   payload         length bytes (command text or command output; no NUL)
+// All header fields are in network byte order. Because each response names the
+// request it answers, a client may pipeline many commands without waiting.
+
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PROTO_HEADER_SIZE 12
+#define PROTO_MAX_PAYLOAD (64u * 1024u * 1024u)  // larger frames are treated as corrupt
+
+// frame status codes
+#define PROTO_REQUEST 0   // client → server: payload is one command
+#define PROTO_OK      1   // final response: command finished; payload is its output
+#define PROTO_ERROR   2   // final response: payload is an "Error: ..." message
+#define PROTO_OUTPUT  3   // partial response: more frames for this id follow
+
+typedef struct {
+    uint32_t length;
+    uint32_t id;
+    int32_t  status;
+} FrameHeader;
+
+// Serialises a header into PROTO_HEADER_SIZE bytes at out.
+void proto_encode_header(unsigned char *out, uint32_t length, uint32_t id, int32_t status);
+
+// Parses PROTO_HEADER_SIZE bytes at in.
+void proto_decode_header(const unsigned char *in, FrameHeader *h);
+
+// Sends one whole frame on a blocking socket. Returns 0 on success, -1 on error.
+int proto_send_frame(int fd, uint32_t id, int32_t status, const void *payload, size_t len);
+
+// Reads one whole frame from a blocking socket. On success stores a malloc'd,
+// NUL-terminated copy of the payload in *payload (caller frees) and returns 1.
+// Returns 0 on a clean EOF before any header byte, -1 on error or a corrupt frame.
+int proto_recv_frame(int fd, FrameHeader *h, char **payload);
+
+#endif /* PROTOCOL_H */
@@ -1,14 +1,50 @@
-// scheduler.c — Phase 4 SRJF + Round-Robin scheduler implementation.
+// scheduler.c — Phase 4 scheduler implementation (SRJF + Round-Robin by default).
 //
-// Shell commands (burst_time = -1) always run first and atomically.
-// Programs are scheduled by Shortest-Remaining-Job-First with FCFS tie-breaking.
-// Each program slice uses QUANTUM_FIRST (round 1) or QUANTUM_REST (rounds 2+).
-// A new program that is shorter than the running one triggers preemption via SIGSTOP.
-
+// Shell commands (burst_time = -1) never occupy a simulated CPU: they go to a FIFO
+// served by a bounded pool of q->nshell threads and run atomically there, so a
+// slow `find /` cannot hold up program slices or preemption.
+// Programs are scheduled by the policy chosen at startup (policy.c); by default
+// Shortest-Remaining-Job-First with FCFS tie-breaking.
+// Waiting tasks live in a binary min-heap ordered by the policy (for srjf by
+// (remaining, arrival)); free
+// slots form a free list and each client's tasks are chained in a per-client
+// index, so enqueue, dequeue and cancellation never scan the whole table.
+// The policy sizes each program slice (srjf: the round-1 or round-2+ quantum).
+// All times (bursts, quanta, arrivals, Gantt stamps) are CLOCK_MONOTONIC nanoseconds.
+// q->ncpus worker threads share the ready queue, so up to ncpus tasks run at once.
+// A new program may preempt a running one via SIGSTOP when no CPU is idle (srjf:
+// if it is shorter than the running program with the most remaining time).
+// A program's output pipe is handed to the client's reactor when it is spawned,
+// so output reaches the client while the program runs (see conn_stream()); the
+// final frame waits for its exit status, as a shell command's does.
+// Each client's index entry also keeps its account of program CPU time. With
+// fair share (-F) the next program comes from the client with the least CPU
+// time divided by its weight, so one client queueing dozens of programs gets
+// its share and no more; -m caps a client's live tasks and -M its programs
+// running at once.
+// After every slice the program's consumption is read from the kernel
+// (usage.c). By default a slice is charged against the burst by the time it
+// held the CPU, as ./demo expects; with -A cpu by the CPU time it actually used,
+// so a program blocked on I/O keeps its remaining time.
+// Every task's queue wait, turnaround and response time, and every slice and
+// preemption, are recorded in the metrics registry (metrics.c). State changes
+// are logged through log.c, which buffers them per thread, so no worker waits
+// on the terminal while it holds q->mutex.
+
+#define _GNU_SOURCE              // pipe2, eventfd, timerfd and syscall() on Linux
 #define _POSIX_C_SOURCE 200809L
 
 #include "scheduler.h"
+#include "policy.h"
 #include "shell.h"
+#include "spawn.h"
+#include "helper.h"
+#include "pcache.h"
+#include "predict.h"
+#include "conn.h"
+#include "protocol.h"
+#include "metrics.h"
+#include "log.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -17,110 +53,295 @@
 #include <signal.h>
 #include <sys/wait.h>
 #include <sys/types.h>
-#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
+#include <poll.h>
 #include <time.h>
 #include <errno.h>
-#include <limits.h>
+#include <fcntl.h>
+#include <stdint.h>
 
 // forward declarations for internal helpers
-static int  select_next_task(TaskQueue *q);
-static void record_history(TaskQueue *q, int client_num);
-static void run_shell_task(TaskQueue *q, int idx);
-static int  run_program_slice(TaskQueue *q, int idx);
-static int  fork_program(Task *t);
-static void send_program_output(int client_num, int client_fd, int pipe_read);
+static int  select_next_task(TaskQueue *q, SchedCpu *cpu);
+static void heap_push(TaskQueue *q, int idx);
+static int  heap_remove(TaskQueue *q, int pos);
+static int  pick_fair(TaskQueue *q, SchedClient *proposed, int pos);
+static SchedClient *client_lookup(TaskQueue *q, int client_num, int create);
+static int  client_may_run(const TaskQueue *q, const SchedClient *c);
+static void client_ready(TaskQueue *q, SchedClient *c, int delta);
+static void client_drop(TaskQueue *q, SchedClient *c);
+static int  slot_alloc(TaskQueue *q);
+static void slot_release(TaskQueue *q, int idx);
+static void record_history(TaskQueue *q, int client_num, int cpu);
+static void account_program(TaskQueue *q, const Task *t);
+static void run_shell_task(TaskQueue *q, Task *t, Helper *h);
+static int  run_program_slice(TaskQueue *q, SchedCpu *cpu, Task *t, int64_t quantum);
+static int  spawn_program(Task *t);
+static int  reap_program(Task *t, int *status);
+static void finish_stream(Task *t, int32_t status);
+static int  open_pidfd(pid_t pid);
+static void close_pidfd(Task *t);
+static void drain_fd(int fd);
+static void kick_cpu(TaskQueue *q, int cpu);
+static double ns_to_sec(int64_t ns);
+
+
+// Returns the current CLOCK_MONOTONIC time in nanoseconds.
+// Monotonic time is immune to wall-clock adjustments, so deltas are always valid.
+int64_t sched_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+
+// Fills cfg with the compiled-in defaults.
+void scheduler_default_config(SchedConfig *cfg) {
+    cfg->ncpus            = DEFAULT_CPUS;
+    cfg->quantum_first_ns = QUANTUM_FIRST_MS * NSEC_PER_MS;
+    cfg->quantum_rest_ns  = QUANTUM_REST_MS  * NSEC_PER_MS;
+    cfg->nshell           = DEFAULT_SHELL_WORKERS;
+    cfg->policy           = policy_default();
+    cfg->fair_share       = 0;
+    cfg->max_queued       = 0;             // unlimited
+    cfg->max_running      = 0;
+    cfg->account_cpu      = 0;             // charge slices by wall-clock time
+    cfg->nweights         = 0;
+}
 
 
 // Zero-initialises every slot, sets up the mutex and condvar, records start time.
-// Must be called once from main() before any threads start.
-void scheduler_init(TaskQueue *q) {
+// cfg->ncpus and cfg->nshell are clamped to [1, MAX_CPUS] and [1, MAX_SHELL_WORKERS]. Must be called once from main() before any threads start.
+void scheduler_init(TaskQueue *q, const SchedConfig *cfg) {
     memset(q, 0, sizeof(TaskQueue));   // task_id == 0 marks every slot as free
+    int ncpus = cfg->ncpus;
+    if (ncpus < 1)        ncpus = 1;
+    if (ncpus > MAX_CPUS) ncpus = MAX_CPUS;
+    q->ncpus            = ncpus;
+    q->quantum_first_ns = cfg->quantum_first_ns;
+    q->quantum_rest_ns  = cfg->quantum_rest_ns;
+    q->policy           = cfg->policy != NULL ? cfg->policy : policy_default();
+    q->fair_share       = cfg->fair_share;
+    q->max_queued       = cfg->max_queued  > 0 ? cfg->max_queued  : 0;
+    q->max_running      = cfg->max_running > 0 ? cfg->max_running : 0;
+    q->account_cpu      = cfg->account_cpu;
+    q->nweights         = cfg->nweights < MAX_CLIENT_WEIGHTS ? cfg->nweights : MAX_CLIENT_WEIGHTS;
+    memcpy(q->weights, cfg->weights, (size_t)q->nweights * sizeof(ClientWeight));
+    q->nshell           = cfg->nshell < 1 ? 1
+                        : cfg->nshell > MAX_SHELL_WORKERS ? MAX_SHELL_WORKERS : cfg->nshell;
+    q->shell_head       = -1;          // shell FIFO starts empty
+    q->shell_tail       = -1;
     q->next_task_id     = 1;           // IDs are 1-based; 0 means empty
-    q->last_run_task_id = -1;          // no task has run yet
-    q->preempt_flag     = 0;
-    q->start_time       = time(NULL);  // used for relative Gantt timestamps
+    q->start_ns         = sched_now_ns();  // used for relative Gantt timestamps
     q->hist_head        = NULL;
     q->hist_tail        = NULL;
+    slab_init(&q->tasks, sizeof(Task), TASK_SLAB_SIZE);  // grows on demand
+    str_arena_init(&q->strings);
+    for (int c = 0; c < ncpus; c++) {
+        q->cpus[c].id               = c;
+        q->cpus[c].current          = -1;  // idle
+        q->cpus[c].last_run_task_id = -1;  // no task has run yet
+        q->cpus[c].timer_fd         = -1;  // created by scheduler_start()
+        q->cpus[c].wake_fd          = -1;
+        q->cpus[c].q                = q;
+    }
     pthread_mutex_init(&q->mutex, NULL);
     pthread_cond_init(&q->has_task, NULL);
+    pthread_cond_init(&q->has_shell, NULL);
+}
+
+
+// Creates each CPU's quantum timerfd and preemption eventfd, then spawns one
+// detached worker thread per CPU running scheduler_run() and q->nshell threads
+// running scheduler_run_shell().
+// Returns 0 on success, -1 if any fd or thread could not be created.
+int scheduler_start(TaskQueue *q) {
+    for (int c = 0; c < q->ncpus; c++) {
+        q->cpus[c].timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        q->cpus[c].wake_fd  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (q->cpus[c].timer_fd < 0 || q->cpus[c].wake_fd < 0) {
+            log_msg(LL_ERROR, LOG_NO_CLIENT, "error", "[SCHEDULER] timerfd/eventfd: %s",
+                    strerror(errno));
+            return -1;
+        }
+    }
+    for (int c = 0; c < q->ncpus; c++) {
+        int rc = pthread_create(&q->cpus[c].thread, NULL, scheduler_run, &q->cpus[c]);
+        if (rc != 0) {
+            log_msg(LL_ERROR, LOG_NO_CLIENT, "error", "[SCHEDULER] pthread_create: %s", strerror(rc));
+            return -1;
+        }
+        pthread_detach(q->cpus[c].thread);  // workers run forever; no need to join them
+    }
+    for (int i = 0; i < q->nshell; i++) {
+        pthread_t th;
+        int       rc = pthread_create(&th, NULL, scheduler_run_shell, q);
+        if (rc != 0) {
+            log_msg(LL_ERROR, LOG_NO_CLIENT, "error", "[SCHEDULER] pthread_create shell: %s",
+                    strerror(rc));
+            return -1;
+        }
+        pthread_detach(th);
+    }
+    log_msg(LL_INFO, LOG_NO_CLIENT, "start",
+            "[SCHEDULER] %d shell worker(s) started, policy %s%s, %s time accounting",
+            q->nshell, q->policy->name, q->fair_share ? ", fair share" : "",
+            q->account_cpu ? "CPU" : "wall-clock");
+    return 0;
 }
 
 
 // Called by a client thread to enqueue a new command.
-// Finds a free slot, fills the Task descriptor, increments count, signals the
-// scheduler thread. Sets preempt_flag if the new program is shorter than the
-// currently running one. Returns the assigned task_id, or -1 if the queue is full.
-int scheduler_add_task(TaskQueue *q, int client_num, int client_fd,
-                       const char *command, int burst_time, int is_shell_cmd) {
+// Takes a slot off the free list, fills the Task descriptor, links it into the
+// client index and either the ready heap (programs) or the shell FIFO, and
+// signals one idle worker of the matching kind. If every CPU is
+// busy and the new program is shorter than a running one, flags that task for
+// preemption. Returns the task_id, SCHED_OVER_QUOTA if the client already has
+// q->max_queued live tasks, or -1 if the queue is full.
+int scheduler_add_task(TaskQueue *q, int client_num, uint32_t req_id,
+                       const char *command, int64_t burst_ns, int is_shell_cmd) {
     pthread_mutex_lock(&q->mutex);
 
-    // scan for a free slot (task_id == 0 means the slot is available)
-    int slot = -1;
-    for (int i = 0; i < MAX_TASKS; i++) {
-        if (q->tasks[i].task_id == 0) { slot = i; break; }
+    SchedClient *client = client_lookup(q, client_num, 1);
+    if (client != NULL && q->max_queued > 0 && client->ntasks >= q->max_queued) {
+        log_msg(LL_INFO, client_num, "rejected", "[%d]--- rejected (%d queued)",
+                client_num, client->ntasks);
+        pthread_mutex_unlock(&q->mutex);
+        metrics_add(MC_REJECTED, 1);
+        return SCHED_OVER_QUOTA;
     }
-    if (slot == -1) {
-        fprintf(stderr, "[SCHEDULER] Queue full — dropping command from client %d\n", client_num);
+
+    int   slot = (client != NULL) ? slot_alloc(q) : -1;
+    char *text = (slot >= 0) ? str_arena_dup(&q->strings, command) : NULL;
+    if (text == NULL) {
+        if (slot >= 0) slab_free(&q->tasks, slot);
+        log_msg(LL_ERROR, client_num, "error",
+                "[SCHEDULER] Out of memory — dropping command from client %d", client_num);
         pthread_mutex_unlock(&q->mutex);
         return -1;
     }
 
     // populate the new task descriptor
-    Task *t = &q->tasks[slot];
+    Task *t = TASK(q, slot);
     memset(t, 0, sizeof(Task));
     t->task_id        = q->next_task_id++;
     t->client_num     = client_num;
-    t->client_fd      = client_fd;
-    strncpy(t->command, command, BUFFER_SIZE - 1);
-    t->burst_time     = burst_time;
-    t->remaining_time = burst_time;  // remaining_time is decremented each slice
+    t->client         = client;
+    t->req_id         = req_id;
+    t->command        = text;
+    t->burst_ns       = burst_ns;
+    t->remaining_ns   = burst_ns;    // remaining_ns is decremented each slice
+    t->used_ns        = 0;
     t->round          = 1;           // first slice is always round 1
     t->is_shell_cmd   = is_shell_cmd;
     t->state          = TASK_WAITING;
-    t->arrival_time   = time(NULL);  // used for FCFS tie-breaking
-    t->pid            = -1;          // no child forked yet
-    t->pipe_read      = -1;          // no pipe open yet
+    t->arrival_ns     = sched_now_ns();  // used for FCFS tie-breaking
+    t->cpu            = -1;          // not running on any CPU yet
+    t->pid            = -1;          // no child spawned yet
+    t->helper_pid     = -1;
+    t->pidfd          = -1;
+    t->stream         = NULL;
     t->cancelled      = 0;
+    t->weight         = CFS_WEIGHT_DEFAULT * client->weight;
+
+    // link at the head of the client's task list, then queue it
+    t->client_prev = -1;
+    t->client_next = client->first_task;
+    if (client->first_task >= 0) TASK(q, client->first_task)->client_prev = slot;
+    client->first_task = slot;
+    client->ntasks++;
     q->count++;
+    if (is_shell_cmd) {
+        // shell commands skip the heap entirely: FIFO order, served by the shell pool
+        t->heap_pos   = -1;
+        t->shell_next = -1;
+        if (q->shell_tail >= 0) TASK(q, q->shell_tail)->shell_next = slot;
+        else                    q->shell_head                       = slot;
+        q->shell_tail = slot;
+        q->shell_ready++;
+    } else {
+        q->policy->enqueue(q, t, 1);
+        heap_push(q, slot);
+    }
 
-    printf("[%d]--- created (%d)\n", client_num, burst_time);
-    fflush(stdout);
-
-    // preemption check: if a shorter program arrives while another is running,
-    // set the flag so the scheduler stops the current child at its next poll
-    if (!is_shell_cmd) {
-        for (int i = 0; i < MAX_TASKS; i++) {
-            if (q->tasks[i].state == TASK_RUNNING && !q->tasks[i].is_shell_cmd) {
-                Task *running = &q->tasks[i];
-                if (burst_time < running->remaining_time)
-                    q->preempt_flag = 1;  // shorter job arrived; request preemption
-                break;
-            }
+    if (is_shell_cmd) log_msg(LL_INFO, client_num, "created", "[%d]--- created (-1)", client_num);
+    else              log_msg(LL_INFO, client_num, "created", "[%d]--- created (%.3f)",
+                              client_num, ns_to_sec(burst_ns));
+
+    // preemption check: an idle CPU will pick the new task up by itself; otherwise
+    // the policy decides whether the new program displaces the running one it
+    // ranks last (for srjf: the most remaining time, if the new one is shorter);
+    // with fair share only if the new program's client is not ahead of the
+    // victim's, and never for a client that may not run another program
+    if (!is_shell_cmd && q->running >= q->ncpus && client_may_run(q, client)) {
+        Task *victim = NULL;
+        for (int c = 0; c < q->ncpus; c++) {
+            if (q->cpus[c].current < 0) continue;
+            Task *r = TASK(q, q->cpus[c].current);
+            if (r->preempt) continue;
+            if (victim == NULL || q->policy->before(victim, r)) victim = r;
+        }
+        if (victim != NULL && q->policy->preempts(q, t, victim) &&
+            (!q->fair_share || client->vruntime_ns <= victim->client->vruntime_ns)) {
+            victim->preempt = 1;         // request preemption
+            kick_cpu(q, victim->cpu);    // wake that CPU out of its slice
         }
     }
 
-    pthread_cond_signal(&q->has_task);  // wake the scheduler thread if it is waiting
+    // wake one idle worker of the right kind if any is waiting
+    pthread_cond_signal(is_shell_cmd ? &q->has_shell : &q->has_task);
+    int task_id = t->task_id;
     pthread_mutex_unlock(&q->mutex);
-    return t->task_id;
+    metrics_add(MC_REQUESTS, 1);
+    return task_id;
 }
 
 
-// Called when a client disconnects.
-// Waiting tasks are dropped immediately; running tasks are killed via SIGKILL.
-// The scheduler thread sees cancelled == 1 and skips sending output on the closed fd.
+// Called when a client disconnects. Walks only this client's tasks via the index.
+// Waiting tasks are dropped immediately (killing a stopped child if one exists),
+// except queued shell commands, which are flagged and dropped by the shell worker
+// that dequeues them; running tasks are killed via SIGKILL, which wakes their CPU through the pidfd.
+// The worker thread sees cancelled == 1 and skips replying to the closed connection.
+// The client's index entry goes with its last task.
 void scheduler_remove_client(TaskQueue *q, int client_num) {
     pthread_mutex_lock(&q->mutex);
 
-    for (int i = 0; i < MAX_TASKS; i++) {
-        Task *t = &q->tasks[i];
-        if (t->task_id == 0 || t->client_num != client_num) continue;
-
-        if (t->state == TASK_WAITING) {
-            t->task_id = 0;  // mark slot free; no child process exists yet
+    SchedClient *client = client_lookup(q, client_num, 0);
+    if (client == NULL) {
+        pthread_mutex_unlock(&q->mutex);
+        return;
+    }
+    client->closed = 1;
+    int next = client->first_task;   // -1 if it owns no task
+    if (client->ntasks == 0) client_drop(q, client);
+    while (next >= 0) {
+        int   i = next;
+        Task *t = TASK(q, i);
+        next = t->client_next;  // read before slot_release() unlinks it
+
+        if (t->state == TASK_WAITING && t->is_shell_cmd) {
+            t->cancelled = 1;  // still linked in the shell FIFO; its worker drops it
+        } else if (t->state == TASK_WAITING) {
+            if (t->pid > 0) {
+                // preempted earlier: the stopped child would otherwise linger forever
+                kill(t->pid, SIGKILL);
+                waitpid(t->pid, NULL, 0);
+                t->pid = -1;
+            }
+            close_pidfd(t);
+            finish_stream(t, PROTO_ERROR);
+            heap_remove(q, t->heap_pos);
+            slot_release(q, i);
             q->count--;
+            metrics_add(MC_CANCELLED, 1);
         } else if (t->state == TASK_RUNNING) {
-            t->cancelled = 1;                        // tell scheduler thread to skip output
-            if (t->pid > 0) kill(t->pid, SIGKILL);  // kill the child immediately
+            t->cancelled = 1;  // tell the worker thread to skip output
+            // kill the child immediately; a shell command's whole process group,
+            // so the commands of its pipeline die with it
+            if (t->pid > 0) kill(t->is_shell_cmd ? -t->pid : t->pid, SIGKILL);
+            // a builtin has no process of its own: kill the helper running it
+            if (t->helper_pid > 0) kill(t->helper_pid, SIGKILL);
         }
     }
 
@@ -128,32 +349,137 @@ void scheduler_remove_client(TaskQueue *q, int client_num) {
 }
 
 
-// Prints the Gantt-chart scheduling history to stdout.
-// Format: 0)-P<client>-(<end_time>)-P<client>-(<end_time>)...
+// Logs the Gantt-chart scheduling history, one line per CPU.
+// Format: 0)-P<client>-(<end_sec>)-P<client>-(<end_sec>)... with millisecond precision.
+// With more than one CPU each line is prefixed with "CPU<n>: ". Then the program
+// CPU time of each client still connected (or still owning a task), in seconds,
+// then the kernel-measured consumption of all programs that completed, and the
+// parse-cache counters once any command has been looked up.
+// The summary is built in memory under q->mutex and logged as one message.
 // Called automatically whenever the queue drains to zero active tasks.
 void scheduler_print_summary(TaskQueue *q) {
+    char  *text = NULL;
+    size_t len  = 0;
+    FILE  *out  = open_memstream(&text, &len);
+    if (out == NULL) return;
+
     pthread_mutex_lock(&q->mutex);
-    printf("0)");
-    for (HistEntry *e = q->hist_head; e != NULL; e = e->next)
-        printf("-P%d-(%ld)", e->client_num, e->end_time);
-    printf("\n");
-    fflush(stdout);
+    for (int c = 0; c < q->ncpus; c++) {
+        if (q->ncpus > 1) fprintf(out, "CPU%d: ", c);
+        fprintf(out, "0)");
+        for (HistEntry *e = q->hist_head; e != NULL; e = e->next)
+            if (e->cpu == c) fprintf(out, "-P%d-(%.3f)", e->client_num, ns_to_sec(e->end_ns));
+        fprintf(out, "\n");
+    }
+    const char *sep = "CPU time by client: ";
+    for (int b = 0; b < CLIENT_BUCKETS; b++)
+        for (SchedClient *c = q->clients[b]; c != NULL; c = c->next) {
+            if (c->cpu_ns == 0) continue;
+            fprintf(out, "%sP%d %.3f", sep, c->client_num, ns_to_sec(c->cpu_ns));
+            sep = ", ";
+        }
+    if (sep[0] == ',') fprintf(out, "\n");
+    if (q->programs_done > 0) {
+        const Usage *u = &q->usage_total;
+        fprintf(out, "Programs: %d done, CPU %.3f s (user %.3f, sys %.3f) of %.3f s on CPUs (%.0f%%),"
+                " max RSS %ld KB, I/O %lld/%lld KB, disk %lld/%lld KB\n",
+                q->programs_done, ns_to_sec(u->cpu_ns), ns_to_sec(u->user_ns), ns_to_sec(u->sys_ns),
+                ns_to_sec(q->wall_total_ns),
+                q->wall_total_ns > 0 ? 100.0 * (double)u->cpu_ns / (double)q->wall_total_ns : 0.0,
+                u->max_rss_kb, (long long)(u->io_read / 1024), (long long)(u->io_write / 1024),
+                (long long)(u->disk_read / 1024), (long long)(u->disk_write / 1024));
+    }
+    PCacheStats pc;
+    pcache_stats(&pc);
+    if (pc.hits + pc.misses > 0)
+        fprintf(out, "Parse cache: %llu hits, %llu misses\n",
+                (unsigned long long)pc.hits, (unsigned long long)pc.misses);
     pthread_mutex_unlock(&q->mutex);
+    fclose(out);
+
+    if (len > 0 && text[len - 1] == '\n') text[--len] = '\0';
+    log_msg(LL_INFO, LOG_NO_CLIENT, "summary", "%s", text);
+    free(text);
+}
+
+
+// Writes the state that is read rather than counted: the ready heap and shell
+// FIFO depths, live tasks by state, busy CPUs and connected clients' CPU time,
+// all taken in one critical section so they agree, then the parse-cache counters.
+void scheduler_write_metrics(TaskQueue *q, FILE *out) {
+    pthread_mutex_lock(&q->mutex);
+    int waiting = q->ready + q->shell_ready;
+    fprintf(out, "# HELP myshell_queue_depth Tasks waiting to run.\n"
+                 "# TYPE myshell_queue_depth gauge\n"
+                 "myshell_queue_depth{queue=\"programs\"} %d\n"
+                 "myshell_queue_depth{queue=\"shell\"} %d\n",
+            q->ready, q->shell_ready);
+    fprintf(out, "# HELP myshell_tasks Live tasks by state.\n"
+                 "# TYPE myshell_tasks gauge\n"
+                 "myshell_tasks{state=\"waiting\"} %d\n"
+                 "myshell_tasks{state=\"running\"} %d\n",
+            waiting, q->count - waiting);
+    fprintf(out, "# HELP myshell_cpus_busy Simulated CPUs running a program.\n"
+                 "# TYPE myshell_cpus_busy gauge\n"
+                 "myshell_cpus_busy %d\n"
+                 "# HELP myshell_cpus Simulated CPUs.\n"
+                 "# TYPE myshell_cpus gauge\n"
+                 "myshell_cpus %d\n",
+            q->running, q->ncpus);
+    fprintf(out, "# HELP myshell_client_cpu_seconds Program running time charged to each client.\n"
+                 "# TYPE myshell_client_cpu_seconds gauge\n");
+    for (int b = 0; b < CLIENT_BUCKETS; b++)
+        for (SchedClient *c = q->clients[b]; c != NULL; c = c->next)
+            fprintf(out, "myshell_client_cpu_seconds{client=\"%d\"} %.3f\n",
+                    c->client_num, ns_to_sec(c->cpu_ns));
+    pthread_mutex_unlock(&q->mutex);
+
+    PCacheStats pc;
+    pcache_stats(&pc);
+    fprintf(out, "# HELP myshell_parse_cache_hits_total Commands answered from the parse cache.\n"
+                 "# TYPE myshell_parse_cache_hits_total counter\n"
+                 "myshell_parse_cache_hits_total %llu\n"
+                 "# HELP myshell_parse_cache_misses_total Commands that had to be parsed.\n"
+                 "# TYPE myshell_parse_cache_misses_total counter\n"
+                 "myshell_parse_cache_misses_total %llu\n",
+            (unsigned long long)pc.hits, (unsigned long long)pc.misses);
 }
 
 
 // Destroys synchronisation objects and frees the history linked list.
-// Call only after the scheduler thread has exited.
+// Call only after the worker threads have exited.
 void scheduler_cleanup(TaskQueue *q) {
     pthread_mutex_lock(&q->mutex);
 
-    // kill any surviving child processes and close their pipes
-    for (int i = 0; i < MAX_TASKS; i++) {
-        Task *t = &q->tasks[i];
+    // kill any surviving child processes
+    for (int i = 0; i < slab_capacity(&q->tasks); i++) {
+        Task *t = TASK(q, i);
+        if (t->task_id == 0) continue;  // free slot
         if (t->pid > 0) { kill(t->pid, SIGKILL); waitpid(t->pid, NULL, 0); }
-        if (t->pipe_read >= 0) { close(t->pipe_read); t->pipe_read = -1; }
+        close_pidfd(t);
+        finish_stream(t, PROTO_ERROR);
+    }
+
+    // close each CPU's timer and preemption fds
+    for (int c = 0; c < q->ncpus; c++) {
+        if (q->cpus[c].timer_fd >= 0) close(q->cpus[c].timer_fd);
+        if (q->cpus[c].wake_fd  >= 0) close(q->cpus[c].wake_fd);
     }
 
+    // free the per-client index
+    for (int b = 0; b < CLIENT_BUCKETS; b++) {
+        SchedClient *c = q->clients[b];
+        while (c) { SchedClient *next = c->next; free(c); c = next; }
+        q->clients[b] = NULL;
+    }
+
+    // release the task pool, command text and ready heap
+    slab_destroy(&q->tasks);
+    str_arena_destroy(&q->strings);
+    free(q->heap);
+    q->heap     = NULL;
+    q->heap_cap = 0;
+
     // free the Gantt history linked list
     HistEntry *e = q->hist_head;
     while (e) { HistEntry *next = e->next; free(e); e = next; }
@@ -162,98 +488,102 @@ void scheduler_cleanup(TaskQueue *q) {
     pthread_mutex_unlock(&q->mutex);
     pthread_mutex_destroy(&q->mutex);
     pthread_cond_destroy(&q->has_task);
+    pthread_cond_destroy(&q->has_shell);
 }
 
 
-// Main scheduling loop — runs in its own dedicated thread (the single simulated CPU).
-// Waits for tasks to arrive, picks the best one, executes it for one slice,
-// then either requeues it (program, not done) or reclaims its slot (done/shell).
+// Main scheduling loop — one instance per simulated CPU (worker thread).
+// Waits for a ready program, picks the best one, executes it for one slice,
+// then either requeues it (not done) or reclaims its slot (done).
 void *scheduler_run(void *arg) {
-    TaskQueue *q = (TaskQueue *)arg;
+    SchedCpu  *cpu = (SchedCpu *)arg;
+    TaskQueue *q   = cpu->q;
 
-    printf("[SCHEDULER] Scheduler thread started\n");
-    fflush(stdout);
+    log_msg(LL_INFO, LOG_NO_CLIENT, "start", "[SCHEDULER] CPU %d started", cpu->id);
 
     while (1) {
         pthread_mutex_lock(&q->mutex);
 
-        // block until at least one task is in the queue
-        while (q->count == 0)
+        // block until a waiting program may run: there is none, or every
+        // client that has one is at its -M limit
+        int idx;
+        while ((idx = select_next_task(q, cpu)) < 0)
             pthread_cond_wait(&q->has_task, &q->mutex);
 
-        // pick the best waiting task (SRJF + FCFS + no-consecutive rule)
-        int idx = select_next_task(q);
-        if (idx == -1) {
-            // count > 0 but no WAITING task found — defensive guard against races
-            pthread_mutex_unlock(&q->mutex);
-            continue;
-        }
-
-        Task *t  = &q->tasks[idx];
-        t->state = TASK_RUNNING;
-        q->preempt_flag = 0;  // clear any stale preemption request before running
+        Task   *t       = TASK(q, idx);
+        int64_t quantum = q->policy->quantum(q, t);
+        int64_t used    = t->used_ns;
+        int     first   = (t->started_ns == 0);
+        int     changed = (cpu->last_run_task_id != t->task_id);
+        if (first) t->started_ns = sched_now_ns();
+        t->state   = TASK_RUNNING;
+        t->cpu     = cpu->id;
+        t->preempt = 0;  // clear any stale preemption request before running
+        cpu->current = idx;
+        q->running++;
+        t->client->running++;
 
         pthread_mutex_unlock(&q->mutex);
 
-        if (t->is_shell_cmd) {
-            // shell commands run atomically in one shot; they are never requeued
-            run_shell_task(q, idx);
+        if (first)    metrics_observe(MH_RESPONSE, METRIC_PROGRAM, t->started_ns - t->arrival_ns);
+        if (changed)  metrics_add(MC_CPU_SWITCHES, 1);
+        metrics_add(MC_SLICES, 1);
 
-            pthread_mutex_lock(&q->mutex);
-            record_history(q, t->client_num);  // log this slice in the Gantt history
-            q->last_run_task_id = t->task_id;
-            t->task_id = 0;  // reclaim the slot
+        // program tasks run for one quantum then may be requeued
+        int completed = run_program_slice(q, cpu, t, quantum);
+
+        pthread_mutex_lock(&q->mutex);
+        int preempted = t->preempt;
+        used = t->used_ns - used;
+        record_history(q, t->client_num, cpu->id);
+        cpu->last_run_task_id = t->task_id;
+        cpu->current          = -1;
+        t->preempt = 0;
+        t->cpu     = -1;
+        q->running--;
+        t->client->running--;
+        t->client->cpu_ns      += used;   // charge the slice to its client
+        t->client->vruntime_ns += used / t->client->weight;
+        if (q->max_running > 0 && t->client->ready > 0)
+            pthread_cond_signal(&q->has_task);  // its waiting programs may run again
+
+        if (t->cancelled) {
+            // client disconnected mid-run; the reactor drops the pipe at EOF
+            if (completed) account_program(q, t);
+            else           metrics_add(MC_CANCELLED, 1);
+            if (t->pid > 0) { waitpid(t->pid, NULL, WNOHANG); t->pid = -1; }
+            close_pidfd(t);
+            finish_stream(t, PROTO_ERROR);
+            slot_release(q, idx);
             q->count--;
-            int empty = (q->count == 0);
-            pthread_mutex_unlock(&q->mutex);
 
-            if (empty) scheduler_print_summary(q);  // print summary when queue drains
+        } else if (completed) {
+            // task finished: its output has been streamed, and run_program_slice()
+            // gave the stream its exit status; the reactor sends the final
+            // frame once the pipe reaches EOF
+            log_msg(LL_INFO, t->client_num, "ended", "[%d]--- ended (0)", t->client_num);
+            account_program(q, t);
+            slot_release(q, idx);
+            q->count--;
 
         } else {
-            // program tasks run for one quantum then may be requeued
-            int completed = run_program_slice(q, idx);
-
-            pthread_mutex_lock(&q->mutex);
-            record_history(q, t->client_num);
-            q->last_run_task_id = t->task_id;
-            q->preempt_flag     = 0;
-
-            if (t->cancelled) {
-                // client disconnected mid-run; discard without sending output
-                if (t->pid > 0)        { waitpid(t->pid, NULL, WNOHANG); t->pid = -1; }
-                if (t->pipe_read >= 0) { close(t->pipe_read); t->pipe_read = -1; }
-                t->task_id = 0;
-                q->count--;
-
-            } else if (completed) {
-                // task finished: send its accumulated output then reclaim slot
-                printf("[%d]--- ended (0)\n", t->client_num);
-                fflush(stdout);
-                // copy fields we need before releasing the mutex (t may be reused after unlock)
-                int cfd  = t->client_fd;
-                int cnum = t->client_num;
-                int pfd  = t->pipe_read;
-                t->pipe_read = -1;
-                t->task_id   = 0;
-                q->count--;
-                int empty = (q->count == 0);
-                pthread_mutex_unlock(&q->mutex);  // unlock before doing I/O
-
-                send_program_output(cnum, cfd, pfd);
-                if (empty) scheduler_print_summary(q);
-                continue;  // already unlocked above; skip the unlock at the bottom
-
-            } else {
-                // quantum expired or preempted: put the task back in the ready queue
-                printf("[%d]--- waiting (%d)\n", t->client_num, t->remaining_time);
-                fflush(stdout);
-                t->state = TASK_WAITING;
-                t->round++;  // increment round so the next slice uses QUANTUM_REST
-            }
+            // quantum expired or preempted: put the task back in the ready queue
+            log_msg(LL_INFO, t->client_num, "waiting", "[%d]--- waiting (%.3f)",
+                    t->client_num, ns_to_sec(t->remaining_ns));
+            if (preempted) metrics_add(MC_PREEMPTIONS, 1);
+            t->state = TASK_WAITING;
+            t->round++;  // increment round so the next slice uses the longer quantum
+            q->policy->on_slice_end(q, t, used, !preempted);
+            q->policy->enqueue(q, t, 0);
+            heap_push(q, idx);
+            pthread_cond_signal(&q->has_task);  // an idle CPU may take it right away
+        }
 
-            int empty = (q->count == 0);
-            pthread_mutex_unlock(&q->mutex);
-            if (empty) scheduler_print_summary(q);
+        int empty = (q->count == 0);
+        pthread_mutex_unlock(&q->mutex);
+        if (empty) {
+            scheduler_print_summary(q);
+            predict_save();  // persist what this run of programs taught the predictor
         }
     }
 
@@ -261,51 +591,310 @@ void *scheduler_run(void *arg) {
 }
 
 
-// Picks the best WAITING task using SRJF with FCFS tie-breaking.
-// Skips the last-run task unless it is the only one available (avoids starvation
-// of other clients by running the same task twice in a row).
-// Must be called with q->mutex held. Returns slot index, or -1 if none found.
-static int select_next_task(TaskQueue *q) {
-    int    best_idx       = -1;
-    int    best_remaining = INT_MAX;  // lower remaining_time wins (SRJF)
-    time_t best_arrival   = 0;       // earlier arrival wins ties (FCFS)
+// Shell-command worker loop — q->nshell instances. Takes shell commands off the
+// FIFO in arrival order and runs each to completion. Shell commands are not
+// simulated-CPU work, so they leave no entry in the per-CPU Gantt history.
+void *scheduler_run_shell(void *arg) {
+    TaskQueue *q      = (TaskQueue *)arg;
+    Helper     helper = { -1, -1 };
 
-    // first pass: prefer any task other than the one that just ran
-    for (int i = 0; i < MAX_TASKS; i++) {
-        Task *t = &q->tasks[i];
-        if (t->task_id == 0 || t->state != TASK_WAITING) continue;
-        if (t->task_id == q->last_run_task_id && q->count > 1) continue;  // skip last-run if alternatives exist
+    // commands run in-process (shell_start()) while no helper is available
+    helper_start(&helper);
 
-        if (t->remaining_time < best_remaining ||
-            (t->remaining_time == best_remaining && t->arrival_time < best_arrival)) {
-            best_remaining = t->remaining_time;
-            best_arrival   = t->arrival_time;
-            best_idx       = i;
+    while (1) {
+        pthread_mutex_lock(&q->mutex);
+        while (q->shell_ready == 0)
+            pthread_cond_wait(&q->has_shell, &q->mutex);
+
+        int   idx = q->shell_head;
+        Task *t   = TASK(q, idx);
+        q->shell_head = t->shell_next;
+        if (q->shell_head < 0) q->shell_tail = -1;
+        q->shell_ready--;
+
+        if (!t->cancelled) {
+            t->state      = TASK_RUNNING;
+            t->started_ns = sched_now_ns();
+            pthread_mutex_unlock(&q->mutex);
+            // a shell command waits only once, in the FIFO, and then runs to the end
+            metrics_observe(MH_RESPONSE,   METRIC_SHELL, t->started_ns - t->arrival_ns);
+            metrics_observe(MH_QUEUE_WAIT, METRIC_SHELL, t->started_ns - t->arrival_ns);
+            run_shell_task(q, t, &helper);
+            metrics_observe(MH_TURNAROUND, METRIC_SHELL, sched_now_ns() - t->arrival_ns);
+            metrics_add(MC_SHELL_DONE, 1);
+            pthread_mutex_lock(&q->mutex);
+        } else {
+            metrics_add(MC_CANCELLED, 1);
         }
+
+        slot_release(q, idx);  // reclaim the slot
+        q->count--;
+        int empty = (q->count == 0);
+        pthread_mutex_unlock(&q->mutex);
+
+        if (empty) scheduler_print_summary(q);  // print summary when queue drains
+    }
+    return NULL;
+}
+
+
+// Dequeues the WAITING program to run next on cpu. The policy proposes one (for
+// srjf: SRJF with FCFS tie-breaking and the no-consecutive rule); pick_fair()
+// overrides it when another client is further behind on its share or the
+// proposal's client is at its -M limit.
+// Must be called with q->mutex held. Returns the slot index, or -1 if no
+// waiting program may run.
+static int select_next_task(TaskQueue *q, SchedCpu *cpu) {
+    if (q->ready == 0) return -1;
+    int          pos = q->policy->pick_next(q, cpu);
+    SchedClient *c   = TASK(q, q->heap[pos])->client;
+    if (!client_may_run(q, c) || (q->fair_share && q->ready_clients > 1)) {
+        if ((pos = pick_fair(q, c, pos)) < 0) return -1;
+        c = TASK(q, q->heap[pos])->client;
     }
+    if (c->vruntime_ns > q->fair_floor_ns) q->fair_floor_ns = c->vruntime_ns;
+    return heap_remove(q, pos);
+}
 
-    // second pass: if every waiting task was the last-run one, select it anyway
-    if (best_idx == -1) {
-        for (int i = 0; i < MAX_TASKS; i++) {
-            if (q->tasks[i].task_id != 0 && q->tasks[i].state == TASK_WAITING) {
-                best_idx = i;
-                break;
-            }
+
+// Returns the heap position of the program to run instead of the policy's
+// proposal at pos, which belongs to client proposed. With fair share: the
+// client that may run with the least vruntime (proposed on a tie), then the
+// best of its waiting programs by the policy's order; this walks the client
+// index, O(CLIENT_BUCKETS + clients), once per slice. Without: the best
+// program in the heap whose client may run. Returns -1 if every client with a
+// waiting program is at its -M limit.
+static int pick_fair(TaskQueue *q, SchedClient *proposed, int pos) {
+    if (!q->fair_share) {
+        int best = -1;
+        for (int i = 0; i < q->ready; i++) {
+            Task *t = TASK(q, q->heap[i]);
+            if (client_may_run(q, t->client) &&
+                (best < 0 || q->policy->before(t, TASK(q, q->heap[best])))) best = i;
         }
+        return best;
+    }
+
+    SchedClient *least = client_may_run(q, proposed) ? proposed : NULL;
+    for (int b = 0; b < CLIENT_BUCKETS; b++)
+        for (SchedClient *c = q->clients[b]; c != NULL; c = c->next)
+            if (c->ready > 0 && client_may_run(q, c) &&
+                (least == NULL || c->vruntime_ns < least->vruntime_ns)) least = c;
+    if (least == NULL)     return -1;
+    if (least == proposed) return pos;
+
+    Task *best = NULL;
+    for (int i = least->first_task; i >= 0; i = TASK(q, i)->client_next) {
+        Task *t = TASK(q, i);
+        if (t->heap_pos >= 0 && (best == NULL || q->policy->before(t, best))) best = t;
+    }
+    return best->heap_pos;
+}
+
+
+// Swaps two heap positions and keeps each task's heap_pos in sync.
+static void heap_swap(TaskQueue *q, int i, int j) {
+    int tmp = q->heap[i];
+    q->heap[i] = q->heap[j];
+    q->heap[j] = tmp;
+    TASK(q, q->heap[i])->heap_pos = i;
+    TASK(q, q->heap[j])->heap_pos = j;
+}
+
+
+// Moves the entry at pos towards the root until its parent runs before it.
+static void heap_sift_up(TaskQueue *q, int pos) {
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+        if (!q->policy->before(TASK(q, q->heap[pos]), TASK(q, q->heap[parent]))) break;
+        heap_swap(q, pos, parent);
+        pos = parent;
+    }
+}
+
+
+// Moves the entry at pos towards the leaves until both children run after it.
+static void heap_sift_down(TaskQueue *q, int pos) {
+    while (1) {
+        int best  = pos;
+        int left  = 2 * pos + 1;
+        int right = left + 1;
+        if (left  < q->ready && q->policy->before(TASK(q, q->heap[left]),  TASK(q, q->heap[best]))) best = left;
+        if (right < q->ready && q->policy->before(TASK(q, q->heap[right]), TASK(q, q->heap[best]))) best = right;
+        if (best == pos) break;
+        heap_swap(q, pos, best);
+        pos = best;
+    }
+}
+
+
+// Inserts slot idx into the ready heap in O(log n); q->ready is the heap size.
+static void heap_push(TaskQueue *q, int idx) {
+    int pos = q->ready++;
+    q->heap[pos]           = idx;
+    TASK(q, idx)->heap_pos = pos;
+    heap_sift_up(q, pos);
+    client_ready(q, TASK(q, idx)->client, +1);
+}
+
+
+// Rebuilds the heap bottom-up in O(n).
+void sched_reorder(TaskQueue *q) {
+    for (int pos = q->ready / 2 - 1; pos >= 0; pos--)
+        heap_sift_down(q, pos);
+}
+
+
+// Removes the entry at heap position pos in O(log n) and returns its slot.
+static int heap_remove(TaskQueue *q, int pos) {
+    int idx  = q->heap[pos];
+    int last = --q->ready;
+    if (pos != last) {
+        heap_swap(q, pos, last);
+        heap_sift_down(q, pos);  // the moved entry may belong lower...
+        heap_sift_up(q, pos);    // ...or higher than the removed one
+    }
+    TASK(q, idx)->heap_pos = -1;
+    client_ready(q, TASK(q, idx)->client, -1);
+    return idx;
+}
+
+
+// Finds the index entry for client_num, creating it when create is set.
+// Returns NULL if absent (or if allocation fails).
+static SchedClient *client_lookup(TaskQueue *q, int client_num, int create) {
+    SchedClient **bucket = &q->clients[(unsigned)client_num % CLIENT_BUCKETS];
+    for (SchedClient *c = *bucket; c != NULL; c = c->next)
+        if (c->client_num == client_num) return c;
+    if (!create) return NULL;
+
+    SchedClient *c = malloc(sizeof(SchedClient));
+    if (!c) return NULL;
+    c->client_num  = client_num;
+    c->first_task  = -1;
+    c->ntasks      = 0;
+    c->ready       = 0;
+    c->running     = 0;
+    c->weight      = 1;
+    c->closed      = 0;
+    c->cpu_ns      = 0;
+    c->vruntime_ns = q->fair_floor_ns;  // level with the clients already here
+    for (int i = 0; i < q->nweights; i++)
+        if (q->weights[i].client_num == client_num) c->weight = q->weights[i].weight;
+    c->next        = *bucket;
+    *bucket        = c;
+    return c;
+}
+
+
+// Returns 1 unless c already has q->max_running programs on a CPU.
+static int client_may_run(const TaskQueue *q, const SchedClient *c) {
+    return q->max_running == 0 || c->running < q->max_running;
+}
+
+
+// Counts a program of c entering (delta +1) or leaving (-1) the ready heap.
+// A client that becomes ready again starts no lower than fair_floor_ns, so
+// time it spent idle is not banked as credit against the clients that kept
+// the CPUs busy meanwhile.
+static void client_ready(TaskQueue *q, SchedClient *c, int delta) {
+    if (delta > 0 && c->ready++ == 0) {
+        q->ready_clients++;
+        if (c->vruntime_ns < q->fair_floor_ns) c->vruntime_ns = q->fair_floor_ns;
+    } else if (delta < 0 && --c->ready == 0) {
+        q->ready_clients--;
     }
+}
+
+
+// Unlinks slot idx from its client's task list; frees the entry once a
+// disconnected client owns no more tasks.
+static void client_unlink(TaskQueue *q, int idx) {
+    Task        *t = TASK(q, idx);
+    SchedClient *c = t->client;
+
+    if (t->client_prev >= 0) TASK(q, t->client_prev)->client_next = t->client_next;
+    else                     c->first_task = t->client_next;
+    if (t->client_next >= 0) TASK(q, t->client_next)->client_prev = t->client_prev;
+    t->client_prev = t->client_next = -1;
+
+    if (--c->ntasks == 0 && c->closed) client_drop(q, c);
+}
 
-    return best_idx;
+
+// Removes an index entry that owns no tasks from its bucket and frees it.
+static void client_drop(TaskQueue *q, SchedClient *c) {
+    SchedClient **link = &q->clients[(unsigned)c->client_num % CLIENT_BUCKETS];
+    while (*link != c) link = &(*link)->next;
+    *link = c->next;
+    free(c);
+}
+
+
+// Takes a descriptor from the task pool (recycling freed ones first, growing by
+// a slab when none is free) and makes sure the ready heap can hold every slot.
+// Returns -1 if memory is exhausted.
+static int slot_alloc(TaskQueue *q) {
+    int idx = slab_alloc(&q->tasks);
+    if (idx < 0) return -1;
+
+    int need = slab_capacity(&q->tasks);
+    if (q->heap_cap < need) {
+        int *heap = realloc(q->heap, (size_t)need * sizeof(int));
+        if (!heap) { slab_free(&q->tasks, idx); return -1; }
+        q->heap     = heap;
+        q->heap_cap = need;
+    }
+    return idx;
+}
+
+
+// Reclaims slot idx: removes it from the client index, releases its command
+// text and returns the descriptor to the pool.
+static void slot_release(TaskQueue *q, int idx) {
+    Task *t = TASK(q, idx);
+    client_unlink(q, idx);
+    str_arena_free(&q->strings, t->command);
+    t->command = NULL;
+    t->task_id = 0;
+    t->state   = TASK_EMPTY;
+    slab_free(&q->tasks, idx);
+}
+
+
+// Prints the consumption of a program that has been reaped and adds it to
+// the totals of the summary and to the metrics. Must be called with q->mutex held.
+static void account_program(TaskQueue *q, const Task *t) {
+    const Usage *u = &t->usage;
+    log_msg(LL_INFO, t->client_num, "usage",
+            "[%d]--- usage: CPU %.3f s (user %.3f, sys %.3f) in %.3f s, max RSS %ld KB,"
+            " %ld+%ld context switches, I/O %lld/%lld KB, disk %lld/%lld KB",
+            t->client_num, ns_to_sec(u->cpu_ns), ns_to_sec(u->user_ns), ns_to_sec(u->sys_ns),
+            ns_to_sec(t->wall_ns), u->max_rss_kb, u->vol_csw, u->invol_csw,
+            (long long)(u->io_read / 1024), (long long)(u->io_write / 1024),
+            (long long)(u->disk_read / 1024), (long long)(u->disk_write / 1024));
+    usage_add(&q->usage_total, u);
+    q->wall_total_ns += t->wall_ns;
+    q->programs_done++;
+
+    int64_t turnaround = sched_now_ns() - t->arrival_ns;
+    metrics_observe(MH_TURNAROUND, METRIC_PROGRAM, turnaround);
+    metrics_observe(MH_QUEUE_WAIT, METRIC_PROGRAM, turnaround - t->wall_ns);
+    metrics_add(MC_PROGRAMS_DONE, 1);
+    metrics_add(MC_CSW_VOLUNTARY,   (uint64_t)u->vol_csw);
+    metrics_add(MC_CSW_INVOLUNTARY, (uint64_t)u->invol_csw);
 }
 
 
 // Appends one entry to the Gantt-chart history linked list.
-// end_time is wall-clock seconds elapsed since scheduler_init().
+// end_ns is monotonic nanoseconds elapsed since scheduler_init().
 // Must be called with q->mutex held.
-static void record_history(TaskQueue *q, int client_num) {
+static void record_history(TaskQueue *q, int client_num, int cpu) {
     HistEntry *e = malloc(sizeof(HistEntry));
     if (!e) return;
     e->client_num = client_num;
-    e->end_time   = (long)(time(NULL) - q->start_time);  // relative timestamp
+    e->cpu        = cpu;
+    e->end_ns     = sched_now_ns() - q->start_ns;  // relative timestamp
     e->next       = NULL;
     if (q->hist_tail) q->hist_tail->next = e;  // append to tail
     else              q->hist_head       = e;   // first entry
@@ -313,173 +902,319 @@ static void record_history(TaskQueue *q, int client_num) {
 }
 
 
-// Runs a shell command synchronously using execute_command() and sends the
-// output directly to the client socket. Never preempted; runs to completion.
-// Called without q->mutex held.
-static void run_shell_task(TaskQueue *q, int idx) {
-    Task *t = &q->tasks[idx];
-    (void)q;  // q not used directly; avoid compiler warning
+// Runs a shell command synchronously and streams its output to the client.
+// The command goes to this worker's helper process (helper.c), which parses it
+// and spawns its processes straight onto the output pipe; if no helper can be
+// started it is run from this process with shell_start(). The pipe is handed
+// to the client's reactor as a held stream, which splices the output to the
+// socket as it is produced; this thread only waits for the command to finish
+// and then supplies the final status (PROTO_ERROR on a non-zero exit).
+// The pipeline's process group is published in t->pid, and the helper's pid in
+// t->helper_pid while it runs a builtin itself, so scheduler_remove_client()
+// can kill them; both are cleared before the group leader or the helper is
+// reaped, so a recycled pid is never signalled. (A builtin run by the fallback
+// path runs on this thread and ends only when its input or output does.)
+// Called without q->mutex held from a shell worker; t stays valid (slabs never move).
+static void run_shell_task(TaskQueue *q, Task *t, Helper *h) {
+    log_msg(LL_INFO, t->client_num, "started", "[%d]--- started (-1)", t->client_num);
+
+    int   fd;
+    pid_t pgid;
+    Job   job;
+    int   via_helper = 0;
+    int   in_helper  = 0;
+    int   rc;
+
+    if (h->sock < 0) helper_start(h);  // replace a helper that died
+    if (h->sock >= 0 && helper_begin(h, t->command, &fd, &pgid, &in_helper) == 0) {
+        via_helper = 1;
+        rc         = 0;
+    } else {
+        rc   = shell_start(t->command, &fd, &job);
+        pgid = job.pgid;
+    }
 
-    printf("[%d]--- started (-1)\n", t->client_num);
-    fflush(stdout);
+    if (rc < 0) {
+        const char *err = "Error: fork failed\n";
+        conn_reply(t->client_num, t->req_id, PROTO_ERROR, err, strlen(err));
+    } else {
+        pthread_mutex_lock(&q->mutex);
+        t->pid        = pgid;
+        t->helper_pid = in_helper ? h->pid : -1;
+        if (t->cancelled) {
+            // client left while we were spawning
+            if (pgid > 0)          kill(-pgid, SIGKILL);
+            if (t->helper_pid > 0) kill(t->helper_pid, SIGKILL);
+        }
+        pthread_mutex_unlock(&q->mutex);
 
-    char *output = execute_command(t->command);  // run the command, capture its output
+        OutStream *s = conn_stream(t->client_num, t->req_id, fd, 1);
+        if (s == NULL) close(fd);  // client already gone: the commands' writes fail with EPIPE
 
-    if (output == NULL || strstr(output, "Error:") != NULL) {
-        // command failed or was not found: send the error string to the client
-        const char *err = (output != NULL) ? output : "Error: Command not found\n";
-        send(t->client_fd, err, strlen(err), 0);
-    } else if (strlen(output) == 0) {
-        // command succeeded but produced no output (e.g., mkdir): send a blank line
-        send(t->client_fd, "\n", 1, 0);
-    } else {
-        ssize_t n = send(t->client_fd, output, strlen(output), 0);
-        printf("[%d]<<< %zd bytes sent\n", t->client_num, n);
-        fflush(stdout);
+        // the group leader stays unreaped until t->pid is cleared
+        int status = via_helper ? helper_end(h) : pipeline_wait(&job);
+        pthread_mutex_lock(&q->mutex);
+        t->pid        = -1;
+        t->helper_pid = -1;
+        pthread_mutex_unlock(&q->mutex);
+        if (!via_helper)     pipeline_release(&job);
+        else if (status < 0) helper_stop(h);  // it died; a new one starts with the next command
+
+        if (s != NULL) conn_stream_finish(s, status == 0 ? PROTO_OK : PROTO_ERROR);
     }
 
-    free(output);
-    printf("[%d]--- ended (-1)\n", t->client_num);
-    fflush(stdout);
+    log_msg(LL_INFO, t->client_num, "ended", "[%d]--- ended (-1)", t->client_num);
 }
 
 
-// Forks the child process to execute t->command with stdout and stderr
-// redirected into a new pipe. The read end is saved in t->pipe_read and
-// survives across SIGSTOP/SIGCONT cycles so output accumulates until the child exits.
-// Returns 0 on success, -1 on error.
-static int fork_program(Task *t) {
-    int pipefd[2];
-    if (pipe(pipefd) < 0) { perror("[SCHEDULER] pipe"); return -1; }
+// Reaps the program of t if it has exited, storing its wait status in *status
+// and its final consumption in t->usage: the I/O counters are read from /proc
+// while it is still a zombie, the rest comes from wait4()'s rusage.
+// Returns 1 if it was reaped, 0 if it is still running.
+static int reap_program(Task *t, int *status) {
+    siginfo_t info;
+    info.si_pid = 0;
+    if (waitid(P_PID, (id_t)t->pid, &info, WEXITED | WNOHANG | WNOWAIT) < 0 || info.si_pid != t->pid)
+        return 0;
+    usage_read(t->pid, &t->usage);
+
+    struct rusage ru;
+    if (wait4(t->pid, status, 0, &ru) != t->pid) return 0;
+    usage_from_rusage(&t->usage, &ru);
+    return 1;
+}
 
-    pid_t pid = fork();
-    if (pid < 0) {
-        perror("[SCHEDULER] fork");
-        close(pipefd[0]); close(pipefd[1]);
+
+// Spawns the child process to execute t->command with stdout and stderr
+// redirected into a new pipe. The read end is handed to the client's reactor,
+// which forwards output as it is written, across SIGSTOP/SIGCONT cycles.
+// The pipe is close-on-exec so programs spawned concurrently on other CPUs never
+// inherit (and hold open) this task's write end. Also opens t->pidfd.
+// The stream is held in t->stream until the program's exit status is known
+// (see finish_stream()). If the program cannot be executed, the error is written
+// to the pipe instead, the reply ends with PROTO_ERROR, and nothing is left to run.
+// Returns 0 if the program started, 1 if it could not be executed, -1 on error.
+static int spawn_program(Task *t) {
+    int pipefd[2];
+    if (pipe2(pipefd, O_CLOEXEC) < 0) {
+        log_msg(LL_ERROR, t->client_num, "error", "[SCHEDULER] pipe: %s", strerror(errno));
         return -1;
     }
 
-    if (pid == 0) {
-        // child: redirect both stdout and stderr into the write end of the pipe
-        close(pipefd[0]);
-        if (dup2(pipefd[1], STDOUT_FILENO) < 0) _exit(1);
-        if (dup2(pipefd[1], STDERR_FILENO) < 0) _exit(1);
-        close(pipefd[1]);
-
-        // tokenize the command string into argv for execvp
-        char  cmd_copy[BUFFER_SIZE];
+    // argv comes from the parse cache; anything the shell parser would treat as
+    // more than a plain command (pipes, redirections, syntax errors) is split on
+    // whitespace as before, so those characters still reach the program
+    char           err[256];  // a parse error is not reported; the split below applies
+    PCacheEntry   *parsed = NULL;
+    char *const   *argv;
+    char          *split[MAX_ARGS];
+    char           cmd_copy[BUFFER_SIZE];
+    int            argc;
+    int            count  = pcache_get(t->command, &parsed, err, sizeof(err));
+    const Command *c      = count == 1 ? &parsed->pipeline.commands[0] : NULL;
+    if (c != NULL && !c->input_file && !c->output_file && !c->error_file) {
+        argv = c->args;
+        argc = c->argc;
+    } else {
         strncpy(cmd_copy, t->command, BUFFER_SIZE - 1);
         cmd_copy[BUFFER_SIZE - 1] = '\0';
+        char *save = NULL;
+        char *tok  = strtok_r(cmd_copy, " \t", &save);
+        for (argc = 0; tok && argc < MAX_ARGS - 1; tok = strtok_r(NULL, " \t", &save))
+            split[argc++] = tok;
+        split[argc] = NULL;
+        argv = split;
+    }
 
-        char *argv[64];
-        int   argc = 0;
-        char *tok  = strtok(cmd_copy, " \t");
-        while (tok && argc < 63) { argv[argc++] = tok; tok = strtok(NULL, " \t"); }
-        argv[argc] = NULL;
-
-        if (argc == 0) _exit(1);
-        execvp(argv[0], argv);
-        // execvp only returns on failure
-        fprintf(stderr, "Error: execvp: %s: %s\n", argv[0], strerror(errno));
-        _exit(1);
+    SpawnIO io  = { -1, pipefd[1], pipefd[1], -1 };
+    pid_t   pid = -1;
+    errno = ENOENT;  // an empty command cannot be executed
+    if (argc > 0) pid = spawn_process(argv, &io);
+    if (pid < 0 && (errno == EAGAIN || errno == ENOMEM)) {
+        log_msg(LL_ERROR, t->client_num, "error", "[SCHEDULER] posix_spawn: %s", strerror(errno));
+        if (parsed) pcache_put(parsed);
+        close(pipefd[0]); close(pipefd[1]);
+        return -1;
+    }
+    if (pid < 0) {
+        // the message is far smaller than the pipe, so this write cannot block
+        dprintf(pipefd[1], "Error: execvp: %s: %s\n", argc > 0 ? argv[0] : "", strerror(errno));
     }
+    if (parsed) pcache_put(parsed);
 
-    // parent: close the write end; child holds the only remaining write reference
+    // close the write end; the child holds the only remaining write reference
     close(pipefd[1]);
-    t->pipe_read = pipefd[0];  // save read end; stays open through SIGSTOP/SIGCONT
+    t->stream = conn_stream(t->client_num, t->req_id, pipefd[0], 1);
+    if (t->stream == NULL)
+        close(pipefd[0]);  // client already gone: the child's writes fail with EPIPE
+    if (pid < 0) {
+        finish_stream(t, PROTO_ERROR);
+        return 1;
+    }
     t->pid       = pid;
+    t->pidfd     = open_pidfd(pid);  // -1 on kernels without pidfd; slice loop then polls
     return 0;
 }
 
 
-// Runs (or resumes) the program task at q->tasks[idx] for one quantum slice.
-// First call (pid == -1): forks the child. Subsequent calls: sends SIGCONT.
-// Polls every SCH_POLL_MS ms for: (a) child exit, (b) preempt_flag set, (c) quantum end.
-// Sends SIGSTOP on (b) or (c). Decrements remaining_time by actual elapsed seconds.
+// Supplies the final status of t's output stream, if it still has one. A
+// program succeeds, like a shell command, only if it exits with status 0.
+static void finish_stream(Task *t, int32_t status) {
+    if (t->stream == NULL) return;
+    conn_stream_finish(t->stream, status);
+    t->stream = NULL;
+}
+
+
+// Opens a pollable handle that becomes readable when pid exits (Linux 5.3+).
+// Returns -1 where the syscall is unavailable.
+static int open_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+
+// Closes t->pidfd if one is open.
+static void close_pidfd(Task *t) {
+    if (t->pidfd >= 0) { close(t->pidfd); t->pidfd = -1; }
+}
+
+
+// Converts nanoseconds to fractional seconds for log and Gantt output.
+static double ns_to_sec(int64_t ns) {
+    return (double)ns / (double)NSEC_PER_SEC;
+}
+
+
+// Consumes any pending count on a non-blocking eventfd or timerfd.
+static void drain_fd(int fd) {
+    uint64_t value;
+    while (read(fd, &value, sizeof(value)) > 0) { }
+}
+
+
+// Wakes the worker of the given CPU out of its slice so it re-checks t->preempt.
+// Safe to call with q->mutex held; the eventfd write never blocks.
+static void kick_cpu(TaskQueue *q, int cpu) {
+    uint64_t one = 1;
+    if (cpu < 0 || cpu >= q->ncpus) return;
+    ssize_t n = write(q->cpus[cpu].wake_fd, &one, sizeof(one));
+    (void)n;  // EAGAIN only means a wakeup is already pending
+}
+
+
+// Runs (or resumes) the program task t for one slice of quantum ns on cpu.
+// t is looked up by the caller under q->mutex (see run_shell_task()).
+// First call (pid == -1): spawns the child. Subsequent calls: sends SIGCONT.
+// Blocks in poll() until (a) the child exits (pidfd), (b) t->preempt is raised
+// (cpu->wake_fd), or (c) the quantum expires (cpu->timer_fd). Without pidfd
+// support the loop falls back to checking waitpid() every SCH_POLL_MS ms.
+// Sends SIGSTOP on (b) or (c). Decrements remaining_ns by the elapsed nanoseconds
+// and, once the program has exited, reports its total running time to predict.c.
 // Returns 1 if the task completed this slice, 0 if it was stopped or preempted.
-static int run_program_slice(TaskQueue *q, int idx) {
-    Task *t = &q->tasks[idx];
-    int quantum = (t->round == 1) ? QUANTUM_FIRST : QUANTUM_REST;  // round 1 uses shorter quantum
+static int run_program_slice(TaskQueue *q, SchedCpu *cpu, Task *t, int64_t quantum) {
 
     if (t->pid == -1) {
-        // first time this task runs: fork a child process
-        if (fork_program(t) < 0) return 0;
-        printf("[%d]--- started (%d)\n", t->client_num, t->remaining_time);
+        // first time this task runs: spawn a child process
+        int rc = spawn_program(t);
+        if (rc < 0) return 0;
+        log_msg(LL_INFO, t->client_num, "started", "[%d]--- started (%.3f)",
+                t->client_num, ns_to_sec(t->remaining_ns));
+        if (rc > 0) return 1;  // could not be executed: nothing to run
     } else {
         // task was stopped before; resume the child with SIGCONT
-        printf("[%d]--- running (%d)\n", t->client_num, t->remaining_time);
+        log_msg(LL_INFO, t->client_num, "running", "[%d]--- running (%.3f)",
+                t->client_num, ns_to_sec(t->remaining_ns));
         kill(t->pid, SIGCONT);
     }
-    fflush(stdout);
 
-    time_t slice_start = time(NULL);
-    int    elapsed     = 0;
-    int    completed   = 0;
+    int64_t slice_start = sched_now_ns();
+    int64_t cpu_start   = t->usage.cpu_ns;
+    int     completed   = 0;
+    int     preempted   = 0;
+    int     status      = 0;
+
+    // arm the quantum timer and discard wakeups left over from the previous slice;
+    // a request raised before the drain is still seen through t->preempt below
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec  = (time_t)(quantum / NSEC_PER_SEC);
+    its.it_value.tv_nsec = (long)(quantum % NSEC_PER_SEC);
+    timerfd_settime(cpu->timer_fd, 0, &its, NULL);
+    drain_fd(cpu->wake_fd);
 
-    // polling loop: wake every SCH_POLL_MS ms and check for exit or preemption
-    while (elapsed < quantum) {
-        struct timespec ts = { 0, (long)SCH_POLL_MS * 1000000L };
-        nanosleep(&ts, NULL);
-        elapsed = (int)(time(NULL) - slice_start);
+    pthread_mutex_lock(&q->mutex);
+    preempted = t->preempt;
+    pthread_mutex_unlock(&q->mutex);
 
-        // check whether the child has already exited
-        int   status;
-        pid_t r = waitpid(t->pid, &status, WNOHANG);
-        if (r == t->pid) { completed = 1; t->pid = -1; break; }
+    // event loop: sleep until the child exits, a preemption is requested, or time is up
+    while (!preempted) {
+        struct pollfd fds[3] = {
+            { cpu->timer_fd, POLLIN, 0 },
+            { cpu->wake_fd,  POLLIN, 0 },
+            { t->pidfd,      POLLIN, 0 },
+        };
+        int nfds    = (t->pidfd >= 0) ? 3 : 2;
+        int timeout = (t->pidfd >= 0) ? -1 : SCH_POLL_MS;
+        if (poll(fds, (nfds_t)nfds, timeout) < 0) {
+            if (errno == EINTR) continue;
+            log_msg(LL_ERROR, t->client_num, "error", "[SCHEDULER] poll: %s", strerror(errno));
+            break;
+        }
 
-        // check whether a client thread requested preemption
-        pthread_mutex_lock(&q->mutex);
-        int preempt = q->preempt_flag;
-        pthread_mutex_unlock(&q->mutex);
-        if (preempt) { kill(t->pid, SIGSTOP); break; }  // stop child; scheduler will reschedule
-    }
+        // child exit: pidfd became readable (or the fallback poll interval passed)
+        if (t->pidfd < 0 || (fds[2].revents & POLLIN)) {
+            if (reap_program(t, &status)) { completed = 1; break; }
+        }
 
-    // edge case: child may have exited exactly when the quantum expired,
-    // so the loop exited before the waitpid check ran again
-    if (!completed && t->pid > 0) {
-        int final_status;
-        if (waitpid(t->pid, &final_status, WNOHANG) == t->pid) {
-            completed = 1; t->pid = -1;
+        // a client thread requested preemption of this task
+        if (fds[1].revents & POLLIN) {
+            drain_fd(cpu->wake_fd);
+            pthread_mutex_lock(&q->mutex);
+            preempted = t->preempt;
+            pthread_mutex_unlock(&q->mutex);
         }
-    }
 
-    // quantum expired without completion or preemption: stop the child now
-    if (!completed && t->pid > 0) {
-        pthread_mutex_lock(&q->mutex);
-        int preempt = q->preempt_flag;
-        pthread_mutex_unlock(&q->mutex);
-        if (!preempt) kill(t->pid, SIGSTOP);  // preempt path already stopped it in the loop
+        // quantum expired
+        if (fds[0].revents & POLLIN) break;
     }
 
-    // update remaining time by actual seconds used this slice
-    t->remaining_time -= elapsed;
-    if (t->remaining_time < 0) t->remaining_time = 0;
-
-    return completed;
-}
+    // disarm the timer so a late expiry does not leak into the next slice
+    memset(&its, 0, sizeof(its));
+    timerfd_settime(cpu->timer_fd, 0, &its, NULL);
+    drain_fd(cpu->timer_fd);
 
+    // edge case: the child may have exited at the same moment the slice ended
+    if (!completed && reap_program(t, &status)) completed = 1;
 
-// Reads all accumulated output from the child's pipe and forwards it to the
-// client socket. Closes the pipe when done.
-// Called without q->mutex held to avoid holding the lock during blocking I/O.
-static void send_program_output(int client_num, int client_fd, int pipe_read) {
-    char    buf[65536];  // large buffer; programs are expected to produce modest output
-    int     total = 0;
-    ssize_t n;
+    int measured = completed;  // reap_program() has read the final usage
+    if (completed) {
+        t->pid = -1;
+        close_pidfd(t);
+        finish_stream(t, WIFEXITED(status) && WEXITSTATUS(status) == 0 ? PROTO_OK : PROTO_ERROR);
+    } else {
+        kill(t->pid, SIGSTOP);  // quantum expired or preempted: stop the child
+        measured = usage_read(t->pid, &t->usage) == 0;
+    }
 
-    // read until EOF (child exited, so the write end of the pipe is closed)
-    while (total < (int)(sizeof(buf) - 1) &&
-           (n = read(pipe_read, buf + total, sizeof(buf) - (size_t)total - 1)) > 0)
-        total += (int)n;
+    // update remaining time by what this slice used: the time the program held
+    // the CPU, or with account_cpu the CPU time the kernel measured
+    int64_t wall = sched_now_ns() - slice_start;
+    int64_t used = (q->account_cpu && measured) ? t->usage.cpu_ns - cpu_start : wall;
+    if (used < 0) used = 0;
+    t->wall_ns      += wall;
+    t->used_ns      += used;
+    t->remaining_ns -= used;
+    if (t->remaining_ns < 0) t->remaining_ns = 0;
 
-    buf[total] = '\0';
-    close(pipe_read);  // done reading; release the fd
+    // a program that exited by itself teaches the predictor its running time;
+    // one killed because its client left does not
+    if (completed && WIFEXITED(status)) predict_record(t->command, t->used_ns);
 
-    if (total > 0) {
-        ssize_t sent = send(client_fd, buf, (size_t)total, 0);
-        printf("[%d]<<< %zd bytes sent\n", client_num, sent);
-    } else {
-        send(client_fd, "\n", 1, 0);  // send a blank line so the client isn't left waiting
-    }
-    fflush(stdout);
+    return completed;
 }
@@ -1,21 +1,38 @@
-// scheduler.h — Phase 4 scheduler interface (SRJF + Round-Robin).
+// scheduler.h — Phase 4 scheduler interface (SRJF + Round-Robin over N CPUs by
+// default; other policies in policy.h).
 
 #ifndef SCHEDULER_H
 #define SCHEDULER_H
 
 #define _POSIX_C_SOURCE 200809L
 
+#include "pool.h"
+#include "usage.h"
+
 #include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <sys/types.h>
 #include <time.h>
 
+struct OutStream;
+
 // tuning constants
-#define MAX_TASKS     100   // max tasks in the queue at once
-#define QUANTUM_FIRST   3   // time-slice for round 1 (seconds)
-#define QUANTUM_REST    7   // time-slice for rounds 2+ (seconds)
-#define DEFAULT_BURST  10   // burst used for unknown programs
-#define SCH_POLL_MS   200   // polling interval inside a slice (ms)
-#define BUFFER_SIZE  4096   // max command string length
+#define TASK_SLAB_SIZE  64   // Task descriptors allocated per slab as the pool grows
+#define QUANTUM_FIRST_MS 3000  // default time-slice for round 1 (milliseconds)
+#define QUANTUM_REST_MS  7000  // default time-slice for rounds 2+ (milliseconds)
+#define DEFAULT_BURST      10  // burst used for unknown programs (seconds)
+#define NSEC_PER_SEC 1000000000LL
+#define NSEC_PER_MS     1000000LL
+#define SCH_POLL_MS   200   // slice polling interval when pidfd is unavailable (ms)
+#define DEFAULT_CPUS    1   // simulated CPUs (worker threads) when not configured
+#define MAX_CPUS       64   // upper bound on configurable worker threads
+#define DEFAULT_SHELL_WORKERS 4   // shell-command threads when not configured
+#define MAX_SHELL_WORKERS    64   // upper bound on configurable shell-command threads
+#define CLIENT_BUCKETS 256   // hash buckets of the per-client task index
+#define MAX_CLIENT_WEIGHTS 64   // -w entries accepted
+#define SCHED_OVER_QUOTA   -2   // scheduler_add_task(): client is at its -m limit
+#define BUFFER_SIZE  4096   // max command string length accepted from a client
 
 // task lifecycle states
 typedef enum {
@@ -25,66 +42,196 @@ typedef enum {
     TASK_DONE    = 3    // finished; slot will be reclaimed
 } TaskState;
 
+struct SchedClient;
+
 // all information the scheduler needs for one client request
 typedef struct {
     int        task_id;               // unique 1-based ID; 0 = empty slot
     int        client_num;
-    int        client_fd;             // socket fd for sending the response
-    char       command[BUFFER_SIZE];
-
-    int        burst_time;            // original burst (-1 for shell commands)
-    int        remaining_time;        // decremented each slice
+    struct SchedClient *client;       // index entry of client_num; valid while the task lives
+    uint32_t   req_id;                // protocol request id, echoed in the reply frame
+    char      *command;               // NUL-terminated text, owned by q->strings
+
+    int64_t    burst_ns;              // original burst (-1 for shell commands)
+    int64_t    remaining_ns;          // decremented by the time used each slice
+    int64_t    used_ns;               // running time so far, summed over slices (see account_cpu)
+    int64_t    wall_ns;               // time spent holding a CPU, summed over slices
+    Usage      usage;                 // kernel-measured consumption up to the last slice
     int        round;                 // starts at 1
 
     int        is_shell_cmd;          // 1 = shell command, 0 = program
     TaskState  state;
-    time_t     arrival_time;          // for FCFS tie-breaking
+    int64_t    arrival_ns;            // CLOCK_MONOTONIC enqueue time; FCFS tie-breaking
+    int64_t    started_ns;            // CLOCK_MONOTONIC time it first ran; 0 until then
+    int        cpu;                   // CPU the task runs on; -1 while waiting
+    int        preempt;               // set by a client thread to request preemption
 
     pid_t      pid;                   // child PID; -1 if not forked yet
-    int        pipe_read;             // read end of the output-capture pipe
+    pid_t      helper_pid;            // helper running a builtin for this task; -1 = none
+    int        pidfd;                 // pollable handle on the child; -1 if none
+    struct OutStream *stream;         // program output, held for its exit status; NULL if none
     int        cancelled;             // set to 1 when the client disconnects
+
+    int        level;                 // mlfq: feedback-queue level, 0 = top
+    int64_t    queued_ns;             // mlfq: when it joined its level's queue
+    int64_t    vruntime_ns;           // cfs: running time scaled by 1/weight
+    int        weight;                // cfs: share weight (CFS_WEIGHT_DEFAULT times the client's)
+    int64_t    deadline_ns;           // edf: absolute CLOCK_MONOTONIC deadline
+
+    int        heap_pos;              // index in the ready heap; -1 if not queued
+    int        shell_next;            // next slot in the shell FIFO; -1 = last
+    int        client_prev;           // neighbours in the owning client's task list
+    int        client_next;
 } Task;
 
+// per-client index entry: the slots of every live task a client owns and its
+// CPU-time account; kept until the client has disconnected and owns no task
+typedef struct SchedClient {
+    int                 client_num;
+    int                 first_task;   // head of the client's task list; -1 = none
+    int                 ntasks;       // live tasks of any kind (the -m quota)
+    int                 ready;        // programs in the ready heap
+    int                 running;      // programs on a CPU (the -M quota)
+    int                 weight;       // fair-share weight (-w), 1 by default
+    int                 closed;       // the connection is gone
+    int64_t             cpu_ns;       // program running time used so far
+    int64_t             vruntime_ns;  // cpu_ns / weight, minus credit not banked while idle
+    struct SchedClient *next;         // hash-bucket chain
+} SchedClient;
+
+// a -w setting: the fair-share weight of one client number
+typedef struct {
+    int client_num;
+    int weight;
+} ClientWeight;
+
 // one entry in the Gantt-chart history linked list
 typedef struct HistEntry {
     int              client_num;
-    long             end_time;        // seconds since scheduler_init()
+    int              cpu;             // CPU the slice ran on
+    int64_t          end_ns;          // nanoseconds since scheduler_init()
     struct HistEntry *next;
 } HistEntry;
 
-// shared scheduling state; all fields below the mutex need the mutex held
+// startup configuration; fill with scheduler_default_config() then override
+typedef struct {
+    int     ncpus;                    // number of worker threads
+    int64_t quantum_first_ns;         // time-slice for round 1
+    int64_t quantum_rest_ns;          // time-slice for rounds 2+
+    int     nshell;                   // shell-command worker threads
+    const struct SchedPolicy *policy; // program scheduling policy (policy.h)
+    int     fair_share;               // pick the client with the least weighted CPU time first
+    int     max_queued;               // live tasks per client; 0 = unlimited
+    int     max_running;              // programs on a CPU per client; 0 = unlimited
+    int     account_cpu;              // charge slices by CPU time used instead of wall-clock time
+    int     nweights;
+    ClientWeight weights[MAX_CLIENT_WEIGHTS];  // clients whose weight is not 1
+} SchedConfig;
+
+struct TaskQueue;
+struct SchedPolicy;
+
+// one simulated CPU: a worker thread that runs one slice at a time
 typedef struct {
-    Task            tasks[MAX_TASKS];
+    int               id;               // 0-based CPU number shown in the Gantt chart
+    pthread_t         thread;
+    int               last_run_task_id; // ID of the task this CPU ran last (-1 = none)
+    int               timer_fd;         // timerfd armed with the quantum of each slice
+    int               wake_fd;          // eventfd written to request preemption
+    int               current;          // slot of the task running here; -1 = idle
+    struct TaskQueue *q;                // back-pointer passed to the worker thread
+} SchedCpu;
+
+// shared scheduling state; all fields below the mutex need the mutex held
+typedef struct TaskQueue {
+    SlabPool        tasks;            // Task descriptors, addressed by slot index
+    StrArena        strings;          // out-of-line command text
+    int            *heap;             // ready queue: min-heap of slots in the policy's order
+    int             heap_cap;         // kept >= the pool capacity so pushes never fail
+    SchedClient    *clients[CLIENT_BUCKETS];
     int             count;            // active (waiting or running) task count
+    int             ready;            // tasks in TASK_WAITING (== heap size)
+    int             running;          // tasks in TASK_RUNNING
     pthread_mutex_t mutex;
-    pthread_cond_t  has_task;         // signalled when a task is added
+    pthread_cond_t  has_task;         // signalled when a task becomes ready
+
+    int             shell_head;       // FIFO of shell commands (slots); -1 = empty
+    int             shell_tail;
+    int             shell_ready;      // shell commands waiting in the FIFO
+    int             nshell;           // shell-command worker threads
+    pthread_cond_t  has_shell;        // signalled when a shell command is queued
 
     int             next_task_id;     // monotonically increasing ID counter
-    int             last_run_task_id; // ID of most recently run task (-1 = none)
-    int             preempt_flag;     // set by client thread to request preemption
 
-    time_t          start_time;       // epoch time at scheduler_init()
+    int             ncpus;            // number of worker threads
+    SchedCpu        cpus[MAX_CPUS];
+    int64_t         quantum_first_ns;
+    int64_t         quantum_rest_ns;
+    const struct SchedPolicy *policy; // orders the ready heap and sizes slices
+    int64_t         min_vruntime_ns;  // cfs: smallest vruntime still queued
+    int64_t         boost_ns;         // mlfq: time of the last boost to the top level
+
+    int             fair_share;       // see SchedConfig
+    int             max_queued;
+    int             max_running;
+    int             account_cpu;
+    int             nweights;
+    ClientWeight    weights[MAX_CLIENT_WEIGHTS];
+    int             ready_clients;    // clients with a program in the ready heap
+    int64_t         fair_floor_ns;    // least client vruntime picked so far; only grows
+
+    int             programs_done;    // programs that ran to completion
+    Usage           usage_total;      // their summed consumption
+    int64_t         wall_total_ns;    // time they held a CPU
+
+    int64_t         start_ns;         // CLOCK_MONOTONIC time at scheduler_init()
     HistEntry      *hist_head;
     HistEntry      *hist_tail;
 } TaskQueue;
 
-// initialise the queue; call once from main before spawning any thread
-void scheduler_init(TaskQueue *q);
+// Task descriptor at slot idx; slabs never move, so the pointer stays valid until released
+#define TASK(q, idx) ((Task *)slab_at(&(q)->tasks, (idx)))
+
+// current CLOCK_MONOTONIC time in nanoseconds
+int64_t sched_now_ns(void);
+
+// Restores the ready heap's order after the policy changed the keys of queued
+// tasks. Must be called with q->mutex held.
+void sched_reorder(TaskQueue *q);
 
-// enqueue a new command; returns the task_id or -1 if queue is full
-int scheduler_add_task(TaskQueue *q, int client_num, int client_fd,
-                       const char *command, int burst_time, int is_shell_cmd);
+// fill cfg with DEFAULT_CPUS, DEFAULT_SHELL_WORKERS, the QUANTUM_*_MS defaults
+// and the default policy
+void scheduler_default_config(SchedConfig *cfg);
 
-// cancel all tasks for a disconnected client
+// initialise the queue from cfg; call once from main before spawning any thread
+void scheduler_init(TaskQueue *q, const SchedConfig *cfg);
+
+// spawn one detached worker thread per CPU plus the shell-command pool;
+// returns 0 on success, -1 on error
+int scheduler_start(TaskQueue *q);
+
+// enqueue a new command with a burst in nanoseconds (-1 for shell commands);
+// returns the task_id, SCHED_OVER_QUOTA if the client already has max_queued
+// live tasks, or -1 if memory for the task is exhausted
+int scheduler_add_task(TaskQueue *q, int client_num, uint32_t req_id,
+                       const char *command, int64_t burst_ns, int is_shell_cmd);
+
+// cancel all tasks for a disconnected client and close its CPU-time account
 void scheduler_remove_client(TaskQueue *q, int client_num);
 
-// main scheduling loop; runs in its own dedicated thread
+// main scheduling loop for one CPU; arg is a SchedCpu *
 void *scheduler_run(void *arg);
 
+// loop of one shell-command worker; arg is the TaskQueue *
+void *scheduler_run_shell(void *arg);
+
 // print the Gantt-chart history; called automatically when the queue empties
 void scheduler_print_summary(TaskQueue *q);
 
-// destroy mutex/condvar and free history; call only after scheduler thread exits
+// write the queue's gauges (depth, tasks by state, busy CPUs) in Prometheus text format
+void scheduler_write_metrics(TaskQueue *q, FILE *out);
+
+// destroy mutex/condvar and free history; call only after the worker threads exit
 void scheduler_cleanup(TaskQueue *q);
 
 #endif // SCHEDULER_H
@@ -1,10 +1,47 @@
-// server.c — Phase 4 multithreaded TCP shell server.
+// server.c — Phase 4 TCP shell server with an epoll-driven connection front end.
 //
 // Thread model:
-//   main thread      — accepts TCP connections, spawns one client thread each.
-//   scheduler thread — runs scheduler_run(); the single simulated CPU.
-//   client threads   — one per client; receives commands and enqueues them.
-
+//   reactor threads  — each owns an epoll instance; together they accept every
+//                      connection and read every client socket without blocking.
+//                      The main thread runs reactor 0.
+//   worker threads   — one per simulated CPU, each running scheduler_run().
+//   shell threads    — a bounded pool running shell commands, so they never
+//                      occupy a simulated CPU. Each hands its commands to its own
+//                      helper process, this binary started with HELPER_ARG.
+//
+// A connection costs one small Conn struct and an epoll registration instead of
+// a thread and its stack, so memory stays flat with thousands of idle clients.
+// Requests and responses are length-prefixed frames (protocol.h). A reactor may
+// find several pipelined requests in one read and enqueues each of them; workers
+// answer through conn_reply() (conn.c), which queues the frame and leaves any
+// part the socket cannot take for the reactor's EPOLLOUT handler. Running
+// programs' output pipes are registered with the client's reactor as well, so
+// their output is forwarded while they run.
+//
+// Usage: ./server [-c cpus] [-q ms] [-Q ms] [-r reactors] [-b backlog] [-s shells]
+//                 [-E file] [-P policy] [-F] [-w client:weight]... [-m n] [-M n]
+//                 [-A wall|cpu] [-a port] [-l level] [-j]
+//   -c cpus      number of simulated CPUs (default DEFAULT_CPUS; 0 = online cores)
+//   -q ms        round-1 quantum in milliseconds (default QUANTUM_FIRST_MS)
+//   -Q ms        round-2+ quantum in milliseconds (default QUANTUM_REST_MS)
+//   -r reactors  number of epoll reactor threads (default DEFAULT_REACTORS)
+//   -b backlog   listen() backlog (default DEFAULT_BACKLOG)
+//   -s shells    shell-command worker threads (default DEFAULT_SHELL_WORKERS)
+//   -E file      file the learned burst estimates are kept in (default
+//                PREDICT_FILE; -E '' keeps them in memory only)
+//   -P policy    program scheduling policy: srjf, mlfq, cfs or edf (default srjf)
+//   -F           fair share: the next program comes from the client with the
+//                least CPU time used, divided by its weight
+//   -w c:w       fair-share weight w of client c (repeatable; default 1)
+//   -m n         at most n commands in progress per client (default 0 = unlimited)
+//   -M n         at most n programs per client on the CPUs at once (default 0 = unlimited)
+//   -A mode      charge slices against the burst by wall time on the CPU or by
+//                the CPU time the kernel measured: wall or cpu (default wall)
+//   -a port      serve Prometheus metrics on 127.0.0.1:port/metrics (default off)
+//   -l level     least log level written: debug, info, warn or error (default info)
+//   -j           log JSON lines instead of plain text
+
+#define _GNU_SOURCE              // accept4 and EPOLLEXCLUSIVE on Linux
 #define _POSIX_C_SOURCE 200809L
 
 #include <stdio.h>
@@ -13,17 +50,33 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <errno.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <signal.h>
 #include <fcntl.h>
 
 #include "shell.h"
 #include "scheduler.h"
-
-#define PORT        3000   // TCP port the server listens on
-#define BUFFER_SIZE 4096   // max length of one incoming command
+#include "policy.h"
+#include "protocol.h"
+#include "conn.h"
+#include "helper.h"
+#include "predict.h"
+#include "metrics.h"
+#include "log.h"
+
+#define PORT             3000   // TCP port the server listens on
+#define BUFFER_SIZE      4096   // max length of one incoming command
+#define READ_CHUNK      65536   // bytes requested per recv() on a client socket
+#define DEFAULT_BACKLOG   128   // pending-connection queue passed to listen()
+#define DEFAULT_REACTORS    1   // epoll threads when -r is not given
+#define MAX_REACTORS       16
+#define MAX_EVENTS        256   // events fetched per epoll_wait() call
 
 // global scheduler queue shared by all threads
 static TaskQueue   g_queue;
@@ -33,122 +86,405 @@ static int         client_counter  = 0;
 static sem_t      *client_sem      = NULL;
 static const char *CLIENT_SEM_NAME = "/client_sem";
 
-// per-connection data passed to each client thread; heap-allocated, freed by the thread
+// listening socket shared by every reactor (non-blocking)
+static int         g_listen_fd     = -1;
+
+// one epoll loop; reactors[0] runs on the main thread
 typedef struct {
-    int                client_fd;
-    struct sockaddr_in client_addr;
-    int                client_num;
-    int                thread_num;
-} client_info_t;
-
-
-// Classifies a command as a program or a shell command and sets burst_time.
-// Commands starting with "./" are programs; everything else is a shell command.
-// For "./demo N", burst_time is parsed from N. Other "./" programs use DEFAULT_BURST.
-// Shell commands get burst_time = -1 (they are always scheduled first and run atomically).
-static void classify_command(const char *command, int *burst_out, int *is_shell_out) {
+    int       id;
+    int       epoll_fd;
+    pthread_t thread;
+} Reactor;
+
+
+// Classifies a command as a program or a shell command and sets the burst in nanoseconds.
+// Commands starting with "./" are programs; their burst is predicted from past
+// runs of the same command (predict.c), or for a new one taken from its last
+// numeric argument ("./demo N" takes N seconds), else DEFAULT_BURST.
+// Shell commands get burst -1: they skip the simulated CPUs and go to a FIFO
+// served in arrival order by the shell worker pool (-s).
+static void classify_command(const char *command, int64_t *burst_out, int *is_shell_out) {
     if (strncmp(command, "./", 2) == 0) {
         *is_shell_out = 0;
-        *burst_out    = DEFAULT_BURST;  // fallback for programs with unknown burst
-        const char *last_space = strrchr(command, ' ');
-        if (last_space != NULL && *(last_space + 1) != '\0') {
-            int n = atoi(last_space + 1);
-            if (n > 0) *burst_out = n;  // override with the N parsed from the command
-        }
+        *burst_out    = predict_burst(command, DEFAULT_BURST * NSEC_PER_SEC);
     } else {
         *is_shell_out = 1;
-        *burst_out    = -1;  // -1 marks shell commands so the scheduler runs them first
+        *burst_out    = -1;  // -1 marks shell commands for the shell workers' FIFO
     }
 }
 
 
-// Entry point for each per-client thread.
-// Loops reading commands, classifies each one, and enqueues it with the scheduler.
-// The scheduler thread handles all execution and sends responses back on client_fd.
-// Exits when the client sends "exit" or disconnects.
-static void *ThreadFunction(void *arg) {
-    client_info_t *info       = (client_info_t *)arg;
-    int            client_fd  = info->client_fd;
-    int            client_num = info->client_num;
+// Runs one command received from a client: logs it, handles "exit", classifies
+// it and enqueues it with the scheduler. The worker threads execute it and reply
+// with a frame carrying the same request id.
+// Returns -1 if the connection should be closed, 0 otherwise.
+static int handle_command(Conn *c, uint32_t req_id, char *buffer) {
+    // strip the trailing newline that client.c's fgets() adds
+    size_t len = strlen(buffer);
+    if (len > 0 && buffer[len - 1] == '\n')
+        buffer[--len] = '\0';
+
+    log_msg(LL_INFO, c->client_num, "command", "[%d]>>> %s", c->client_num, buffer);
+
+    // "exit" closes the connection; client is waiting for the socket to close
+    if (strcmp(buffer, "exit") == 0)
+        return -1;
+
+    // determine burst and type, then add to the scheduler queue
+    int64_t burst_ns;
+    int     is_shell_cmd;
+    classify_command(buffer, &burst_ns, &is_shell_cmd);
+
+    int task_id = scheduler_add_task(&g_queue, c->client_num, req_id,
+                                     buffer, burst_ns, is_shell_cmd);
+    if (task_id == SCHED_OVER_QUOTA) {
+        char err[128];
+        int  n = snprintf(err, sizeof(err),
+                          "Error: Too many commands in progress (limit %d). Try again later.\n",
+                          g_queue.max_queued);
+        conn_reply(c->client_num, req_id, PROTO_ERROR, err, (size_t)n);
+    } else if (task_id < 0) {
+        // no memory for the task: answer immediately so the client isn't left hanging
+        const char *err = "Error: Server could not queue the command. Try again later.\n";
+        conn_reply(c->client_num, req_id, PROTO_ERROR, err, strlen(err));
+    }
+    return 0;
+}
 
-    printf("[%d]<<< client connected\n", client_num);
-    fflush(stdout);
 
-    char    buffer[BUFFER_SIZE];
-    ssize_t bytes_read;
+// Tears down a connection: unregisters it first so no worker can reply to it any
+// more, then cancels its queued/running tasks. The socket itself is closed by the
+// last conn reference, so a reply in flight never lands on a reused fd.
+static void close_client(Conn *c) {
+    int client_num = c->client_num;
+    conn_close(c);
+    scheduler_remove_client(&g_queue, client_num);
+}
 
-    while (1) {
-        memset(buffer, 0, BUFFER_SIZE);
 
-        // block until the client sends data or disconnects
-        bytes_read = recv(client_fd, buffer, BUFFER_SIZE - 1, 0);
+// Parses every complete frame in c->in and runs its command, then moves any
+// trailing partial frame to the front of the buffer.
+// Returns -1 if the connection should be closed, 0 otherwise.
+static int process_frames(Conn *c) {
+    size_t off = 0;
+    int    rc  = 0;
+
+    while (c->in_len - off >= PROTO_HEADER_SIZE) {
+        FrameHeader h;
+        proto_decode_header((unsigned char *)c->in + off, &h);
+
+        if (h.status != PROTO_REQUEST || h.length > BUFFER_SIZE - 1) {
+            // a corrupt or oversized frame leaves the stream unsynchronised: give up on it
+            const char *err = "Error: Malformed or oversized request.\n";
+            conn_reply(c->client_num, h.id, PROTO_ERROR, err, strlen(err));
+            log_msg(LL_ERROR, c->client_num, "error", "[ERROR] client %d: bad frame (status %d, %u bytes)",
+                    c->client_num, (int)h.status, h.length);
+            return -1;
+        }
+        if (c->in_len - off - PROTO_HEADER_SIZE < h.length) break;  // payload still in flight
 
-        if (bytes_read <= 0) {
-            // 0 = clean disconnect; negative = error
-            if (bytes_read == 0)
-                printf("[%d] disconnected.\n", client_num);
-            else
-                fprintf(stderr, "[ERROR] recv client %d: %s\n", client_num, strerror(errno));
-            break;
+        char command[BUFFER_SIZE];
+        memcpy(command, c->in + off + PROTO_HEADER_SIZE, h.length);
+        command[h.length] = '\0';
+        off += PROTO_HEADER_SIZE + h.length;
+
+        if (handle_command(c, h.id, command) < 0) { rc = -1; break; }
+    }
+
+    c->in_len -= off;
+    if (c->in_len > 0 && off > 0) memmove(c->in, c->in + off, c->in_len);
+    return rc;
+}
+
+
+// Handles EPOLLIN on a client socket: appends whatever has arrived to the
+// connection's input buffer and runs every complete request in it, so a client
+// may pipeline many commands in a single write.
+// recv() uses MSG_DONTWAIT, so a spurious wakeup never blocks the reactor.
+static void client_readable(Conn *c) {
+    if (c->in_cap - c->in_len < READ_CHUNK) {
+        size_t cap = c->in_len + READ_CHUNK;
+        char  *p   = realloc(c->in, cap);
+        if (!p) {
+            log_msg(LL_ERROR, c->client_num, "error", "[ERROR] realloc: %s", strerror(errno));
+            close_client(c);
+            return;
         }
+        c->in     = p;
+        c->in_cap = cap;
+    }
 
-        buffer[bytes_read] = '\0';
+    ssize_t bytes_read = recv(c->fd, c->in + c->in_len, c->in_cap - c->in_len, MSG_DONTWAIT);
 
-        // strip the trailing newline that client.c's fgets() adds
-        size_t len = strlen(buffer);
-        if (len > 0 && buffer[len - 1] == '\n')
-            buffer[--len] = '\0';
+    if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return;  // nothing to read after all
 
-        printf("[%d]>>> %s\n", client_num, buffer);  // log the received command
-        fflush(stdout);
+    if (bytes_read <= 0) {
+        // 0 = clean disconnect; negative = error
+        if (bytes_read == 0)
+            log_msg(LL_INFO, c->client_num, "disconnected", "[%d] disconnected.", c->client_num);
+        else
+            log_msg(LL_ERROR, c->client_num, "error", "[ERROR] recv client %d: %s",
+                    c->client_num, strerror(errno));
+        close_client(c);
+        return;
+    }
 
-        // "exit" closes the connection; client is waiting for the socket to close
-        if (strcmp(buffer, "exit") == 0)
-            break;
+    c->in_len += (size_t)bytes_read;
+    if (process_frames(c) < 0) close_client(c);
+}
 
-        // determine burst_time and type, then add to the scheduler queue
-        int burst_time, is_shell_cmd;
-        classify_command(buffer, &burst_time, &is_shell_cmd);
 
-        int task_id = scheduler_add_task(&g_queue, client_num, client_fd,
-                                         buffer, burst_time, is_shell_cmd);
-        if (task_id < 0) {
-            // queue full: send error immediately so the client isn't left hanging
-            const char *err = "Error: Server task queue is full. Try again later.\n";
-            send(client_fd, err, strlen(err), 0);
+// Handles EPOLLIN on the listening socket: accepts until the backlog is empty
+// and registers each new connection with this reactor's epoll instance.
+// Client sockets are non-blocking: every send is either MSG_DONTWAIT or a
+// splice() that must fail with EAGAIN rather than stall a thread.
+static void accept_clients(Reactor *r) {
+    while (1) {
+        struct sockaddr_in client_addr;
+        socklen_t addrlen   = sizeof(client_addr);
+        int       client_fd = accept4(g_listen_fd, (struct sockaddr *)&client_addr,
+                                      &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;  // backlog drained
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            // EMFILE/ENFILE and friends: log and retry on the next wakeup
+            log_msg(LL_ERROR, LOG_NO_CLIENT, "error", "[ERROR] accept: %s", strerror(errno));
+            return;
+        }
+
+        // a reply is several small writes (frame header, output, final frame);
+        // with Nagle the last one would wait for the client's delayed ACK
+        int one = 1;
+        setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        // assign a unique client number atomically under the semaphore
+        sem_wait(client_sem);
+        int client_num = ++client_counter;
+        sem_post(client_sem);
+
+        Conn *c = conn_create(client_fd, client_num, r->epoll_fd);
+        if (!c) {
+            log_msg(LL_ERROR, client_num, "error", "[ERROR] conn_create: %s", strerror(errno));
+            close(client_fd);
+            continue;
         }
-        // the client thread does NOT wait for the result here;
-        // client.c is synchronous so recv() above naturally blocks until
-        // the scheduler sends the response on client_fd
+
+        log_msg(LL_INFO, c->client_num, "connected", "[%d]<<< client connected", c->client_num);
     }
+}
 
-    // cancel any queued/running tasks before closing the socket so the
-    // scheduler never tries to send on a closed file descriptor
-    scheduler_remove_client(&g_queue, client_num);
 
-    close(client_fd);
-    free(info);           // info was malloc'd in the accept loop
-    pthread_exit(NULL);
+// Event loop of one reactor. data.ptr == NULL marks the listening socket; every
+// other registration points at a Conn or an OutStream, told apart by their
+// leading ConnKind. Pending output is flushed before input is read, because
+// reading may close the connection.
+static void *reactor_run(void *arg) {
+    Reactor           *r = (Reactor *)arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    while (1) {
+        int n = epoll_wait(r->epoll_fd, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            log_msg(LL_ERROR, LOG_NO_CLIENT, "error", "epoll_wait: %s", strerror(errno));
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr == NULL) { accept_clients(r); continue; }
+            if (*(ConnKind *)events[i].data.ptr == CONN_STREAM) {
+                conn_stream_event(events[i].data.ptr, events[i].events);
+                continue;
+            }
+            Conn *c = events[i].data.ptr;
+            if (events[i].events & EPOLLOUT) conn_flush(c);
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                client_readable(c);
+        }
+    }
     return NULL;
 }
 
 
-int main(void) {
+// Raises the open-file soft limit to the hard limit: every connection is an fd.
+static void raise_fd_limit(void) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+
+// Gauges of the admin endpoint: the scheduler's view of the queue.
+static void write_gauges(FILE *out) {
+    scheduler_write_metrics(&g_queue, out);
+}
+
+
+// Prints the command-line synopsis to stderr.
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-c cpus] [-q first_quantum_ms] [-Q rest_quantum_ms]"
+                    " [-r reactors] [-b backlog] [-s shell_workers] [-E burst_file]"
+                    " [-P srjf|mlfq|cfs|edf] [-F] [-w client:weight]... [-m max_queued]"
+                    " [-M max_running] [-A wall|cpu] [-a admin_port] [-l level] [-j]\n", prog);
+}
+
+
+int main(int argc, char *argv[]) {
+    SchedConfig cfg;
+    scheduler_default_config(&cfg);
+    int         nreactors  = DEFAULT_REACTORS;
+    int         backlog    = DEFAULT_BACKLOG;
+    const char *burst_file = PREDICT_FILE;
+    int         admin_port = 0;
+    int         log_level  = LL_INFO;
+    int         log_json   = 0;
+
+    // started by a shell worker as its helper process (helper.c)
+    if (argc == 2 && strcmp(argv[1], HELPER_ARG) == 0)
+        return helper_main(HELPER_FD);
+
+    int opt_ch;
+    while ((opt_ch = getopt(argc, argv, "c:q:Q:r:b:s:E:P:Fw:m:M:A:a:l:j")) != -1) {
+        switch (opt_ch) {
+        case 'c':
+            cfg.ncpus = atoi(optarg);
+            if (cfg.ncpus == 0) {
+                cfg.ncpus = (int)sysconf(_SC_NPROCESSORS_ONLN);  // one worker per online core
+                if (cfg.ncpus > MAX_CPUS) cfg.ncpus = MAX_CPUS;
+            }
+            if (cfg.ncpus < 1 || cfg.ncpus > MAX_CPUS) {
+                fprintf(stderr, "Error: cpus must be between 1 and %d\n", MAX_CPUS);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'q':
+        case 'Q': {
+            long ms = atol(optarg);
+            if (ms <= 0) {
+                fprintf(stderr, "Error: quantum must be a positive number of milliseconds\n");
+                exit(EXIT_FAILURE);
+            }
+            if (opt_ch == 'q') cfg.quantum_first_ns = ms * NSEC_PER_MS;
+            else               cfg.quantum_rest_ns  = ms * NSEC_PER_MS;
+            break;
+        }
+        case 'r':
+            nreactors = atoi(optarg);
+            if (nreactors < 1 || nreactors > MAX_REACTORS) {
+                fprintf(stderr, "Error: reactors must be between 1 and %d\n", MAX_REACTORS);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'b':
+            backlog = atoi(optarg);
+            if (backlog < 1) {
+                fprintf(stderr, "Error: backlog must be positive\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 's':
+            cfg.nshell = atoi(optarg);
+            if (cfg.nshell < 1 || cfg.nshell > MAX_SHELL_WORKERS) {
+                fprintf(stderr, "Error: shell workers must be between 1 and %d\n", MAX_SHELL_WORKERS);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'E':
+            burst_file = optarg[0] != '\0' ? optarg : NULL;  // -E '' keeps estimates in memory
+            break;
+        case 'P':
+            cfg.policy = policy_find(optarg);
+            if (cfg.policy == NULL) {
+                fprintf(stderr, "Error: unknown policy '%s' (srjf, mlfq, cfs or edf)\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'F':
+            cfg.fair_share = 1;
+            break;
+        case 'w': {
+            int client, weight;
+            char end;
+            if (sscanf(optarg, "%d:%d%c", &client, &weight, &end) != 2 || client < 1 || weight < 1) {
+                fprintf(stderr, "Error: weight must be client:weight with both positive\n");
+                exit(EXIT_FAILURE);
+            }
+            if (cfg.nweights == MAX_CLIENT_WEIGHTS) {
+                fprintf(stderr, "Error: at most %d weights\n", MAX_CLIENT_WEIGHTS);
+                exit(EXIT_FAILURE);
+            }
+            cfg.weights[cfg.nweights].client_num = client;
+            cfg.weights[cfg.nweights].weight     = weight;
+            cfg.nweights++;
+            break;
+        }
+        case 'm':
+        case 'M': {
+            int n = atoi(optarg);
+            if (n < 0) {
+                fprintf(stderr, "Error: per-client limits must be 0 (unlimited) or positive\n");
+                exit(EXIT_FAILURE);
+            }
+            if (opt_ch == 'm') cfg.max_queued  = n;
+            else               cfg.max_running = n;
+            break;
+        }
+        case 'A':
+            if      (strcmp(optarg, "wall") == 0) cfg.account_cpu = 0;
+            else if (strcmp(optarg, "cpu")  == 0) cfg.account_cpu = 1;
+            else {
+                fprintf(stderr, "Error: accounting must be wall or cpu\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'a':
+            admin_port = atoi(optarg);
+            if (admin_port < 1 || admin_port > 65535 || admin_port == PORT) {
+                fprintf(stderr, "Error: admin port must be between 1 and 65535 and not %d\n", PORT);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'l':
+            log_level = log_level_parse(optarg);
+            if (log_level < 0) {
+                fprintf(stderr, "Error: log level must be debug, info, warn or error\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'j':
+            log_json = 1;
+            break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // from here on the threads log through per-thread buffers and a writer thread
+    log_init((LogLevel)log_level, log_json);
+    if (log_start() < 0) perror("log_start");  // messages are then written directly
+
+    // a client that disconnects mid-send must not kill the server with SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+    raise_fd_limit();
+
     // create a named semaphore (value=1) to protect client_counter
     sem_unlink(CLIENT_SEM_NAME);  // remove stale instance from a previous run
     client_sem = sem_open(CLIENT_SEM_NAME, O_CREAT | O_EXCL, 0600, 1);
     if (client_sem == SEM_FAILED) { perror("sem_open"); exit(EXIT_FAILURE); }
 
-    // create the TCP server socket
-    int server_fd, opt = 1;
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+    // create the non-blocking TCP server socket; reactors accept until EAGAIN
+    int opt = 1;
+    if ((g_listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
         perror("socket"); exit(EXIT_FAILURE);
     }
 
     // SO_REUSEADDR lets the server rebind immediately after a restart
     // without waiting for the port to leave the TIME_WAIT state
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-        perror("setsockopt"); close(server_fd); exit(EXIT_FAILURE);
+    if (setsockopt(g_listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+        perror("setsockopt"); close(g_listen_fd); exit(EXIT_FAILURE);
     }
 
     // bind to all interfaces on PORT
@@ -158,71 +494,56 @@ int main(void) {
     address.sin_addr.s_addr = INADDR_ANY;
     address.sin_port        = htons(PORT);
 
-    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
-        perror("bind"); close(server_fd); exit(EXIT_FAILURE);
+    if (bind(g_listen_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("bind"); close(g_listen_fd); exit(EXIT_FAILURE);
     }
-    if (listen(server_fd, 5) < 0) {
-        perror("listen"); close(server_fd); exit(EXIT_FAILURE);
+    if (listen(g_listen_fd, backlog) < 0) {
+        perror("listen"); close(g_listen_fd); exit(EXIT_FAILURE);
     }
 
-    // initialise the shared task queue and spawn the dedicated scheduler thread
-    scheduler_init(&g_queue);
+    // burst estimates learned by earlier runs
+    predict_init(burst_file);
 
-    pthread_t sched_thread;
-    if (pthread_create(&sched_thread, NULL, scheduler_run, &g_queue) != 0) {
-        perror("pthread_create scheduler"); close(server_fd); exit(EXIT_FAILURE);
+    // initialise the shared task queue and spawn one worker thread per CPU
+    scheduler_init(&g_queue, &cfg);
+    if (scheduler_start(&g_queue) < 0) {
+        close(g_listen_fd); exit(EXIT_FAILURE);
     }
-    pthread_detach(sched_thread);  // scheduler runs forever; no need to join it
-
-    printf("| Hello, Server Started |\n");
-    printf("----------------------------\n");
-    fflush(stdout);
-
-    int thread_counter = 0;  // used only to assign thread_num (for info struct)
-
-    // accept loop: one iteration per incoming client connection
-    while (1) {
-        struct sockaddr_in client_addr;
-        socklen_t addrlen   = sizeof(client_addr);
-        int       client_fd = accept(server_fd, (struct sockaddr *)&client_addr, &addrlen);
-        if (client_fd < 0) {
-            // accept() can fail transiently (e.g., interrupted by a signal)
-            fprintf(stderr, "[ERROR] accept: %s\n", strerror(errno));
-            continue;
-        }
 
-        // assign unique client and thread numbers atomically under the semaphore
-        int client_num, thread_num;
-        sem_wait(client_sem);
-        client_num = ++client_counter;
-        thread_num = ++thread_counter;
-        sem_post(client_sem);
+    // metrics for a local scraper
+    if (admin_port > 0 && metrics_start(admin_port, write_gauges) < 0) {
+        perror("metrics admin port"); close(g_listen_fd); exit(EXIT_FAILURE);
+    }
 
-        // allocate the per-client struct; the client thread frees it on exit
-        client_info_t *info = malloc(sizeof(client_info_t));
-        if (!info) {
-            fprintf(stderr, "[ERROR] malloc: %s\n", strerror(errno));
-            close(client_fd);
-            continue;
+    // one epoll instance per reactor, each watching the listening socket;
+    // EPOLLEXCLUSIVE wakes a single reactor per incoming connection
+    static Reactor reactors[MAX_REACTORS];
+    for (int i = 0; i < nreactors; i++) {
+        reactors[i].id       = i;
+        reactors[i].epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (reactors[i].epoll_fd < 0) { perror("epoll_create1"); exit(EXIT_FAILURE); }
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events   = EPOLLIN | (nreactors > 1 ? EPOLLEXCLUSIVE : 0);
+        ev.data.ptr = NULL;  // NULL marks the listening socket
+        if (epoll_ctl(reactors[i].epoll_fd, EPOLL_CTL_ADD, g_listen_fd, &ev) < 0) {
+            perror("epoll_ctl listen"); exit(EXIT_FAILURE);
         }
-        info->client_fd   = client_fd;
-        info->client_addr = client_addr;
-        info->client_num  = client_num;
-        info->thread_num  = thread_num;
-
-        // spawn a thread for this client; detach so it cleans up automatically on exit
-        pthread_t thread;
-        if (pthread_create(&thread, NULL, ThreadFunction, info) != 0) {
-            fprintf(stderr, "[ERROR] pthread_create: %s\n", strerror(errno));
-            close(client_fd);
-            free(info);
-            continue;
+    }
+    for (int i = 1; i < nreactors; i++) {
+        if (pthread_create(&reactors[i].thread, NULL, reactor_run, &reactors[i]) != 0) {
+            perror("pthread_create reactor"); exit(EXIT_FAILURE);
         }
-        pthread_detach(thread);
+        pthread_detach(reactors[i].thread);
     }
 
+    log_msg(LL_INFO, LOG_NO_CLIENT, "start", "| Hello, Server Started |\n----------------------------");
+
+    reactor_run(&reactors[0]);  // the main thread serves as reactor 0
+
     // unreachable during normal operation; here for completeness
-    close(server_fd);
+    close(g_listen_fd);
     sem_close(client_sem);
     sem_unlink(CLIENT_SEM_NAME);
     scheduler_cleanup(&g_queue);
@@ -1,83 +1,62 @@
+#define _GNU_SOURCE              // pipe2 on Linux
 #define _POSIX_C_SOURCE 200809L
 
 #include "shell.h"
 #include "parse.h"
+#include "pcache.h"
 #include "execute.h"
-#include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <sys/wait.h>
+#include <fcntl.h>
+
+#define PARSE_ERROR_MAX   256   // longest syntax error message
+
+// The commands are spawned directly from this process; there is no
+// intermediate shell process, and the group they form lets kill(-job->pgid, ...)
+// reach all of them. A command seen before is not parsed again: its Pipeline
+// comes from the parse cache (pcache.c), which pipeline_start() only reads.
+int shell_run(const char *cmd, int out_fd, Job *job) {
+    char         err[PARSE_ERROR_MAX];
+    PCacheEntry *parsed;
+
+    job_init(job);
+
+    int count = pcache_get(cmd, &parsed, err, sizeof(err));
+    if (count == -1) {
+        // the message is far smaller than a pipe, so this write cannot block
+        if (err[0] == '\0') strcpy(err, "Error: Out of memory\n");
+        ssize_t n = write(out_fd, err, strlen(err));
+        (void)n;
+        job->last_status = 2;
+        return 0;
+    }
+    if (count == 0) return 0;  // empty input exits quietly
+
+    // stdin is /dev/null: a remote command must not read the server's terminal,
+    // and a builtin cat without operands ends at once instead of blocking
+    int null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (null_fd < 0) { pcache_put(parsed); return -1; }
+    SpawnIO io = { null_fd, out_fd, out_fd, 0 };
+    int     rc = pipeline_start(&parsed->pipeline, &io, job);
+    close(null_fd);
+    pcache_put(parsed);
+    return rc;
+}
 
-#define CMD_OUTPUT_SIZE 8192
 
-// Executes a shell command string by parsing and running it in a child process.
-// Captures all output (stdout and stderr) and returns it as a heap-allocated string.
-// The caller must free this string. If an error occurs, returns an error message string.
-char* execute_command(const char* cmd) {
+// The pipe is close-on-exec so children spawned concurrently by other threads
+// never inherit (and hold open) this command's write end.
+int shell_start(const char *cmd, int *out_fd, Job *job) {
     int pipefd[2];
-    if (pipe(pipefd) < 0) {
-        return strdup("Error: pipe failed\n");
-    }
-
-    pid_t pid = fork();
-    if (pid < 0) {
-        close(pipefd[0]);
-        close(pipefd[1]);
-        return strdup("Error: fork failed\n");
-    }
+    if (pipe2(pipefd, O_CLOEXEC) < 0) return -1;
 
-    if (pid == 0) {
-        // --- CHILD process ---
+    if (shell_run(cmd, pipefd[1], job) < 0) {
         close(pipefd[0]);
-        dup2(pipefd[1], STDOUT_FILENO);
-        dup2(pipefd[1], STDERR_FILENO);
         close(pipefd[1]);
-
-        Pipeline pipeline = parse_input(cmd);
-        if (pipeline.command_count == -1) {
-            // parse_input already printed the specific error message
-            _exit(1);
-        }
-        if (pipeline.command_count == 0) {
-            // Empty input: exit quietly
-            _exit(0);
-        }
-
-        execute_pipeline(&pipeline);
-        free_pipeline(&pipeline);
-        _exit(0);
-    }
-
-    // --- PARENT process ---
-    close(pipefd[1]);
-
-    char* output = malloc(CMD_OUTPUT_SIZE);
-    if (!output) {
-        close(pipefd[0]);
-        waitpid(pid, NULL, 0);
-        return NULL;
-    }
-
-    size_t total = 0;
-    ssize_t n;
-    // Read all bytes from the pipe until the child closes it or buffer is full
-    while ((n = read(pipefd[0], output + total, CMD_OUTPUT_SIZE - 1 - total)) > 0) {
-        total += (size_t)n;
-        if (total >= CMD_OUTPUT_SIZE - 1) break;
+        return -1;
     }
-    output[total] = '\0'; // Null-terminate the output string
-    close(pipefd[0]);
-
-    int status;
-    // Wait for child to finish
-    waitpid(pid, &status, 0);
-
-    // If the child failed and produced no output, synthesize an error message
-    if (total == 0 && WIFEXITED(status) && WEXITSTATUS(status) != 0) {
-        free(output);
-        return strdup("Error: Command not found\n");
-    }
-
-    return output;
+    close(pipefd[1]);  // the commands hold the only write references now
+    *out_fd = pipefd[0];
+    return 0;
 }
+
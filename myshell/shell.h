@@ -1,13 +1,30 @@
 // shell.h
-// Declares execute_command(), which runs a shell command string and returns
-// its output as a heap-allocated string. The caller must free the string.
+// Runs a shell command string (parse.c + execute.c) with its stdout and stderr
+// on a pipe. shell_start() hands the pipe to the caller so output can be
+// streamed; shell_run() is the common part, also used by the server's helper
+// processes (helper.c).
 
 #ifndef SHELL_H
 #define SHELL_H
 
-// Forks a child process, executes cmd through the parser and executor,
-// captures all stdout and stderr output via a pipe, and returns it.
-// Returns a string starting with "Error:" if the command fails or is not found.
-char *execute_command(const char *cmd);
+#include "execute.h"
+
+// Parses cmd (or takes it from the parse cache) in the calling thread and starts
+// its pipeline with stdin on
+// /dev/null, stdout and stderr on out_fd (which the caller keeps), and the
+// commands in a new process group (job->pgid). A syntax error is written to out_fd with nothing started and
+// status 2. The caller must pipeline_wait() and pipeline_release() job.
+// Returns 0 on success, -1 if a pipe or fork fails.
+int shell_run(const char *cmd, int out_fd, Job *job);
+
+// Parses cmd in the calling thread and starts its pipeline with stdout and
+// stderr redirected into a new pipe, the commands in a new process group
+// (job->pgid). Stores the pipe's read end (close-on-exec) in *out_fd. A syntax
+// error is written to the pipe with nothing started and status 2.
+// The caller must pipeline_wait() and pipeline_release() job while something
+// else drains the pipe: a builtin in the last stage runs inside pipeline_wait()
+// and holds a write end until then, so reading to EOF first never finishes.
+// Returns 0 on success, -1 if a pipe or fork fails.
+int shell_start(const char *cmd, int *out_fd, Job *job);
 
 #endif /* SHELL_H */
@@ -0,0 +1,87 @@
+#include "spawn.h"
+#include "pathcache.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+
+extern char **environ;
+
+// Adds a dup2(fd, target) file action unless fd is -1 (inherit) or already the
+// target. Returns 0 or an error number.
+static int add_dup(posix_spawn_file_actions_t *fa, int fd, int target) {
+    if (fd < 0 || fd == target) return 0;
+    return posix_spawn_file_actions_adddup2(fa, fd, target);
+}
+
+// Every fd the caller opens for a child is close-on-exec, so dup2() onto its
+// target is all the child needs: the exec closes the originals, and descriptors
+// opened concurrently by other threads never leak into it.
+static pid_t spawn_common(const char *path, char *const argv[], const SpawnIO *io,
+                          int extra_fd, int target) {
+    posix_spawn_file_actions_t fa;
+    posix_spawnattr_t          attr;
+    sigset_t                   none, dfl;
+    short                      flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+    pid_t                      pid   = -1;
+    int                        rc;
+
+    if ((rc = posix_spawn_file_actions_init(&fa)) != 0) { errno = rc; return -1; }
+    if ((rc = posix_spawnattr_init(&attr)) != 0) {
+        posix_spawn_file_actions_destroy(&fa);
+        errno = rc;
+        return -1;
+    }
+
+    // stdio wiring
+    rc = add_dup(&fa, io->in_fd, STDIN_FILENO);
+    if (rc == 0) rc = add_dup(&fa, io->out_fd, STDOUT_FILENO);
+    if (rc == 0) rc = add_dup(&fa, io->err_fd, STDERR_FILENO);
+    if (rc == 0) rc = add_dup(&fa, extra_fd, target);
+
+    // a clean signal state: nothing blocked, SIGPIPE back to default so a
+    // pipeline stage dies when its reader goes away
+    sigemptyset(&none);
+    sigemptyset(&dfl);
+    sigaddset(&dfl, SIGPIPE);
+    if (rc == 0) rc = posix_spawnattr_setsigmask(&attr, &none);
+    if (rc == 0) rc = posix_spawnattr_setsigdefault(&attr, &dfl);
+
+    if (rc == 0 && io->pgroup >= 0) {
+        flags |= POSIX_SPAWN_SETPGROUP;
+        rc = posix_spawnattr_setpgroup(&attr, io->pgroup);
+    }
+    if (rc == 0) rc = posix_spawnattr_setflags(&attr, flags);
+
+    if (rc == 0) rc = posix_spawnp(&pid, path, &fa, &attr, argv, environ);
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&fa);
+    if (rc != 0) { errno = rc; return -1; }
+    return pid;
+}
+
+
+// A name found in the path cache is started by its full path, which
+// posix_spawnp() execs without searching; a name known to be missing fails
+// here without starting anything.
+pid_t spawn_process(char *const argv[], const SpawnIO *io) {
+    char path[PATH_MAX];
+    switch (path_resolve(argv[0], path, sizeof(path))) {
+    case PATH_FOUND:
+        return spawn_common(path, argv, io, -1, -1);
+    case PATH_MISSING:
+        errno = ENOENT;
+        return -1;
+    default:
+        return spawn_common(argv[0], argv, io, -1, -1);
+    }
+}
+
+
+pid_t spawn_process_fd(const char *path, char *const argv[], const SpawnIO *io,
+                       int fd, int target) {
+    return spawn_common(path, argv, io, fd, target);
+}
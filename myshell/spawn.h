@@ -0,0 +1,40 @@
+// spawn.h
+// Process launch layer shared by the interactive shell and the server.
+// Children are started with posix_spawn(), which glibc implements with
+// clone(CLONE_VM|CLONE_VFORK): the child borrows the parent's address space
+// until it execs instead of copying its page tables, so a launch costs the same
+// however much memory the server has mapped. The stdio wiring is expressed as
+// spawn file actions, so no code of ours runs in the child. Command names are
+// resolved to full paths in the parent (pathcache.c), so the child execs once
+// instead of trying every PATH directory.
+
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include <sys/types.h>
+
+// How a child's standard streams and process group are set up.
+typedef struct {
+    int   in_fd;    // becomes stdin;  -1 = inherit the caller's
+    int   out_fd;   // becomes stdout; -1 = inherit the caller's
+    int   err_fd;   // becomes stderr; -1 = inherit the caller's
+    pid_t pgroup;   // -1 = stay in the caller's group, 0 = lead a new one, >0 = join that one
+} SpawnIO;
+
+#define SPAWN_IO_INHERIT { -1, -1, -1, -1 }
+
+// Starts argv[0] (looked up in PATH through pathcache.c) with argv as its
+// arguments and its stdio and process group set up as described by io. Signals
+// the caller ignores or blocks (the server ignores SIGPIPE) are reset to their
+// defaults in the child.
+// Returns the child's pid, or -1 with errno set: ENOENT or EACCES if the program
+// could not be executed, or the error of a failed fork or file action.
+pid_t spawn_process(char *const argv[], const SpawnIO *io);
+
+// Like spawn_process(), but runs the program at path (argv[0] is only its name)
+// and also passes fd to the child as descriptor target (above 2), which stays
+// open across the exec.
+pid_t spawn_process_fd(const char *path, char *const argv[], const SpawnIO *io,
+                       int fd, int target);
+
+#endif /* SPAWN_H */
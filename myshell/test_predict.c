@@ -0,0 +1,63 @@
+// test_predict.c
+// Checks of the burst predictor (predict.c) that SRJF's ordering relies on.
+// Usage: ./test_predict   (or make check)
+// Prints one line per check and exits 1 if any failed.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "predict.h"
+
+#include <stdio.h>
+
+#define NSEC_PER_SEC 1000000000LL
+#define FALLBACK_NS  (5 * NSEC_PER_SEC)
+
+static int failures;
+
+
+// Reports one check.
+static void check(int ok, const char *what) {
+    printf("%s  %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok) failures++;
+}
+
+
+int main(void) {
+    predict_init(NULL);  // in memory only
+
+    // never seen: the numeric last argument is the guess
+    check(predict_burst("./demo 20", FALLBACK_NS) == 20 * NSEC_PER_SEC,
+          "unseen ./demo 20 is predicted from its argument");
+
+    // a run of ./demo 2 must not make ./demo 20 look as short as it
+    predict_record("./demo 2", 2 * NSEC_PER_SEC);
+    int64_t short_job = predict_burst("./demo 2", FALLBACK_NS);
+    int64_t long_job  = predict_burst("./demo 20", FALLBACK_NS);
+    check(short_job == 2 * NSEC_PER_SEC, "./demo 2 is predicted from its own run");
+    check(long_job > short_job, "./demo 20 still ranks behind ./demo 2");
+    check(long_job == 20 * NSEC_PER_SEC, "./demo 20 is the shape's rate times 20");
+
+    // a program that runs slower than its argument says is scaled the same way
+    predict_record("./work cpu 1", 3 * NSEC_PER_SEC);
+    check(predict_burst("./work cpu 4", FALLBACK_NS) == 12 * NSEC_PER_SEC,
+          "./work cpu 4 is scaled from ./work cpu 1");
+
+    // the exact text wins over the shape once it has run
+    predict_record("./demo 20", 21 * NSEC_PER_SEC);
+    check(predict_burst("./demo 20", FALLBACK_NS) == 21 * NSEC_PER_SEC,
+          "./demo 20 is predicted from its own run once it has one");
+
+    // no numeric argument: the shape estimate is used as is
+    predict_record("./sort -r a.txt", 3 * NSEC_PER_SEC);
+    check(predict_burst("./sort -r b.txt", FALLBACK_NS) == 3 * NSEC_PER_SEC,
+          "./sort -r b.txt takes the shape's estimate unscaled");
+    check(predict_burst("./unknown", FALLBACK_NS) == FALLBACK_NS,
+          "an unseen command without arguments gets the fallback");
+
+    if (failures > 0) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,92 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "usage.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NSEC_PER_SEC 1000000000LL
+
+
+// Reads /proc/<pid>/<name> into buf (size bytes, NUL-terminated).
+// Returns the number of bytes read, or -1 if the file cannot be read.
+static int read_proc(pid_t pid, const char *name, char *buf, size_t size) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/%s", (int)pid, name);
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    size_t n = fread(buf, 1, size - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+    return (int)n;
+}
+
+
+// Stores the number after "key" in text into *value; leaves it alone if the key is absent.
+static void field(const char *text, const char *key, long long *value) {
+    const char *p = strstr(text, key);
+    if (p) sscanf(p + strlen(key), "%lld", value);
+}
+
+
+int usage_read(pid_t pid, Usage *u) {
+    clockid_t       clock;
+    struct timespec ts;
+    if (clock_getcpuclockid(pid, &clock) != 0 || clock_gettime(clock, &ts) != 0) return -1;
+    u->cpu_ns = (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+
+    // utime and stime are fields 14 and 15, counted after the ")" that ends
+    // the command name (which may itself contain spaces)
+    char buf[4096];
+    if (read_proc(pid, "stat", buf, sizeof(buf)) > 0) {
+        const char        *p = strrchr(buf, ')');
+        unsigned long long utime, stime;
+        long               hz = sysconf(_SC_CLK_TCK);
+        if (p && hz > 0 &&
+            sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+                   &utime, &stime) == 2) {
+            u->user_ns = (int64_t)(utime * NSEC_PER_SEC / (unsigned long long)hz);
+            u->sys_ns  = (int64_t)(stime * NSEC_PER_SEC / (unsigned long long)hz);
+        }
+    }
+
+    long long v;
+    if (read_proc(pid, "status", buf, sizeof(buf)) > 0) {
+        v = u->max_rss_kb; field(buf, "VmHWM:", &v);                      u->max_rss_kb = (long)v;
+        v = u->vol_csw;    field(buf, "\nvoluntary_ctxt_switches:", &v);  u->vol_csw    = (long)v;
+        v = u->invol_csw;  field(buf, "nonvoluntary_ctxt_switches:", &v); u->invol_csw  = (long)v;
+    }
+    if (read_proc(pid, "io", buf, sizeof(buf)) > 0) {
+        v = u->io_read;    field(buf, "rchar:", &v);              u->io_read    = v;
+        v = u->io_write;   field(buf, "wchar:", &v);              u->io_write   = v;
+        v = u->disk_read;  field(buf, "\nread_bytes:", &v);       u->disk_read  = v;
+        v = u->disk_write; field(buf, "\nwrite_bytes:", &v);      u->disk_write = v;
+    }
+    return 0;
+}
+
+
+void usage_from_rusage(Usage *u, const struct rusage *ru) {
+    u->user_ns    = (int64_t)ru->ru_utime.tv_sec * NSEC_PER_SEC + (int64_t)ru->ru_utime.tv_usec * 1000;
+    u->sys_ns     = (int64_t)ru->ru_stime.tv_sec * NSEC_PER_SEC + (int64_t)ru->ru_stime.tv_usec * 1000;
+    u->cpu_ns     = u->user_ns + u->sys_ns;
+    u->max_rss_kb = ru->ru_maxrss;
+    u->vol_csw    = ru->ru_nvcsw;
+    u->invol_csw  = ru->ru_nivcsw;
+}
+
+
+void usage_add(Usage *total, const Usage *u) {
+    total->cpu_ns     += u->cpu_ns;
+    total->user_ns    += u->user_ns;
+    total->sys_ns     += u->sys_ns;
+    total->vol_csw    += u->vol_csw;
+    total->invol_csw  += u->invol_csw;
+    total->io_read    += u->io_read;
+    total->io_write   += u->io_write;
+    total->disk_read  += u->disk_read;
+    total->disk_write += u->disk_write;
+    if (u->max_rss_kb > total->max_rss_kb) total->max_rss_kb = u->max_rss_kb;
+}
@@ -0,0 +1,44 @@
+// usage.h
+// Resource consumption of a program, as the kernel accounts it.
+//
+// The scheduler's own clock only says how long a program held a simulated CPU;
+// it cannot tell a program that computed for the whole slice from one that sat
+// blocked on a pipe or a disk. These figures come from the kernel instead: a
+// running or stopped program is read from /proc/<pid>/{stat,status,io} and its
+// CPU clock (clock_getcpuclockid()), an exited one from the rusage returned
+// when it is reaped. Counters are cumulative over the program's life.
+
+#ifndef USAGE_H
+#define USAGE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+typedef struct {
+    int64_t cpu_ns;          // user + system CPU time
+    int64_t user_ns;
+    int64_t sys_ns;
+    long    max_rss_kb;      // peak resident set size
+    long    vol_csw;         // context switches from blocking (I/O, sleep)
+    long    invol_csw;       // context switches forced by the kernel's scheduler
+    int64_t io_read;         // bytes through read()-like calls, pipes included
+    int64_t io_write;        // bytes through write()-like calls
+    int64_t disk_read;       // bytes fetched from storage
+    int64_t disk_write;      // bytes sent to storage
+} Usage;
+
+// Reads the consumption of process pid, which must not have been reaped yet.
+// Returns 0 on success, -1 if its CPU clock could not be read; fields whose
+// /proc file is missing keep their previous value.
+int usage_read(pid_t pid, Usage *u);
+
+// Replaces the CPU, memory and context-switch figures of u by those reported
+// for a reaped child (wait4()); its I/O counters must be read before reaping.
+void usage_from_rusage(Usage *u, const struct rusage *ru);
+
+// Adds the consumption of one finished program to a running total (max_rss_kb
+// keeps the largest).
+void usage_add(Usage *total, const Usage *u);
+
+#endif /* USAGE_H */
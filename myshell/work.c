@@ -0,0 +1,296 @@
+// work.c
+// Synthetic workload programs for the scheduler, the loaded counterparts of demo.
+// Usage: ./work cpu   N
+//        ./work mem   [-m MB] N
+//        ./work disk  [-b KB] [-d dir] N
+//        ./work pipe  [-b KB] N
+//        ./work mixed N
+//   N       the burst in seconds, fractions allowed; the last argument, so the
+//           server predicts it the way it does for ./demo N
+//   cpu     integer arithmetic in registers: N seconds of work as calibrated
+//           against this process's own CPU clock, so it needs N CPU-seconds
+//           however many other programs compete for the cores
+//   mem     streams a buffer of -m MB (default 64, beyond the caches) through
+//           a scale-and-add pass; N seconds of work, calibrated like cpu
+//   disk    writes -b KB blocks (default 64) to an unlinked file in -d (default
+//           /tmp), syncing every MB, for N seconds: mostly waiting on the disk
+//   pipe    writes -b KB of text (default 64) to stdout as fast as it is
+//           drained, for N seconds: exercises the server's output streaming
+//   mixed   cycles through cpu, mem, disk and sleep phases of 250 ms each until
+//           N seconds have passed
+// Every mode prints a line per second of progress ("cpu 1/3") and a final line
+// with the wall-clock and CPU time used. Time spent stopped by the scheduler
+// (SIGSTOP) is not counted towards N in the timed modes, just as it is not
+// progress for the calibrated ones.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+
+#define NSEC_PER_SEC   1000000000LL
+#define NSEC_PER_MS       1000000LL
+#define CALIBRATE_MS          50   // CPU time spent measuring the work rate
+#define PHASE_MS             250   // length of each phase of mixed
+#define SYNC_BYTES   (1L << 20)    // disk: fdatasync() after this many bytes
+#define DISK_WRAP    (64L << 20)   // disk: rewrite from the start past this size
+#define CPU_UNIT_OPS      100000   // loop iterations in one unit of cpu work
+
+typedef struct {
+    const char *mode;
+    double      burst_s;       // N
+    int         shown;         // progress lines printed
+    size_t      mem_bytes;     // -m
+    size_t      block;         // -b
+    const char *dir;           // -d
+
+    // mem buffers, allocated on first use
+    double     *src, *dst;
+    size_t      nelem;
+
+    // disk file, opened on first use
+    int         fd;
+    long        written;       // bytes since the last sync
+    long        offset;
+    char       *buf;
+
+    // running time: wall-clock time without the stops
+    int64_t     run_ns;
+    int64_t     last_ns;
+} Work;
+
+static volatile sig_atomic_t resumed;
+static volatile uint64_t     sink;   // keeps the cpu loop from being optimised away
+
+
+static int64_t clock_ns(clockid_t id) {
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+
+// SIGCONT: the process was stopped since running_ns() last looked at the clock.
+static void on_cont(int sig) {
+    (void)sig;
+    resumed = 1;
+}
+
+
+// Returns the running time so far. The interval in which a SIGCONT arrived
+// spans a stop and is not counted, so this must be called at least every few
+// milliseconds while work is being done.
+static int64_t running_ns(Work *w) {
+    int64_t now = clock_ns(CLOCK_MONOTONIC);
+    if (resumed) resumed = 0;
+    else         w->run_ns += now - w->last_ns;
+    w->last_ns = now;
+    return w->run_ns;
+}
+
+
+// Prints a progress line for every whole second in done_s not yet reported.
+static void progress(Work *w, double done_s) {
+    while (w->shown + 1 <= done_s && w->shown + 1 <= w->burst_s) {
+        printf("%s %d/%g\n", w->mode, ++w->shown, w->burst_s);
+        fflush(stdout);
+    }
+}
+
+
+// One unit of cpu work: a multiply-xorshift chain that stays in registers.
+static void cpu_unit(void) {
+    uint64_t x = sink | 1;
+    for (int i = 0; i < CPU_UNIT_OPS; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x *= 0x9E3779B97F4A7C15ULL;
+    }
+    sink = x;
+}
+
+
+// One unit of mem work: one pass of dst = src * s + dst over the whole buffer.
+// Returns -1 if the buffer cannot be allocated.
+static int mem_unit(Work *w) {
+    if (w->src == NULL) {
+        w->nelem = w->mem_bytes / 2 / sizeof(double);
+        w->src   = malloc(w->nelem * sizeof(double));
+        w->dst   = malloc(w->nelem * sizeof(double));
+        if (!w->src || !w->dst) { perror("work: malloc"); return -1; }
+        for (size_t i = 0; i < w->nelem; i++) { w->src[i] = (double)i; w->dst[i] = 0; }
+    }
+    for (size_t i = 0; i < w->nelem; i++) w->dst[i] += 0.5 * w->src[i];
+    return 0;
+}
+
+
+// Measures units per CPU-second of unit by running it for CALIBRATE_MS of
+// this process's CPU time; the work done meanwhile counts. A first unit,
+// which pays for allocating and faulting in buffers, is not timed.
+// Returns the rate, or -1 if unit failed.
+static double calibrate(Work *w, int (*unit)(Work *), long *done) {
+    if (unit(w) < 0) return -1;
+    int64_t start = clock_ns(CLOCK_PROCESS_CPUTIME_ID), used;
+    *done = 0;
+    do {
+        if (unit(w) < 0) return -1;
+        (*done)++;
+        used = clock_ns(CLOCK_PROCESS_CPUTIME_ID) - start;
+    } while (used < CALIBRATE_MS * NSEC_PER_MS);
+    return (double)*done * NSEC_PER_SEC / (double)used;
+}
+
+
+static int cpu_step(Work *w) {
+    (void)w;
+    cpu_unit();
+    return 0;
+}
+
+
+// cpu and mem: a fixed amount of work, burst_s seconds at the calibrated rate.
+static int run_calibrated(Work *w, int (*unit)(Work *)) {
+    long   done;
+    double rate = calibrate(w, unit, &done);
+    if (rate < 0) return -1;
+    long total = (long)(w->burst_s * rate + 0.5);
+    for (; done < total; done++) {
+        if (unit(w) < 0) return -1;
+        progress(w, done / rate);
+    }
+    progress(w, w->burst_s);
+    return 0;
+}
+
+
+// One disk block: written at the current offset, synced every SYNC_BYTES.
+// Returns -1 on error.
+static int disk_block(Work *w) {
+    if (w->fd < 0) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/work-disk-XXXXXX", w->dir);
+        if ((w->fd = mkstemp(path)) < 0) { perror("work: mkstemp"); return -1; }
+        unlink(path);   // the space is returned when the program exits
+    }
+    if (pwrite(w->fd, w->buf, w->block, w->offset) != (ssize_t)w->block) {
+        perror("work: write");
+        return -1;
+    }
+    w->offset  = w->offset + (long)w->block >= DISK_WRAP ? 0 : w->offset + (long)w->block;
+    w->written += (long)w->block;
+    if (w->written >= SYNC_BYTES) {
+        w->written = 0;
+        if (fdatasync(w->fd) < 0) { perror("work: fdatasync"); return -1; }
+    }
+    return 0;
+}
+
+
+// One pipe block to stdout; blocks while the reader is behind.
+static int pipe_block(Work *w) {
+    size_t off = 0;
+    while (off < w->block) {
+        ssize_t n = write(STDOUT_FILENO, w->buf + off, w->block - off);
+        if (n < 0) { perror("work: write"); return -1; }
+        off += (size_t)n;
+    }
+    return 0;
+}
+
+
+// One slice of the mixed mode: the phase is chosen by the running time.
+static int mixed_step(Work *w) {
+    switch ((int)(w->run_ns / (PHASE_MS * NSEC_PER_MS)) % 4) {
+    case 0:  cpu_unit(); return 0;
+    case 1:  return mem_unit(w);
+    case 2:  return disk_block(w);
+    default: {
+        struct timespec ts = { 0, NSEC_PER_MS };
+        nanosleep(&ts, NULL);
+        return 0;
+    }
+    }
+}
+
+
+// disk, pipe and mixed: repeat step until burst_s seconds of running time.
+static int run_timed(Work *w, int (*step)(Work *)) {
+    int64_t limit = (int64_t)(w->burst_s * NSEC_PER_SEC);
+    w->last_ns = clock_ns(CLOCK_MONOTONIC);
+    while (running_ns(w) < limit) {
+        if (step(w) < 0) return -1;
+        progress(w, (double)w->run_ns / NSEC_PER_SEC);
+    }
+    progress(w, w->burst_s);
+    return 0;
+}
+
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s cpu|mem|disk|pipe|mixed [-m MB] [-b KB] [-d dir] N\n", prog);
+}
+
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Work w;
+    memset(&w, 0, sizeof(w));
+    w.mode      = argv[1];
+    w.mem_bytes = 64u << 20;
+    w.block     = 64u << 10;
+    w.dir       = "/tmp";
+    w.fd        = -1;
+
+    int opt;
+    optind = 2;
+    while ((opt = getopt(argc, argv, "m:b:d:")) != -1) {
+        switch (opt) {
+        case 'm': w.mem_bytes = (size_t)atol(optarg) << 20; break;
+        case 'b': w.block     = (size_t)atol(optarg) << 10; break;
+        case 'd': w.dir       = optarg;                     break;
+        default:  usage(argv[0]); return 1;
+        }
+    }
+    char *end;
+    if (optind != argc - 1 || (w.burst_s = strtod(argv[optind], &end)) <= 0 || *end != '\0' ||
+        w.mem_bytes == 0 || w.block == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // text lines for pipe, any bytes for disk
+    if ((w.buf = malloc(w.block)) == NULL) { perror("work: malloc"); return 1; }
+    for (size_t i = 0; i < w.block; i++) w.buf[i] = (i % 64 == 63) ? '\n' : 'a' + (char)(i % 26);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_cont;
+    sa.sa_flags   = SA_RESTART;
+    sigaction(SIGCONT, &sa, NULL);
+
+    int64_t wall = clock_ns(CLOCK_MONOTONIC);
+    int     rc;
+    if      (strcmp(w.mode, "cpu")   == 0) rc = run_calibrated(&w, cpu_step);
+    else if (strcmp(w.mode, "mem")   == 0) rc = run_calibrated(&w, mem_unit);
+    else if (strcmp(w.mode, "disk")  == 0) rc = run_timed(&w, disk_block);
+    else if (strcmp(w.mode, "pipe")  == 0) rc = run_timed(&w, pipe_block);
+    else if (strcmp(w.mode, "mixed") == 0) rc = run_timed(&w, mixed_step);
+    else { usage(argv[0]); return 1; }
+    if (rc < 0) return 1;
+
+    printf("%s done: %.3f s wall, %.3f s CPU\n", w.mode,
+           (double)(clock_ns(CLOCK_MONOTONIC) - wall) / NSEC_PER_SEC,
+           (double)clock_ns(CLOCK_PROCESS_CPUTIME_ID) / NSEC_PER_SEC);
+    return 0;
+}